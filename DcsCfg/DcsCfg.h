@@ -41,6 +41,42 @@ BlockRangeWipe(
 	IN UINT64 end
 	);
 
+EFI_STATUS
+BlockRangeOverwrite(
+	IN EFI_HANDLE h,
+	IN UINT64 start,
+	IN UINT64 end
+	);
+
+extern CHAR16*  gWipePasses;
+extern UINTN    gWipeVerify;
+extern CHAR16*  gWipeReportFile;
+
+enum BlockEraseMethods {
+	BlockEraseNone = 0,
+	BlockEraseSoftware,
+	BlockEraseProtocol,
+	BlockEraseNvmeFormat,
+	BlockEraseNvmeCrypto,
+	BlockEraseAtaBlock,
+	BlockEraseAtaCrypto
+};
+
+extern BOOLEAN gBlockEraseHardware;
+
+CHAR16*
+BlockEraseMethodName(
+	IN UINTN method
+	);
+
+EFI_STATUS
+BlockRangeErase(
+	IN  EFI_HANDLE h,
+	IN  UINT64     start,
+	IN  UINT64     end,
+	OUT UINTN      *method
+	);
+
 //////////////////////////////////////////////////////////////////////////
 // System crypt
 //////////////////////////////////////////////////////////////////////////
@@ -62,6 +98,62 @@ EFI_STATUS
 VolumeChangePassword(
 	IN UINTN index);
 
+extern BOOLEAN gCryptBatch;
+extern CHAR16* gCryptBadLbaLog;
+extern UINT64  gCryptBadCount;
+
+//////////////////////////////////////////////////////////////////////////
+// Progress status (file and volatile variable for OS tools)
+//////////////////////////////////////////////////////////////////////////
+#define DCS_CRYPT_STATUS_VAR        L"DcsCryptStatus"
+#define DCS_CRYPT_STATUS_SIGNATURE  SIGNATURE_32('D','C','S','T')
+
+enum DcsCryptPhase {
+	CryptPhaseNone = 0,
+	CryptPhaseEncrypt,
+	CryptPhaseDecrypt,
+	CryptPhaseWipe,
+	CryptPhaseDone,
+	CryptPhaseStopped,
+	CryptPhaseFailed
+};
+
+#pragma pack(1)
+typedef struct _DCS_CRYPT_STATUS {
+	UINT32   Signature;
+	UINT32   Phase;
+	UINT64   Size;            // sectors
+	UINT64   Remains;         // sectors
+	UINT64   Pos;             // current LBA
+	UINT64   BytesPerSecond;  // smoothed
+	UINT64   EtaSeconds;
+	UINT64   ElapsedSeconds;
+	UINT64   BadSectors;
+} DCS_CRYPT_STATUS;
+#pragma pack()
+
+extern DCS_CRYPT_STATUS gCryptStatus;
+extern CHAR16*          gCryptStatusFile;
+
+VOID
+RangeCryptProgressStart(
+	IN UINT32  phase,
+	IN UINT64  size
+	);
+
+VOID
+RangeCryptProgress(
+	IN UINT64  size,
+	IN UINT64  remains,
+	IN UINT64  pos,
+	IN UINT64  remainsOnStart
+	);
+
+VOID
+RangeCryptProgressEnd(
+	IN UINT32  phase
+	);
+
 EFI_STATUS
 CreateVolumeHeaderOnDisk(
 	IN UINTN          index,
@@ -101,6 +193,25 @@ SecRigionAdd(
 VOID
 UpdateDcsBoot();
 
+//////////////////////////////////////////////////////////////////////////
+// Reboot token
+//////////////////////////////////////////////////////////////////////////
+EFI_STATUS
+RebootTokenCreate(
+	IN UINTN  slot,
+	IN UINTN  minutes
+	);
+
+//////////////////////////////////////////////////////////////////////////
+// KDF benchmark
+//////////////////////////////////////////////////////////////////////////
+extern CHAR16*          gKdfBenchFile;
+
+EFI_STATUS
+KdfBenchmark(
+	IN UINTN targetMs
+	);
+
 //////////////////////////////////////////////////////////////////////////
 // DCS authorization check
 //////////////////////////////////////////////////////////////////////////
@@ -116,6 +227,28 @@ DisksAuthCheck();
 VOID
 TestAuthAsk();
 
+//////////////////////////////////////////////////////////////////////////
+// Command file
+//////////////////////////////////////////////////////////////////////////
+extern CHAR16*  gCmdStatusFile;
+extern BOOLEAN  gCmdKeepGoing;
+extern BOOLEAN  gCmdRunning;
+extern BOOLEAN  gCmdAuthDone;
+
+EFI_STATUS
+EFIAPI
+DcsCfgMain(
+	IN EFI_HANDLE        ImageHandle,
+	IN EFI_SYSTEM_TABLE  *SystemTable
+	);
+
+EFI_STATUS
+DcsCfgRunCmdFile(
+	IN EFI_HANDLE        ImageHandle,
+	IN EFI_SYSTEM_TABLE  *SystemTable,
+	IN CHAR16            *fileName
+	);
+
 
 //////////////////////////////////////////////////////////////////////////
 // RUD / USB
@@ -16,8 +16,12 @@ https://opensource.org/licenses/LGPL-3.0
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/DevicePathLib.h>
 #include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
 #include <Uefi/UefiGpt.h>
 #include <Guid/Gpt.h>
+#include <Protocol/EraseBlock.h>
+#include <Protocol/NvmExpressPassthru.h>
+#include <Protocol/AtaPassThru.h>
 
 #include "DcsCfg.h"
 
@@ -50,3 +54,372 @@ PrintBioList() {
 	BioPrintDevicePaths(L"%HBlock IO handles%N\n");
 }
 
+//////////////////////////////////////////////////////////////////////////
+// Block erase
+// Range: EFI_ERASE_BLOCK_PROTOCOL (unaligned head/tail are overwritten).
+// Whole disk: NVMe Format NVM (user data or crypto erase) or ATA SANITIZE.
+// EFI_UNSUPPORTED - no hardware method, use software overwrite.
+//////////////////////////////////////////////////////////////////////////
+BOOLEAN  gBlockEraseHardware = TRUE;
+
+CHAR16* gBlockEraseMethodNames[] = {
+	L"none",
+	L"software overwrite",
+	L"erase block protocol",
+	L"NVMe format (user data erase)",
+	L"NVMe format (crypto erase)",
+	L"ATA sanitize (block erase)",
+	L"ATA sanitize (crypto scramble)"
+};
+
+CHAR16*
+BlockEraseMethodName(
+	IN UINTN method
+	) 
+{
+	if (method >= sizeof(gBlockEraseMethodNames) / sizeof(gBlockEraseMethodNames[0])) {
+		method = BlockEraseNone;
+	}
+	return gBlockEraseMethodNames[method];
+}
+
+#define ERASE_BLOCK_CHUNK_BLOCKS (1024 * 1024)
+
+EFI_STATUS
+BlockEraseByProtocol(
+	IN EFI_HANDLE h,
+	IN UINT64     start,
+	IN UINT64     end
+	) 
+{
+	EFI_STATUS                res;
+	EFI_BLOCK_IO_PROTOCOL     *bio;
+	EFI_ERASE_BLOCK_PROTOCOL  *erase;
+	EFI_ERASE_BLOCK_TOKEN     token;
+	UINT64                    gran;
+	UINT64                    first;
+	UINT64                    last;
+	UINT64                    pos;
+	UINT64                    chunk;
+
+	bio = EfiGetBlockIO(h);
+	res = gBS->HandleProtocol(h, &gEfiEraseBlockProtocolGuid, (VOID**)&erase);
+	if (EFI_ERROR(res) || bio == NULL) return EFI_UNSUPPORTED;
+	gran = erase->EraseLengthGranularity;
+	if (gran == 0) gran = 1;
+
+	// Aligned part by erase, head and tail by overwrite
+	first = ((start + gran - 1) / gran) * gran;
+	last = ((end + 1) / gran) * gran;
+	if (first >= last) return EFI_UNSUPPORTED;
+	chunk = (ERASE_BLOCK_CHUNK_BLOCKS / gran) * gran;
+	if (chunk == 0) chunk = gran;
+	for (pos = first; pos < last; pos += chunk) {
+		UINT64 count = (last - pos > chunk) ? chunk : last - pos;
+		ZeroMem(&token, sizeof(token));
+		res = erase->EraseBlocks(erase, bio->Media->MediaId, pos, &token, (UINTN)(count * bio->Media->BlockSize));
+		if (EFI_ERROR(res)) {
+			if (pos == first) return EFI_UNSUPPORTED;
+			ERR_PRINT(L"\nErase %lld: %r\n", pos, res);
+			return res;
+		}
+		OUT_PRINT(L"%lld %lld       \r", pos + count, last - pos - count);
+	}
+	if (first > start) {
+		res = BlockRangeOverwrite(h, start, first - 1);
+		if (EFI_ERROR(res)) return res;
+	}
+	if (last <= end) {
+		res = BlockRangeOverwrite(h, last, end);
+	}
+	return res;
+}
+
+BOOLEAN
+BlockIsWholeDisk(
+	IN EFI_HANDLE h,
+	IN UINT64     start,
+	IN UINT64     end
+	)
+{
+	EFI_BLOCK_IO_PROTOCOL *bio;
+	bio = EfiGetBlockIO(h);
+	if (bio == NULL || EfiIsPartition(h)) return FALSE;
+	return start == 0 && end >= bio->Media->LastBlock;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// NVMe
+//////////////////////////////////////////////////////////////////////////
+#define NVME_ADMIN_IDENTIFY       0x06
+#define NVME_ADMIN_FORMAT_NVM     0x80
+#define NVME_IDENTIFY_NN          516
+#define NVME_IDENTIFY_FNA         524
+#define NVME_FNA_ALL_NAMESPACES   BIT0
+#define NVME_FNA_ALL_SECURE_ERASE BIT1
+#define NVME_FNA_CRYPTO_ERASE     BIT2
+#define NVME_IDENTIFY_FLBAS       26      // 3:0 format, 4 MSET, 6:5 format (upper)
+#define NVME_IDENTIFY_DPS         29      // 2:0 PI type, 3 PI first
+#define NVME_SES_USER_DATA_ERASE  1
+#define NVME_SES_CRYPTO_ERASE     2
+
+EFI_STATUS
+NvmeAdminCmd(
+	IN EFI_NVM_EXPRESS_PASS_THRU_PROTOCOL *nvme,
+	IN UINT32   nsid,
+	IN UINT8    opcode,
+	IN UINT32   cdw10,
+	IN VOID     *data,
+	IN UINT32   dataLen,
+	IN UINT64   timeout
+	)
+{
+	EFI_NVM_EXPRESS_PASS_THRU_COMMAND_PACKET  packet;
+	EFI_NVM_EXPRESS_COMMAND                   cmd;
+	EFI_NVM_EXPRESS_COMPLETION                completion;
+	ZeroMem(&packet, sizeof(packet));
+	ZeroMem(&cmd, sizeof(cmd));
+	ZeroMem(&completion, sizeof(completion));
+	cmd.Cdw0.Opcode = opcode;
+	cmd.Nsid = nsid;
+	cmd.Cdw10 = cdw10;
+	cmd.Flags = CDW10_VALID;
+	packet.NvmeCmd = &cmd;
+	packet.NvmeCompletion = &completion;
+	packet.QueueType = NVME_ADMIN_QUEUE;
+	packet.TransferBuffer = data;
+	packet.TransferLength = dataLen;
+	packet.CommandTimeout = timeout;
+	return nvme->PassThru(nvme, nsid, &packet, NULL);
+}
+
+EFI_STATUS
+BlockEraseNvme(
+	IN  EFI_HANDLE h,
+	OUT UINTN      *method
+	)
+{
+	EFI_STATUS                          res;
+	EFI_DEVICE_PATH_PROTOCOL            *dp;
+	EFI_DEVICE_PATH_PROTOCOL            *node;
+	EFI_HANDLE                          hCtrl;
+	EFI_NVM_EXPRESS_PASS_THRU_PROTOCOL  *nvme;
+	UINT32                              nsid = 0;
+	UINT8                               *identify;
+	UINT32                              cdw10;
+	UINT8                               fna;
+
+	dp = DevicePathFromHandle(h);
+	if (dp == NULL) return EFI_UNSUPPORTED;
+	for (node = dp; !IsDevicePathEnd(node); node = NextDevicePathNode(node)) {
+		if (DevicePathType(node) == MESSAGING_DEVICE_PATH && DevicePathSubType(node) == MSG_NVME_NAMESPACE_DP) {
+			nsid = ((NVME_NAMESPACE_DEVICE_PATH*)node)->NamespaceId;
+		}
+	}
+	if (nsid == 0) return EFI_UNSUPPORTED;
+	res = gBS->LocateDevicePath(&gEfiNvmExpressPassThruProtocolGuid, &dp, &hCtrl);
+	if (EFI_ERROR(res)) return EFI_UNSUPPORTED;
+	res = gBS->HandleProtocol(hCtrl, &gEfiNvmExpressPassThruProtocolGuid, (VOID**)&nvme);
+	if (EFI_ERROR(res)) return EFI_UNSUPPORTED;
+
+	identify = AllocateAlignedPages(1, nvme->Mode->IoAlign > EFI_PAGE_SIZE ? nvme->Mode->IoAlign : EFI_PAGE_SIZE);
+	if (identify == NULL) return EFI_BUFFER_TOO_SMALL;
+
+	// Controller: format scope and crypto erase support
+	res = NvmeAdminCmd(nvme, 0, NVME_ADMIN_IDENTIFY, 1, identify, EFI_PAGE_SIZE, 10000000);
+	if (EFI_ERROR(res)) {
+		res = EFI_UNSUPPORTED;
+		goto error;
+	}
+	fna = identify[NVME_IDENTIFY_FNA];
+	if ((fna & (NVME_FNA_ALL_NAMESPACES | NVME_FNA_ALL_SECURE_ERASE)) && *(UINT32*)(identify + NVME_IDENTIFY_NN) > 1) {
+		// Format or secure erase would destroy other namespaces
+		res = EFI_UNSUPPORTED;
+		goto error;
+	}
+
+	// Namespace: keep current LBA format, metadata and protection information
+	res = NvmeAdminCmd(nvme, nsid, NVME_ADMIN_IDENTIFY, 0, identify, EFI_PAGE_SIZE, 10000000);
+	if (EFI_ERROR(res)) {
+		res = EFI_UNSUPPORTED;
+		goto error;
+	}
+	cdw10 = identify[NVME_IDENTIFY_FLBAS] & 0x1F;                   // LBAF, MSET
+	cdw10 |= (UINT32)(identify[NVME_IDENTIFY_FLBAS] & 0x60) << 7;   // LBAF upper
+	cdw10 |= (UINT32)(identify[NVME_IDENTIFY_DPS] & 0x07) << 5;     // PI
+	cdw10 |= (UINT32)(identify[NVME_IDENTIFY_DPS] & 0x08) << 5;     // PIL
+	if (fna & NVME_FNA_CRYPTO_ERASE) {
+		cdw10 |= NVME_SES_CRYPTO_ERASE << 9;
+		*method = BlockEraseNvmeCrypto;
+	}	else {
+		cdw10 |= NVME_SES_USER_DATA_ERASE << 9;
+		*method = BlockEraseNvmeFormat;
+	}
+	OUT_PRINT(L"%s...\n", BlockEraseMethodName(*method));
+	res = NvmeAdminCmd(nvme, nsid, NVME_ADMIN_FORMAT_NVM, cdw10, NULL, 0, 0);
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"NVMe format: %r\n", res);
+	}
+
+error:
+	FreeAlignedPages(identify, 1);
+	return res;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// ATA
+//////////////////////////////////////////////////////////////////////////
+#define ATA_CMD_IDENTIFY                  0xEC
+#define ATA_CMD_SANITIZE                  0xB4
+#define ATA_SANITIZE_STATUS               0x0000
+#define ATA_SANITIZE_CRYPTO_SCRAMBLE      0x0011
+#define ATA_SANITIZE_BLOCK_ERASE          0x0012
+#define ATA_SANITIZE_CRYPTO_SCRAMBLE_KEY  0x43727970
+#define ATA_SANITIZE_BLOCK_ERASE_KEY      0x426B4572
+#define ATA_IDENTIFY_SANITIZE_WORD        59
+#define ATA_SANITIZE_SUPPORTED            BIT12
+#define ATA_SANITIZE_CRYPTO_SUPPORTED     BIT13
+#define ATA_SANITIZE_BLOCK_SUPPORTED      BIT15
+#define ATA_SANITIZE_IN_PROGRESS          BIT6    // count (15:8)
+#define ATA_SANITIZE_COMPLETED            BIT7    // count (15:8)
+#define ATA_TIMEOUT                       (30 * 10000000ULL)
+
+EFI_STATUS
+AtaSanitizeCmd(
+	IN  EFI_ATA_PASS_THRU_PROTOCOL *ata,
+	IN  UINT16                     port,
+	IN  UINT16                     pmp,
+	IN  UINT16                     feature,
+	IN  UINT32                     lba,
+	OUT EFI_ATA_STATUS_BLOCK       *asb
+	)
+{
+	EFI_ATA_PASS_THRU_COMMAND_PACKET packet;
+	EFI_ATA_COMMAND_BLOCK            acb;
+	ZeroMem(&packet, sizeof(packet));
+	ZeroMem(&acb, sizeof(acb));
+	ZeroMem(asb, sizeof(EFI_ATA_STATUS_BLOCK));
+	acb.AtaCommand = ATA_CMD_SANITIZE;
+	acb.AtaFeatures = (UINT8)feature;
+	acb.AtaFeaturesExp = (UINT8)(feature >> 8);
+	acb.AtaSectorNumber = (UINT8)lba;
+	acb.AtaCylinderLow = (UINT8)(lba >> 8);
+	acb.AtaCylinderHigh = (UINT8)(lba >> 16);
+	acb.AtaSectorNumberExp = (UINT8)(lba >> 24);
+	acb.AtaDeviceHead = 0x40;
+	packet.Asb = asb;
+	packet.Acb = &acb;
+	packet.Timeout = ATA_TIMEOUT;
+	packet.Protocol = EFI_ATA_PASS_THRU_PROTOCOL_ATA_NON_DATA;
+	packet.Length = EFI_ATA_PASS_THRU_LENGTH_NO_DATA_TRANSFER;
+	return ata->PassThru(ata, port, pmp, &packet, NULL);
+}
+
+EFI_STATUS
+BlockEraseAta(
+	IN  EFI_HANDLE h,
+	OUT UINTN      *method
+	)
+{
+	EFI_STATUS                        res;
+	EFI_DEVICE_PATH_PROTOCOL          *dp;
+	EFI_DEVICE_PATH_PROTOCOL          *node;
+	EFI_HANDLE                        hCtrl;
+	EFI_ATA_PASS_THRU_PROTOCOL        *ata;
+	SATA_DEVICE_PATH                  *sata = NULL;
+	UINT16                            *identify;
+	EFI_ATA_STATUS_BLOCK              asb;
+	EFI_ATA_COMMAND_BLOCK             acb;
+	EFI_ATA_PASS_THRU_COMMAND_PACKET  packet;
+	UINT16                            word;
+
+	dp = DevicePathFromHandle(h);
+	if (dp == NULL) return EFI_UNSUPPORTED;
+	for (node = dp; !IsDevicePathEnd(node); node = NextDevicePathNode(node)) {
+		if (DevicePathType(node) == MESSAGING_DEVICE_PATH && DevicePathSubType(node) == MSG_SATA_DP) {
+			sata = (SATA_DEVICE_PATH*)node;
+		}
+	}
+	if (sata == NULL) return EFI_UNSUPPORTED;
+	res = gBS->LocateDevicePath(&gEfiAtaPassThruProtocolGuid, &dp, &hCtrl);
+	if (EFI_ERROR(res)) return EFI_UNSUPPORTED;
+	res = gBS->HandleProtocol(hCtrl, &gEfiAtaPassThruProtocolGuid, (VOID**)&ata);
+	if (EFI_ERROR(res)) return EFI_UNSUPPORTED;
+
+	identify = AllocateAlignedPages(1, ata->Mode->IoAlign > EFI_PAGE_SIZE ? ata->Mode->IoAlign : EFI_PAGE_SIZE);
+	if (identify == NULL) return EFI_BUFFER_TOO_SMALL;
+
+	// Sanitize feature set support
+	ZeroMem(&packet, sizeof(packet));
+	ZeroMem(&acb, sizeof(acb));
+	acb.AtaCommand = ATA_CMD_IDENTIFY;
+	acb.AtaSectorCount = 1;
+	packet.Asb = &asb;
+	packet.Acb = &acb;
+	packet.Timeout = ATA_TIMEOUT;
+	packet.InDataBuffer = identify;
+	packet.InTransferLength = 512;
+	packet.Protocol = EFI_ATA_PASS_THRU_PROTOCOL_PIO_DATA_IN;
+	packet.Length = EFI_ATA_PASS_THRU_LENGTH_BYTES | EFI_ATA_PASS_THRU_LENGTH_SECTOR_COUNT;
+	res = ata->PassThru(ata, sata->HBAPortNumber, sata->PortMultiplierPortNumber, &packet, NULL);
+	word = identify[ATA_IDENTIFY_SANITIZE_WORD];
+	FreeAlignedPages(identify, 1);
+	if (EFI_ERROR(res) || (word & ATA_SANITIZE_SUPPORTED) == 0) return EFI_UNSUPPORTED;
+
+	if (word & ATA_SANITIZE_CRYPTO_SUPPORTED) {
+		*method = BlockEraseAtaCrypto;
+		OUT_PRINT(L"%s...\n", BlockEraseMethodName(*method));
+		res = AtaSanitizeCmd(ata, sata->HBAPortNumber, sata->PortMultiplierPortNumber, ATA_SANITIZE_CRYPTO_SCRAMBLE, ATA_SANITIZE_CRYPTO_SCRAMBLE_KEY, &asb);
+	}	else if (word & ATA_SANITIZE_BLOCK_SUPPORTED) {
+		*method = BlockEraseAtaBlock;
+		OUT_PRINT(L"%s...\n", BlockEraseMethodName(*method));
+		res = AtaSanitizeCmd(ata, sata->HBAPortNumber, sata->PortMultiplierPortNumber, ATA_SANITIZE_BLOCK_ERASE, ATA_SANITIZE_BLOCK_ERASE_KEY, &asb);
+	}	else {
+		return EFI_UNSUPPORTED;
+	}
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"ATA sanitize: %r\n", res);
+		return res;
+	}
+
+	// Wait completion
+	do {
+		gBS->Stall(1000000);
+		res = AtaSanitizeCmd(ata, sata->HBAPortNumber, sata->PortMultiplierPortNumber, ATA_SANITIZE_STATUS, 0, &asb);
+		if (EFI_ERROR(res)) {
+			ERR_PRINT(L"ATA sanitize status: %r\n", res);
+			return res;
+		}
+		OUT_PRINT(L"%d%%   \r", (UINT32)(asb.AtaSectorNumber | (asb.AtaCylinderLow << 8)) * 100 / 0x10000);
+	} while (asb.AtaSectorCountExp & ATA_SANITIZE_IN_PROGRESS);
+	if ((asb.AtaSectorCountExp & ATA_SANITIZE_COMPLETED) == 0) {
+		ERR_PRINT(L"ATA sanitize failed\n");
+		return EFI_DEVICE_ERROR;
+	}
+	return EFI_SUCCESS;
+}
+
+EFI_STATUS
+BlockRangeErase(
+	IN  EFI_HANDLE h,
+	IN  UINT64     start,
+	IN  UINT64     end,
+	OUT UINTN      *method
+	)
+{
+	EFI_STATUS res = EFI_UNSUPPORTED;
+	*method = BlockEraseNone;
+	if (!gBlockEraseHardware) return EFI_UNSUPPORTED;
+	if (BlockIsWholeDisk(h, start, end)) {
+		res = BlockEraseNvme(h, method);
+		if (res != EFI_UNSUPPORTED) return res;
+		res = BlockEraseAta(h, method);
+		if (res != EFI_UNSUPPORTED) return res;
+	}
+	*method = BlockEraseProtocol;
+	res = BlockEraseByProtocol(h, start, end);
+	if (res == EFI_UNSUPPORTED) {
+		*method = BlockEraseNone;
+	}
+	return res;
+}
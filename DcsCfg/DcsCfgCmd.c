@@ -0,0 +1,200 @@
+/** @file
+DCS configuration tool. Command file runner.
+
+Copyright (c) 2016. Disk Cryptography Services for EFI (DCS), Alex Kolotnikov
+
+This program and the accompanying materials
+are licensed and made available under the terms and conditions
+of the GNU Lesser General Public License, version 3.0 (LGPL-3.0).
+
+The full text of the license may be found at
+https://opensource.org/licenses/LGPL-3.0
+**/
+
+#include <Library/CommonLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/ShellLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/PrintLib.h>
+
+#include "common/Tcdefs.h"
+#include "DcsVeraCrypt.h"
+#include "DcsCfg.h"
+
+//////////////////////////////////////////////////////////////////////////
+// Command file
+// Every line is DcsCfg parameters (# - comment). Lines are executed one by
+// one in this image, so settings (-ds, -batch, ...) and authorization of
+// first -aa stay for next lines. Visible questions are answered by -ans
+// of the line or get defaults. Hidden input (password, PIM) is never
+// taken from file.
+//////////////////////////////////////////////////////////////////////////
+#define CMD_MAX_ARGS       32
+#define CMD_REPORT_SIZE    (16 * 1024)
+
+CHAR16*  gCmdStatusFile = L"DcsCmdStatus.txt";
+BOOLEAN  gCmdKeepGoing = FALSE;
+BOOLEAN  gCmdRunning = FALSE;
+BOOLEAN  gCmdAuthDone = FALSE;
+
+/**
+Load command file as CHAR16 text (UTF-16 with BOM or ASCII)
+*/
+EFI_STATUS
+CmdFileLoad(
+	IN  CHAR16   *name,
+	OUT CHAR16   **text
+	)
+{
+	EFI_STATUS  res;
+	UINT8       *data = NULL;
+	UINTN       size = 0;
+	CHAR16      *txt;
+	UINTN       i;
+	res = FileLoad(NULL, name, (VOID**)&data, &size);
+	if (EFI_ERROR(res)) return res;
+	if (size >= 2 && data[0] == 0xFF && data[1] == 0xFE) {
+		txt = MEM_ALLOC(size);
+		if (txt == NULL) {
+			MEM_FREE(data);
+			return EFI_BUFFER_TOO_SMALL;
+		}
+		CopyMem(txt, data + 2, size - 2);
+	}	else {
+		txt = MEM_ALLOC((size + 1) * sizeof(CHAR16));
+		if (txt == NULL) {
+			MEM_FREE(data);
+			return EFI_BUFFER_TOO_SMALL;
+		}
+		for (i = 0; i < size; ++i) txt[i] = data[i];
+	}
+	MEM_FREE(data);
+	*text = txt;
+	return EFI_SUCCESS;
+}
+
+/**
+Split line in place. "quoted text" is one argument
+*/
+UINTN
+CmdLineSplit(
+	IN OUT CHAR16  *line,
+	OUT    CHAR16  **argv,
+	IN     UINTN   max
+	)
+{
+	UINTN    argc = 0;
+	CHAR16   *pos = line;
+	while (*pos != 0 && argc < max) {
+		while (*pos == L' ' || *pos == L'\t') pos++;
+		if (*pos == 0) break;
+		if (*pos == L'"') {
+			argv[argc++] = ++pos;
+			while (*pos != 0 && *pos != L'"') pos++;
+		}	else {
+			argv[argc++] = pos;
+			while (*pos != 0 && *pos != L' ' && *pos != L'\t') pos++;
+		}
+		if (*pos != 0) *pos++ = 0;
+	}
+	return argc;
+}
+
+EFI_STATUS
+DcsCfgRunCmdFile(
+	IN EFI_HANDLE        ImageHandle,
+	IN EFI_SYSTEM_TABLE  *SystemTable,
+	IN CHAR16            *fileName
+	)
+{
+	EFI_STATUS   res;
+	EFI_STATUS   firstErr = EFI_SUCCESS;
+	CHAR16       *text = NULL;
+	CHAR16       *line;
+	CHAR16       *next;
+	CHAR16       *cmd = NULL;
+	CHAR16       *argv[CMD_MAX_ARGS + 1];
+	CHAR16       **orgArgv;
+	UINTN        orgArgc;
+	UINTN        argc;
+	UINTN        step = 0;
+	UINTN        failed = 0;
+	CHAR8        *rep = NULL;
+	UINTN        repLen = 0;
+
+	if (gCmdRunning || gEfiShellParametersProtocol == NULL) {
+		ERR_PRINT(L"Command file can not be nested\n");
+		return EFI_INVALID_PARAMETER;
+	}
+	res = CmdFileLoad(fileName, &text);
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"Load %s: %r\n", fileName, res);
+		return res;
+	}
+	rep = MEM_ALLOC(CMD_REPORT_SIZE);
+	if (rep == NULL) {
+		MEM_FREE(text);
+		return EFI_BUFFER_TOO_SMALL;
+	}
+
+	orgArgv = gEfiShellParametersProtocol->Argv;
+	orgArgc = gEfiShellParametersProtocol->Argc;
+	gCmdRunning = TRUE;
+	gCmdAuthDone = FALSE;
+	for (line = text; line != NULL && *line != 0; line = next) {
+		next = StrStr(line, L"\n");
+		if (next != NULL) *next++ = 0;
+		if (StrLen(line) > 0 && line[StrLen(line) - 1] == L'\r') line[StrLen(line) - 1] = 0;
+		while (*line == L' ' || *line == L'\t') line++;
+		if (*line == 0 || *line == L'#') continue;
+
+		step++;
+		MEM_FREE(cmd);
+		cmd = MEM_ALLOC((StrLen(line) + 1) * sizeof(CHAR16));
+		if (cmd == NULL) {
+			res = EFI_BUFFER_TOO_SMALL;
+			break;
+		}
+		StrCpyS(cmd, StrLen(line) + 1, line);
+		OUT_PRINT(L"%H[%d]%N %s\n", step, cmd);
+
+		argv[0] = orgArgv[0];
+		argc = CmdLineSplit(line, argv + 1, CMD_MAX_ARGS) + 1;
+		argv[argc] = NULL;
+		gEfiShellParametersProtocol->Argv = argv;
+		gEfiShellParametersProtocol->Argc = argc;
+		gConsoleAnswers = NULL;
+		gConsoleNoInput = TRUE;
+
+		res = DcsCfgMain(ImageHandle, SystemTable);
+
+		gConsoleAnswers = NULL;
+		gConsoleNoInput = FALSE;
+		OUT_PRINT(L"%H[%d]%N %r\n", step, res);
+		if (repLen + 64 + StrLen(cmd) < CMD_REPORT_SIZE) {
+			repLen += AsciiSPrint(rep + repLen, CMD_REPORT_SIZE - repLen, "step=%d\r\ncmd=%s\r\nstatus=%r\r\n", step, cmd, res);
+		}
+		if (EFI_ERROR(res)) {
+			failed++;
+			if (!EFI_ERROR(firstErr)) firstErr = res;
+			if (!gCmdKeepGoing) break;
+		}
+	}
+	gEfiShellParametersProtocol->Argv = orgArgv;
+	gEfiShellParametersProtocol->Argc = orgArgc;
+	gCmdRunning = FALSE;
+	burn(&gAuthPassword, sizeof(gAuthPassword));
+
+	if (EFI_ERROR(res) && !EFI_ERROR(firstErr)) firstErr = res;
+	repLen += AsciiSPrint(rep + repLen, CMD_REPORT_SIZE - repLen, "steps=%d\r\nfailed=%d\r\nresult=%r\r\n", step, failed, firstErr);
+	res = FileSave(NULL, gCmdStatusFile, rep, repLen);
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"Save %s: %r\n", gCmdStatusFile, res);
+	}
+	OUT_PRINT(L"Steps %d, failed %d: %r\n", step, failed, firstErr);
+	MEM_FREE(cmd);
+	MEM_FREE(rep);
+	MEM_FREE(text);
+	return firstErr;
+}
@@ -18,6 +18,8 @@ https://opensource.org/licenses/LGPL-3.0
 #include <Library/DebugLib.h>
 #include <Library/MemoryAllocationLib.h>
 #include <Library/BaseMemoryLib.h>
+#include <Library/PrintLib.h>
+#include <Protocol/BlockIo2.h>
 #include <Guid/Gpt.h>
 #include <Guid/GlobalVariable.h>
 
@@ -31,6 +33,7 @@ https://opensource.org/licenses/LGPL-3.0
 #include "common/Crypto.h"
 #include "common/Volumes.h"
 #include "common/Crc.h"
+#include "common/Pkcs5.h"
 #include "crypto/cpu.h"
 #include "DcsVeraCrypt.h"
 #include "BootCommon.h"
@@ -91,6 +94,19 @@ AskPkcs5() {
 	return pkcs5;
 }
 
+VOID
+CryptoInfoPrint(
+	IN PCRYPTO_INFO cryptoInfo
+	)
+{
+	OUT_PRINT(L"%H" L"Success\n" L"%N");
+	OUT_PRINT(L"Start %lld length %lld\nVolumeSize %lld\nhiddenVolumeSize %lld\nflags 0x%x\n",
+		cryptoInfo->EncryptedAreaStart.Value, (uint64)cryptoInfo->EncryptedAreaLength.Value,
+		cryptoInfo->VolumeSize,
+		cryptoInfo->HeaderFlags
+		);
+}
+
 EFI_STATUS
 TryHeaderDecrypt(
 	IN  CHAR8*                  header,
@@ -106,7 +122,7 @@ TryHeaderDecrypt(
 		headerCryptoInfo = crypto_open();
 	}
 
-	vcres = ReadVolumeHeader(
+	vcres = ReadVolumeHeaderMP(
 		gAuthBoot,
 		header,
 		&gAuthPassword,
@@ -120,17 +136,171 @@ TryHeaderDecrypt(
 		ERR_PRINT(L"Authorization failed. Wrong password, PIM or hash. Decrypt error(%x)\n", vcres);
 		return EFI_INVALID_PARAMETER;
 	}
-	OUT_PRINT(L"%H" L"Success\n" L"%N", vcres);
-	OUT_PRINT(L"Start %lld length %lld\nVolumeSize %lld\nhiddenVolumeSize %lld\nflags 0x%x\n",
-		cryptoInfo->EncryptedAreaStart.Value, (uint64)cryptoInfo->EncryptedAreaLength.Value,
-		cryptoInfo->VolumeSize,
-		cryptoInfo->HeaderFlags
-		);
+	CryptoInfoPrint(cryptoInfo);
 	if(rci != NULL) *rci = cryptoInfo;
 	if (rhci != NULL) *rhci = headerCryptoInfo;
 	return EFI_SUCCESS;
 }
 
+//////////////////////////////////////////////////////////////////////////
+// Parallel header probe
+//////////////////////////////////////////////////////////////////////////
+// Headers of all candidates are read first, then all key derivations
+// (headers x PRFs for TEST ALL) run in one HeaderTryAll on all processors.
+typedef struct _HEADER_PROBE {
+	UINTN         Disk;
+	EFI_LBA       Sector;
+	UINT8         Header[512];
+	PCRYPTO_INFO  CryptoInfo;
+	PCRYPTO_INFO  HeaderCryptoInfo;
+} HEADER_PROBE;
+
+/**
+Decrypt all probes. With firstOnly only the first decrypted probe (in order)
+gets keys. Index of first decrypted probe or -1 is in found.
+*/
+EFI_STATUS
+HeaderProbeAll(
+	IN OUT HEADER_PROBE  *probes,
+	IN     UINTN         count,
+	IN     BOOLEAN       firstOnly,
+	IN     BOOLEAN       headerKeys,
+	OUT    INTN          *found
+	)
+{
+	EFI_STATUS      res = EFI_SUCCESS;
+	DCS_HEADER_TRY  *tries;
+	UINTN           prfs;
+	UINTN           total = 0;
+	UINTN           i;
+	UINTN           prf;
+
+	*found = -1;
+	prfs = (gAuthHash == 0) ? LAST_PRF_ID - FIRST_PRF_ID + 1 : 1;
+	tries = MEM_ALLOC(sizeof(DCS_HEADER_TRY) * count * prfs);
+	if (tries == NULL) return EFI_OUT_OF_RESOURCES;
+	for (i = 0; i < count; ++i) {
+		probes[i].CryptoInfo = NULL;
+		probes[i].HeaderCryptoInfo = NULL;
+		for (prf = 0; prf < prfs; ++prf) {
+			tries[total].Header = (char*)probes[i].Header;
+			tries[total].Prf = (gAuthHash == 0) ? (int)(FIRST_PRF_ID + prf) : gAuthHash;
+			tries[total].Tag = i;
+			if (headerKeys) {
+				tries[total].HeaderCryptoInfo = crypto_open();
+				if (tries[total].HeaderCryptoInfo == NULL) {
+					res = EFI_OUT_OF_RESOURCES;
+					goto error;
+				}
+			}
+			total++;
+		}
+	}
+
+	HeaderTryAll(gAuthBoot, &gAuthPassword, gAuthPim, gAuthTc, tries, total, firstOnly);
+
+	for (i = 0; i < total; ++i) {
+		HEADER_PROBE* probe = &probes[tries[i].Tag];
+		if (tries[i].CryptoInfo != NULL && probe->CryptoInfo == NULL) {
+			probe->CryptoInfo = tries[i].CryptoInfo;
+			probe->HeaderCryptoInfo = tries[i].HeaderCryptoInfo;
+			if (*found < 0) *found = (INTN)tries[i].Tag;
+			continue;
+		}
+		if (tries[i].Result == ERR_OUTOFMEMORY) res = EFI_OUT_OF_RESOURCES;
+		crypto_close(tries[i].CryptoInfo);
+		crypto_close(tries[i].HeaderCryptoInfo);
+	}
+	if (*found >= 0) res = EFI_SUCCESS;
+	MEM_FREE(tries);
+	return res;
+
+error:
+	for (i = 0; i < total; ++i) {
+		crypto_close(tries[i].HeaderCryptoInfo);
+	}
+	MEM_FREE(tries);
+	return res;
+}
+
+VOID
+HeaderProbeFree(
+	IN OUT HEADER_PROBE  *probes,
+	IN     UINTN         count
+	)
+{
+	UINTN i;
+	for (i = 0; i < count; ++i) {
+		crypto_close(probes[i].CryptoInfo);
+		crypto_close(probes[i].HeaderCryptoInfo);
+		probes[i].CryptoInfo = NULL;
+		probes[i].HeaderCryptoInfo = NULL;
+	}
+}
+
+/**
+Read header of disk at sector to next probe
+*/
+EFI_STATUS
+HeaderProbeRead(
+	IN OUT HEADER_PROBE  *probes,
+	IN OUT UINTN         *count,
+	IN     UINTN         disk,
+	IN     EFI_LBA       sector
+	)
+{
+	EFI_STATUS              res;
+	EFI_BLOCK_IO_PROTOCOL*  io;
+	HEADER_PROBE*           probe = &probes[*count];
+	io = EfiGetBlockIO(gBIOHandles[disk]);
+	if (io == NULL) return EFI_NOT_FOUND;
+	res = io->ReadBlocks(io, io->Media->MediaId, sector, 512, probe->Header);
+	if (EFI_ERROR(res)) return res;
+	probe->Disk = disk;
+	probe->Sector = sector;
+	*count += 1;
+	return EFI_SUCCESS;
+}
+
+/**
+Probe slots (128K) of security region data. First decrypted slot is in SecRegionOffset.
+*/
+EFI_STATUS
+HeaderProbeSecRegion(
+	OUT PCRYPTO_INFO  *rci
+	)
+{
+	EFI_STATUS    res;
+	HEADER_PROBE  *probes;
+	UINTN         count = 0;
+	INTN          found;
+
+	probes = MEM_ALLOC(sizeof(HEADER_PROBE) * ((SecRegionSize + 128 * 1024 - 1) / (128 * 1024)));
+	if (probes == NULL) return EFI_BUFFER_TOO_SMALL;
+	for (SecRegionOffset = 0; SecRegionOffset + 512 <= SecRegionSize; SecRegionOffset += 128 * 1024) {
+		CopyMem(probes[count].Header, SecRegionData + SecRegionOffset, 512);
+		probes[count].Sector = SecRegionOffset >> 9;
+		count++;
+	}
+	res = HeaderProbeAll(probes, count, TRUE, FALSE, &found);
+	SecRegionOffset = 0;
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"Probe: %r\n", res);
+		HeaderProbeFree(probes, count);
+		MEM_FREE(probes);
+		return res;
+	}
+	if (found >= 0) {
+		SecRegionOffset = (UINTN)probes[found].Sector << 9;
+		*rci = probes[found].CryptoInfo;
+		probes[found].CryptoInfo = NULL;
+		CryptoInfoPrint(*rci);
+	}
+	HeaderProbeFree(probes, count);
+	MEM_FREE(probes);
+	return (found >= 0) ? EFI_SUCCESS : EFI_INVALID_PARAMETER;
+}
+
 EFI_STATUS
 ChangePassword(
 	IN OUT CHAR8*                  header
@@ -276,6 +446,10 @@ AskChoice(
 		pos = choice;
 		OUT_PRINT(L"%a", prompt);
 		GetLine(&len, buf, NULL, sizeof(buf) / 2, visible);
+		if (len == 0 && gConsoleNoInput) {
+			// no input - first choice
+			return *choice;
+		}
 		while (*pos != 0 && ret == 0) {
 			if (buf[0] == *pos) {
 				ret = *pos;
@@ -292,30 +466,81 @@ AskARI() {
 	return AskChoice("[a]bort [r]etry [i]gnore?", "aArRiI", 1);
 }
 
-UINTN gScndTotal = 0;
-UINTN gScndCurrent = 0;
+//////////////////////////////////////////////////////////////////////////
+// Progress and status
+// Rate is measured by calibrated TSC and smoothed. Status is saved 
+// to gCryptStatusFile and volatile variable DCS_CRYPT_STATUS_VAR.
+//////////////////////////////////////////////////////////////////////////
+DCS_CRYPT_STATUS gCryptStatus;
+CHAR16*  gCryptStatusFile = L"DcsCryptStatus.txt";
+UINT64   gCryptStartUs = 0;
+UINT64   gCryptLastUs = 0;
+UINT64   gCryptLastDone = 0;
+UINT64   gCryptStatusSavedUs = 0;
+
+#define CRYPT_STATUS_SAVE_US  (10 * 1000000)
+#define CRYPT_RATE_MIN_US     (1000000)
+
+CHAR8* gCryptPhaseNames[] = {
+	"none",
+	"encrypt",
+	"decrypt",
+	"wipe",
+	"done",
+	"stopped",
+	"failed"
+};
+
 VOID
-AddSecondsDelta() 
+RangeCryptStatusSave() 
 {
 	EFI_STATUS res;
-	EFI_TIME time;
-	UINTN secs;
-	UINTN secsDelta;
-	res = gST->RuntimeServices->GetTime(&time, NULL);
-	if (EFI_ERROR(res)) return;
-	secs = (UINTN)time.Second + ((UINTN)time.Minute) * 60 + ((UINTN)time.Hour) * 60 * 60;
-	if (gScndTotal == 0 && gScndCurrent == 0) {
-		gScndCurrent = secs;
-		return;
-	}
-	if (secs > gScndCurrent) {
-		secsDelta = secs - gScndCurrent;
-	}	else {
-		secsDelta = 24 * 60 * 60 - gScndCurrent;
-		secsDelta += secs;
+	CHAR8      buf[512];
+	UINTN      len;
+	UINT32     phase;
+	phase = gCryptStatus.Phase;
+	if (phase >= sizeof(gCryptPhaseNames) / sizeof(gCryptPhaseNames[0])) phase = CryptPhaseNone;
+	len = AsciiSPrint(buf, sizeof(buf),
+		"phase=%a\r\nsize=%lld\r\nremains=%lld\r\npos=%lld\r\nrate=%lld\r\neta=%lld\r\nelapsed=%lld\r\nbad=%lld\r\n",
+		gCryptPhaseNames[phase],
+		gCryptStatus.Size,
+		gCryptStatus.Remains,
+		gCryptStatus.Pos,
+		gCryptStatus.BytesPerSecond,
+		gCryptStatus.EtaSeconds,
+		gCryptStatus.ElapsedSeconds,
+		gCryptStatus.BadSectors);
+	res = FileSave(NULL, gCryptStatusFile, buf, len);
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"\nStatus save %s: %r\n", gCryptStatusFile, res);
 	}
-	gScndCurrent = secs;
-	gScndTotal += secsDelta;
+	EfiSetVar(DCS_CRYPT_STATUS_VAR, NULL, &gCryptStatus, sizeof(gCryptStatus), EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS);
+}
+
+VOID
+RangeCryptProgressStart(
+	IN UINT32  phase,
+	IN UINT64  size
+	) {
+	ZeroMem(&gCryptStatus, sizeof(gCryptStatus));
+	gCryptStatus.Signature = DCS_CRYPT_STATUS_SIGNATURE;
+	gCryptStatus.Phase = phase;
+	gCryptStatus.Size = size;
+	gCryptStartUs = EfiTimeStampUs();
+	gCryptLastUs = gCryptStartUs;
+	gCryptStatusSavedUs = gCryptStartUs;
+	gCryptLastDone = 0;
+}
+
+VOID
+RangeCryptProgressEnd(
+	IN UINT32  phase
+	) {
+	gCryptStatus.Phase = phase;
+	gCryptStatus.BadSectors = gCryptBadCount;
+	gCryptLastUs = EfiTimeStampUs();
+	gCryptStatus.ElapsedSeconds = (gCryptLastUs - gCryptStartUs) / 1000000;
+	RangeCryptStatusSave();
 }
 
 VOID
@@ -326,11 +551,31 @@ RangeCryptProgress(
 	IN UINT64  remainsOnStart
 	) {
 	UINTN  percent;
+	UINT64 nowUs;
+	UINT64 done;
 	percent = (UINTN)(100 * (size - remains) / size);
 	OUT_PRINT(L"%H%d%%%N (%llds %llds) ", percent, pos, remains);
-	AddSecondsDelta();
-	if (gScndTotal > 10) {
-		UINT64 doneBpS = (remainsOnStart - remains) * 512 / gScndTotal;
+	nowUs = EfiTimeStampUs();
+	done = remainsOnStart - remains;
+	if (nowUs > gCryptLastUs + CRYPT_RATE_MIN_US) {
+		UINT64 rate = (done - gCryptLastDone) * 512 * 1000000 / (nowUs - gCryptLastUs);
+		// exponential moving average (1/4 weight of last interval)
+		if (gCryptStatus.BytesPerSecond == 0) {
+			gCryptStatus.BytesPerSecond = rate;
+		}	else {
+			gCryptStatus.BytesPerSecond = (gCryptStatus.BytesPerSecond * 3 + rate) >> 2;
+		}
+		gCryptLastUs = nowUs;
+		gCryptLastDone = done;
+	}
+	gCryptStatus.Size = size;
+	gCryptStatus.Remains = remains;
+	gCryptStatus.Pos = pos;
+	gCryptStatus.BadSectors = gCryptBadCount;
+	gCryptStatus.ElapsedSeconds = (nowUs - gCryptStartUs) / 1000000;
+	if (gCryptStatus.BytesPerSecond > 0) {
+		UINT64 doneBpS = gCryptStatus.BytesPerSecond;
+		gCryptStatus.EtaSeconds = remains * 512 / doneBpS;
 		if (doneBpS > 1024 * 1024) {
 			OUT_PRINT(L"%lldMB/s", doneBpS / (1024 * 1024));
 		}	else	if (doneBpS > 1024) {
@@ -338,13 +583,115 @@ RangeCryptProgress(
 		}	else {
 			OUT_PRINT(L"%lldB/s", doneBpS);
 		}
-		if (doneBpS > 0) {
-			OUT_PRINT(L"(ETA: %lldm)", (remains * 512 / doneBpS) / 60);
-		}
+		OUT_PRINT(L"(ETA: %lldm)", gCryptStatus.EtaSeconds / 60);
+	}
+	if (nowUs >= gCryptStatusSavedUs + CRYPT_STATUS_SAVE_US) {
+		gCryptStatusSavedUs = nowUs;
+		RangeCryptStatusSave();
 	}
 	OUT_PRINT(L"        \r");
 }
 
+//////////////////////////////////////////////////////////////////////////
+// Batch mode
+// On read/write error the chunk is bisected down to single sectors.
+// Bad sectors are skipped and logged to gCryptBadLbaLog.
+//////////////////////////////////////////////////////////////////////////
+BOOLEAN  gCryptBatch = FALSE;
+CHAR16*  gCryptBadLbaLog = L"DcsBadLba.log";
+UINT64   gCryptBadCount = 0;
+
+VOID
+RangeCryptLogBadLba(
+	IN UINT64      lba,
+	IN BOOLEAN     write,
+	IN EFI_STATUS  status
+	)
+{
+	EFI_STATUS res;
+	EFI_FILE*  file;
+	UINTN      size = 0;
+	UINT64     position;
+	CHAR8      line[64];
+
+	gCryptBadCount++;
+	ERR_PRINT(L"\n%a error %lld: %r\n", write ? "Write" : "Read", lba, status);
+	res = FileOpen(NULL, gCryptBadLbaLog, &file, EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE, 0);
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"Bad LBA log %s: %r\n", gCryptBadLbaLog, res);
+		return;
+	}
+	FileGetSize(file, &size);
+	position = size;
+	size = AsciiSPrint(line, sizeof(line), "%a %lld %r\r\n", write ? "W" : "R", lba, status);
+	res = FileWrite(file, line, &size, &position);
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"Bad LBA log %s: %r\n", gCryptBadLbaLog, res);
+	}
+	FileClose(file);
+}
+
+EFI_STATUS
+RangeCryptBatchWrite(
+	IN EFI_BLOCK_IO_PROTOCOL  *io,
+	IN UINT8                  *buf,
+	IN UINT64                 pos,
+	IN UINTN                  count
+	)
+{
+	EFI_STATUS res;
+	UINTN      half;
+	res = io->WriteBlocks(io, io->Media->MediaId, pos, count << 9, buf);
+	if (!EFI_ERROR(res)) return res;
+	if (res == EFI_NO_MEDIA || res == EFI_MEDIA_CHANGED) return res;
+	if (count == 1) {
+		RangeCryptLogBadLba(pos, TRUE, res);
+		return EFI_SUCCESS;
+	}
+	half = count >> 1;
+	res = RangeCryptBatchWrite(io, buf, pos, half);
+	if (EFI_ERROR(res)) return res;
+	return RangeCryptBatchWrite(io, buf + (half << 9), pos + half, count - half);
+}
+
+/**
+Crypt sectors [pos, pos + count) without user interaction.
+Failed range is split in halves down to single sectors. Readable parts are crypted 
+and written back; write errors are bisected on the crypted buffer (data is never 
+read back twice). Bad sectors are left untouched and logged.
+**/
+EFI_STATUS
+RangeCryptBatch(
+	IN EFI_BLOCK_IO_PROTOCOL  *io,
+	IN UINT8                  *buf,
+	IN UINT64                 pos,
+	IN UINTN                  count,
+	IN PCRYPTO_INFO           info,
+	IN BOOL                   encrypt
+	)
+{
+	EFI_STATUS res;
+	UINTN      half;
+	res = io->ReadBlocks(io, io->Media->MediaId, pos, count << 9, buf);
+	if (!EFI_ERROR(res)) {
+		if (encrypt) {
+			EncryptDataUnits(buf, (UINT64_STRUCT*)&pos, (UINT32)(count), info);
+		}	else {
+			DecryptDataUnits(buf, (UINT64_STRUCT*)&pos, (UINT32)(count), info);
+		}
+		return RangeCryptBatchWrite(io, buf, pos, count);
+	}
+	if (res == EFI_NO_MEDIA || res == EFI_MEDIA_CHANGED) return res;
+	if (count == 1) {
+		RangeCryptLogBadLba(pos, FALSE, res);
+		return EFI_SUCCESS;
+	}
+	half = count >> 1;
+	res = RangeCryptBatch(io, buf, pos, half, info, encrypt);
+	if (EFI_ERROR(res)) return res;
+	return RangeCryptBatch(io, buf + (half << 9), pos + half, count - half, info, encrypt);
+}
+
 #define CRYPT_BUF_SECTORS 50*1024*2
 EFI_STATUS
 RangeCrypt(
@@ -387,12 +734,19 @@ RangeCrypt(
 		pos = start + enSize - rd;
 	}
 	remainsOnStart = remains;
-	// Start second
-	gScndTotal = 0;
-	gScndCurrent = 0;
+	gCryptBadCount = 0;
+	RangeCryptProgressStart(encrypt ? CryptPhaseEncrypt : CryptPhaseDecrypt, size);
 	do {
 		rd = (UINTN)((remains > CRYPT_BUF_SECTORS) ? CRYPT_BUF_SECTORS : remains);
 		RangeCryptProgress(size, remains, pos, remainsOnStart);
+		if (gCryptBatch) {
+			res = RangeCryptBatch(io, buf, pos, rd, info, encrypt);
+			if (EFI_ERROR(res)) {
+				ERR_PRINT(L"Batch crypt: %r\n", res);
+				goto error;
+			}
+			goto crypted;
+		}
 		// Read
 		do {
 			res = io->ReadBlocks(io, io->Media->MediaId, pos, rd << 9, buf);
@@ -449,6 +803,7 @@ RangeCrypt(
 			}
 		} while (EFI_ERROR(res));
 
+crypted:
 		if (encrypt) {
 			pos += rd;
 		}	else {
@@ -472,7 +827,7 @@ RangeCrypt(
 				if (GetHeaderField32(buf, TC_HEADER_OFFSET_MAGIC) == 0x56455241) {
 					headerData = buf + TC_HEADER_OFFSET_ENCRYPTED_AREA_LENGTH;
 					mputInt64(headerData, encryptedAreaLength);
-					headerCrc32 = GetCrc32(buf + TC_HEADER_OFFSET_MAGIC, TC_HEADER_OFFSET_HEADER_CRC - TC_HEADER_OFFSET_MAGIC);
+					headerCrc32 = EfiCrc32(buf + TC_HEADER_OFFSET_MAGIC, TC_HEADER_OFFSET_HEADER_CRC - TC_HEADER_OFFSET_MAGIC);
 					headerData = buf + TC_HEADER_OFFSET_HEADER_CRC;
 					mputLong(headerData, headerCrc32);
 					EncryptBuffer(buf + HEADER_ENCRYPTED_DATA_OFFSET, HEADER_ENCRYPTED_DATA_SIZE, headerInfo);
@@ -503,8 +858,16 @@ RangeCrypt(
 	} while (remains > 0);
 	RangeCryptProgress(size, remains, pos, remainsOnStart);
 	OUT_PRINT(L"\nDone");
+	if (gCryptBadCount > 0) {
+		OUT_PRINT(L", %E%lld%N bad sectors (see %s)", gCryptBadCount, gCryptBadLbaLog);
+	}
+	res = EFI_SUCCESS;
+	RangeCryptProgressEnd(CryptPhaseDone);
 
 error:
+	if (gCryptStatus.Phase == CryptPhaseEncrypt || gCryptStatus.Phase == CryptPhaseDecrypt) {
+		RangeCryptProgressEnd(res == EFI_NOT_READY ? CryptPhaseStopped : CryptPhaseFailed);
+	}
 	OUT_PRINT(L"\n");
 	MEM_FREE(buf);
 	return res;
@@ -659,25 +1022,38 @@ OSDecrypt()
 {
 
 	EFI_STATUS              res;
-	UINTN                   disk;
+	UINTN                   disk = 0;
 	BOOLEAN                 doDecrypt = FALSE;
-	EFI_BLOCK_IO_PROTOCOL*  io;
+	HEADER_PROBE            *probes;
+	UINTN                   count = 0;
+	INTN                    found;
 	if (gAuthPasswordMsg == NULL) {
 		VCAuthAsk();
 	}
 
+	probes = MEM_ALLOC(sizeof(HEADER_PROBE) * (gBIOCount + 1));
+	if (probes == NULL) return EFI_BUFFER_TOO_SMALL;
 	for (disk = 0; disk < gBIOCount; ++disk) {
 		if (EfiIsPartition(gBIOHandles[disk])) continue;
-		io = EfiGetBlockIO(gBIOHandles[disk]);
-		if (io == NULL) continue;
-		res = io->ReadBlocks(io, io->Media->MediaId, 62, 512, Header);
-		if (EFI_ERROR(res)) continue;
+		HeaderProbeRead(probes, &count, disk, 62);
+	}
+	res = HeaderProbeAll(probes, count, TRUE, TRUE, &found);
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"Probe: %r\n", res);
+	}	else if (found >= 0) {
+		disk = probes[found].Disk;
+		gAuthCryptInfo = probes[found].CryptoInfo;
+		gHeaderCryptInfo = probes[found].HeaderCryptoInfo;
+		probes[found].CryptoInfo = NULL;
+		probes[found].HeaderCryptoInfo = NULL;
 		BioPrintDevicePath(disk);
-		res = TryHeaderDecrypt(Header, &gAuthCryptInfo, &gHeaderCryptInfo);
-		if (EFI_ERROR(res)) continue;
+		CryptoInfoPrint(gAuthCryptInfo);
 		doDecrypt = TRUE;
-		break;
+	} else {
+		ERR_PRINT(L"Authorization failed. Wrong password, PIM or hash.\n");
 	}
+	HeaderProbeFree(probes, count);
+	MEM_FREE(probes);
 
 	if (doDecrypt) {
 		if (!AskConfirm("Decrypt?", 1)) {
@@ -694,7 +1070,7 @@ OSDecrypt()
 		crypto_close(gHeaderCryptInfo);
 		crypto_close(gAuthCryptInfo);
 	}
-	else {
+	else if (!EFI_ERROR(res)) {
 		res = EFI_NOT_FOUND;
 	}
 	return res;
@@ -739,23 +1115,21 @@ OSBackupKeyLoad(
 	}
 
 	// Try decrypt/locate header (in file or on removable flash)
-	do {
-		CopyMem(Header, SecRegionData + SecRegionOffset, 512);
-		res = TryHeaderDecrypt(Header, &gAuthCryptInfo, NULL);
+	res = HeaderProbeSecRegion(&gAuthCryptInfo);
+	if (EFI_ERROR(res)) {
+		MEM_FREE(SecRegionData);
+		res = PlatformGetAuthData(&SecRegionData, &SecRegionSize, &SecRegionHandle);
 		if (EFI_ERROR(res)) {
-			SecRegionOffset += 128 * 1024;
-			if (SecRegionOffset > SecRegionSize) {
-				MEM_FREE(SecRegionData);
-				SecRegionOffset = 0;
-				res = PlatformGetAuthData(&SecRegionData, &SecRegionSize, &SecRegionHandle);
-				if (EFI_ERROR(res)) {
-					return EFI_INVALID_PARAMETER;
-				}
-			}
+			return EFI_INVALID_PARAMETER;
+		}
+		res = HeaderProbeSecRegion(&gAuthCryptInfo);
+		if (EFI_ERROR(res)) {
+			ERR_PRINT(L"Authorization failed. Wrong password, PIM or hash.\n");
+			goto error;
 		}
-		restoreDataSize = (SecRegionSize - SecRegionOffset >= 128 * 1024)? 128 * 1024 : SecRegionSize - SecRegionOffset;
-		restoreData = SecRegionData + SecRegionOffset;
-	} while (EFI_ERROR(res));
+	}
+	restoreDataSize = (SecRegionSize - SecRegionOffset >= 128 * 1024)? 128 * 1024 : SecRegionSize - SecRegionOffset;
+	restoreData = SecRegionData + SecRegionOffset;
 
 	// Parse DE list if present
 	SetMem(&DeDiskId.GptID, sizeof(DeDiskId.GptID), 0x55);
@@ -839,9 +1213,463 @@ error:
 	return res;
 }
 
+//////////////////////////////////////////////////////////////////////////
+// Reboot token
+//////////////////////////////////////////////////////////////////////////
+#define REBOOT_TOKEN_SLOT_SIZE (128 * 1024)
+
+/**
+Slot was never written (all zeros or all ones)
+*/
+BOOLEAN
+RebootTokenSlotEmpty(
+	IN UINT8  *data,
+	IN UINTN  size)
+{
+	UINTN i;
+	if (data[0] != 0 && data[0] != 0xFF) return FALSE;
+	for (i = 1; i < size; ++i) {
+		if (data[i] != data[0]) return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+Copy authorized slot of security region to token slot under random secret (platform bound).
+DcsInt uses it once before expiration and wipes the slot.
+Token slot has to be empty or hold previous token (free slots and headers look the same).
+*/
+EFI_STATUS
+RebootTokenCreate(
+	IN UINTN  slot,
+	IN UINTN  minutes
+	)
+{
+	EFI_STATUS              res;
+	EFI_BLOCK_IO_PROTOCOL*  io;
+	DCS_REBOOT_TOKEN        token;
+	Password                pwd;
+	PCRYPTO_INFO            ci = NULL;
+	UINT8                   *slotData = NULL;
+	UINTN                   offset = slot * REBOOT_TOKEN_SLOT_SIZE;
+	UINT64                  now;
+	INT32                   vcres;
+
+	now = EfiTimeNowSeconds();
+	if (minutes == 0 || now == 0) {
+		ERR_PRINT(L"Token time\n");
+		return EFI_INVALID_PARAMETER;
+	}
+	if (gRnd == NULL) {
+		res = RndInit(RndTypeRDRand, NULL, &gRnd);
+		if (EFI_ERROR(res)) {
+			ERR_PRINT(L"Random: %r (use -rnd)\n", res);
+			return res;
+		}
+	}
+	if (gAuthPasswordMsg == NULL) {
+		VCAuthAsk();
+	}
+
+	res = PlatformGetAuthData(&SecRegionData, &SecRegionSize, &SecRegionHandle);
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"Security region: %r\n", res);
+		return res;
+	}
+	res = HeaderProbeSecRegion(&gAuthCryptInfo);
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"Authorization failed. Wrong password, PIM or hash.\n");
+		goto error;
+	}
+	if (offset + REBOOT_TOKEN_SLOT_SIZE > SecRegionSize || SecRegionOffset + REBOOT_TOKEN_SLOT_SIZE > SecRegionSize ||
+		offset == SecRegionOffset || (INTN)slot == gAuthTpmSlot) {
+		ERR_PRINT(L"Token slot %d is not usable\n", (UINT32)slot);
+		res = EFI_INVALID_PARAMETER;
+		goto error;
+	}
+	if (!RebootTokenSlotOwned((UINT32)slot, SecRegionData + offset) &&
+		!RebootTokenSlotEmpty(SecRegionData + offset, REBOOT_TOKEN_SLOT_SIZE)) {
+		ERR_PRINT(L"Token slot %d is not empty and holds no reboot token\n", (UINT32)slot);
+		res = EFI_ACCESS_DENIED;
+		goto error;
+	}
+	io = EfiGetBlockIO(SecRegionHandle);
+	if (io == NULL) {
+		res = EFI_NOT_FOUND;
+		goto error;
+	}
+	PlatformGetID(SecRegionHandle, &gPlatformKeyFile, &gPlatformKeyFileSize);
+
+	// Data units stay encrypted by master key, only header is new
+	slotData = MEM_ALLOC(REBOOT_TOKEN_SLOT_SIZE);
+	if (slotData == NULL) {
+		res = EFI_BUFFER_TOO_SMALL;
+		goto error;
+	}
+	CopyMem(slotData, SecRegionData + SecRegionOffset, REBOOT_TOKEN_SLOT_SIZE);
+	ZeroMem(&token, sizeof(token));
+	res = RndGetBytes(token.Secret, sizeof(token.Secret));
+	if (EFI_ERROR(res)) goto error;
+	token.Slot = (UINT32)slot;
+	token.Expires = now + (UINT64)minutes * 60;
+	RebootTokenPassword(&token, &pwd);
+
+	vcres = CreateVolumeHeaderInMemory(
+		gAuthBoot, (char*)slotData,
+		gAuthCryptInfo->ea,
+		gAuthCryptInfo->mode,
+		&pwd,
+		SHA512,
+		DCS_REBOOT_TOKEN_PIM,
+		gAuthCryptInfo->master_keydata,
+		&ci,
+		gAuthCryptInfo->VolumeSize.Value,
+		0,
+		gAuthCryptInfo->EncryptedAreaStart.Value,
+		gAuthCryptInfo->EncryptedAreaLength.Value,
+		gAuthCryptInfo->RequiredProgramVersion,
+		gAuthCryptInfo->HeaderFlags,
+		gAuthCryptInfo->SectorSize,
+		FALSE);
+	burn(&pwd, sizeof(pwd));
+	if (ci != NULL) crypto_close(ci);
+	if (vcres != 0) {
+		ERR_PRINT(L"header create error(%x)\n", vcres);
+		res = EFI_INVALID_PARAMETER;
+		goto error;
+	}
+
+	res = io->WriteBlocks(io, io->Media->MediaId, 62 + offset / 512, REBOOT_TOKEN_SLOT_SIZE, slotData);
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"Write: %r\n", res);
+		goto error;
+	}
+	res = RebootTokenSlotSave((UINT32)slot, slotData);
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"Token slot save: %r\n", res);
+		goto error;
+	}
+	res = RebootTokenSave(&token);
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"Token save: %r\n", res);
+		goto error;
+	}
+	OUT_PRINT(L"Reboot token in slot %d, valid %d minutes\n", (UINT32)slot, (UINT32)minutes);
+
+error:
+	burn(&token, sizeof(token));
+	MEM_FREE(slotData);
+	MEM_FREE(SecRegionData);
+	SecRegionSize = 0;
+	return res;
+}
+
 //////////////////////////////////////////////////////////////////////////
 // Wipe
+// Pass schedule: z - zeros, o - ones, r - random (AES-CTR stream), 
+// c - complement of previous pass. Pattern of next buffer is generated 
+// while previous buffer is written (BlockIo2), random stream is seekable 
+// so sampled sectors are read back and compared after every pass.
 //////////////////////////////////////////////////////////////////////////
+#define WIPE_BUF_SECTORS    (8 * 1024 * 2)
+#define WIPE_MAX_PASSES     16
+#define WIPE_CTR_PER_SECTOR (512 / 16)
+
+CHAR16*  gWipePasses = NULL;
+UINTN    gWipeVerify = 0;   // sampled sectors per 1000
+CHAR16*  gWipeReportFile = L"DcsWipeReport.txt";
+
+typedef struct _WIPE_PASS {
+	CHAR16   Pattern;       // z, o, r
+	BOOLEAN  Invert;
+	UINT64   Counter;       // random stream counter of start sector
+	UINT64   Us;
+	UINT64   Verified;      // sectors read back
+	UINT64   Mismatch;
+} WIPE_PASS;
+
+typedef struct _WIPE_REPORT {
+	CHAR8    *Buf;
+	UINTN    Len;
+	UINTN    Size;
+} WIPE_REPORT;
+
+VOID
+WipeReportAdd(
+	IN OUT WIPE_REPORT  *rep,
+	IN     CONST CHAR8  *fmt,
+	...
+	)
+{
+	VA_LIST  args;
+	if (rep == NULL || rep->Buf == NULL) return;
+	VA_START(args, fmt);
+	rep->Len += AsciiVSPrint(rep->Buf + rep->Len, rep->Size - rep->Len, fmt, args);
+	VA_END(args);
+}
+
+VOID
+WipeReportSave(
+	IN WIPE_REPORT  *rep
+	)
+{
+	EFI_STATUS res;
+	if (rep->Buf == NULL) return;
+	res = FileSave(NULL, gWipeReportFile, rep->Buf, rep->Len);
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"Save %s: %r\n", gWipeReportFile, res);
+	}	else {
+		OUT_PRINT(L"Report %s\n", gWipeReportFile);
+	}
+	MEM_FREE(rep->Buf);
+	rep->Buf = NULL;
+}
+
+/**
+Pattern of pass for count sectors starting rel sectors from start of range
+*/
+VOID
+WipeFill(
+	IN     WIPE_PASS   *pass,
+	IN OUT RND_STREAM  *stream,
+	OUT    UINT8       *buf,
+	IN     UINT64      rel,
+	IN     UINTN       count
+	)
+{
+	UINTN   i;
+	UINT64  *p = (UINT64*)buf;
+	UINTN   n = (count << 9) / sizeof(UINT64);
+	if (pass->Pattern == L'r') {
+		stream->Counter = pass->Counter + rel * WIPE_CTR_PER_SECTOR;
+		RndStreamGetBytes(stream, buf, count << 9);
+		if (pass->Invert) {
+			for (i = 0; i < n; ++i) p[i] = ~p[i];
+		}
+		return;
+	}
+	SetMem(buf, count << 9, (UINT8)(((pass->Pattern == L'o') ^ pass->Invert) ? 0xFF : 0));
+}
+
+EFI_STATUS
+WipePassesParse(
+	IN  CHAR16      *passes,
+	OUT WIPE_PASS   *pass,
+	OUT UINTN       *count,
+	IN  UINT64      sectors
+	)
+{
+	UINTN   i;
+	UINT64  counter = 0;
+	for (i = 0; passes[i] != 0; ++i) {
+		if (i >= WIPE_MAX_PASSES) return EFI_INVALID_PARAMETER;
+		ZeroMem(&pass[i], sizeof(WIPE_PASS));
+		switch (passes[i]) {
+		case L'z':
+		case L'o':
+			pass[i].Pattern = passes[i];
+			break;
+		case L'r':
+			pass[i].Pattern = L'r';
+			pass[i].Counter = counter;
+			counter += sectors * WIPE_CTR_PER_SECTOR;
+			break;
+		case L'c':
+			if (i == 0) return EFI_INVALID_PARAMETER;
+			pass[i].Pattern = pass[i - 1].Pattern;
+			pass[i].Counter = pass[i - 1].Counter;
+			pass[i].Invert = !pass[i - 1].Invert;
+			break;
+		default:
+			return EFI_INVALID_PARAMETER;
+		}
+	}
+	*count = i;
+	return i == 0 ? EFI_INVALID_PARAMETER : EFI_SUCCESS;
+}
+
+/**
+Read back verify/1000 of sectors (at least one) at random positions
+*/
+EFI_STATUS
+WipeVerify(
+	IN     EFI_BLOCK_IO_PROTOCOL  *bio,
+	IN     WIPE_PASS              *pass,
+	IN OUT RND_STREAM             *stream,
+	IN     UINT64                 start,
+	IN     UINT64                 sectors,
+	IN     UINTN                  verify,
+	IN     UINT8                  *buf
+	)
+{
+	EFI_STATUS  res = EFI_SUCCESS;
+	UINT64      samples;
+	UINT64      i;
+	UINT64      rel;
+	samples = sectors * verify / 1000;
+	if (samples == 0) samples = 1;
+	for (i = 0; i < samples; ++i) {
+		res = RndGetBytes((UINT8*)&rel, sizeof(rel));
+		if (EFI_ERROR(res)) return res;
+		rel = rel % sectors;
+		res = bio->ReadBlocks(bio, bio->Media->MediaId, start + rel, 512, buf);
+		if (EFI_ERROR(res)) {
+			ERR_PRINT(L"\nRead %lld: %r\n", start + rel, res);
+			pass->Mismatch++;
+			continue;
+		}
+		WipeFill(pass, stream, buf + 512, rel, 1);
+		if (CompareMem(buf, buf + 512, 512) != 0) {
+			ERR_PRINT(L"\nMismatch %lld\n", start + rel);
+			pass->Mismatch++;
+		}
+		pass->Verified++;
+	}
+	return EFI_SUCCESS;
+}
+
+/**
+Write passes over [start, end]. verify - sectors per 1000 read back after each pass.
+*/
+EFI_STATUS
+BlockRangeWipePasses(
+	IN     EFI_HANDLE   h,
+	IN     UINT64       start,
+	IN     UINT64       end,
+	IN     CHAR16       *passes,
+	IN     UINTN        verify,
+	IN OUT WIPE_REPORT  *rep
+	)
+{
+	EFI_STATUS              res;
+	EFI_BLOCK_IO_PROTOCOL*  bio;
+	EFI_BLOCK_IO2_PROTOCOL* bio2 = NULL;
+	EFI_BLOCK_IO2_TOKEN     token;
+	UINT8*                  buf[2] = { NULL, NULL };
+	UINTN                   cur;
+	BOOLEAN                 pending = FALSE;
+	BOOLEAN                 started = FALSE;
+	WIPE_PASS               pass[WIPE_MAX_PASSES];
+	UINTN                   passCount;
+	UINTN                   p;
+	UINT64                  sectors = end - start + 1;
+	UINT64                  remains;
+	UINT64                  pos;
+	UINT64                  mismatch = 0;
+	UINTN                   rd;
+	RND_STREAM              stream;
+
+	ZeroMem(&stream, sizeof(stream));
+	ZeroMem(&token, sizeof(token));
+	bio = EfiGetBlockIO(h);
+	if (bio == 0) {
+		ERR_PRINT(L"No block device");
+		return EFI_NOT_FOUND;
+	}
+	res = WipePassesParse(passes, pass, &passCount, sectors);
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"Wipe passes %s: %r\n", passes, res);
+		return res;
+	}
+	buf[0] = MEM_ALLOC(WIPE_BUF_SECTORS << 9);
+	buf[1] = MEM_ALLOC(WIPE_BUF_SECTORS << 9);
+	if (buf[0] == NULL || buf[1] == NULL) {
+		ERR_PRINT(L"can not get buffer\n");
+		res = EFI_BUFFER_TOO_SMALL;
+		goto error;
+	}
+	res = RndStreamInit(&stream);
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"Rnd stream: %r\n", res);
+		goto error;
+	}
+	if (!EFI_ERROR(gBS->HandleProtocol(h, &gEfiBlockIo2ProtocolGuid, (VOID**)&bio2))) {
+		res = gBS->CreateEvent(0, 0, NULL, NULL, &token.Event);
+		if (EFI_ERROR(res)) bio2 = NULL;
+	}
+	WipeReportAdd(rep, "start=%lld\r\nend=%lld\r\npasses=%s\r\nverify=%d\r\nasync=%d\r\n", start, end, passes, (UINT32)verify, bio2 != NULL);
+
+	for (p = 0; p < passCount; ++p) {
+		UINT64 startUs = EfiTimeStampUs();
+		OUT_PRINT(L"Pass %d/%d (%c%a)\n", (UINT32)(p + 1), (UINT32)passCount, pass[p].Pattern, pass[p].Invert ? "~" : "");
+		RangeCryptProgressStart(CryptPhaseWipe, sectors);
+		started = TRUE;
+		remains = sectors;
+		pos = start;
+		cur = 0;
+		pending = FALSE;
+		do {
+			rd = (UINTN)((remains > WIPE_BUF_SECTORS) ? WIPE_BUF_SECTORS : remains);
+			WipeFill(&pass[p], &stream, buf[cur], pos - start, rd);
+			if (pending) {
+				UINTN idx;
+				gBS->WaitForEvent(1, &token.Event, &idx);
+				pending = FALSE;
+				if (EFI_ERROR(token.TransactionStatus)) {
+					res = token.TransactionStatus;
+					ERR_PRINT(L"\nWrite error: %r\n", res);
+					goto error;
+				}
+			}
+			if (bio2 != NULL) {
+				token.TransactionStatus = EFI_SUCCESS;
+				res = bio2->WriteBlocksEx(bio2, bio->Media->MediaId, pos, &token, rd << 9, buf[cur]);
+				pending = !EFI_ERROR(res);
+			}	else {
+				res = bio->WriteBlocks(bio, bio->Media->MediaId, pos, rd << 9, buf[cur]);
+			}
+			if (EFI_ERROR(res)) {
+				ERR_PRINT(L"\nWrite error: %r\n", res);
+				goto error;
+			}
+			cur ^= 1;
+			pos += rd;
+			remains -= rd;
+			RangeCryptProgress(sectors, remains, pos, sectors);
+		} while (remains > 0);
+		if (pending) {
+			UINTN idx;
+			gBS->WaitForEvent(1, &token.Event, &idx);
+			pending = FALSE;
+			res = token.TransactionStatus;
+			if (EFI_ERROR(res)) {
+				ERR_PRINT(L"\nWrite error: %r\n", res);
+				goto error;
+			}
+		}
+		bio->FlushBlocks(bio);
+		pass[p].Us = EfiTimeStampUs() - startUs;
+		OUT_PRINT(L"\n");
+
+		if (verify > 0) {
+			res = WipeVerify(bio, &pass[p], &stream, start, sectors, verify, buf[0]);
+			if (EFI_ERROR(res)) goto error;
+			mismatch += pass[p].Mismatch;
+			OUT_PRINT(L"Verified %lld, mismatch %lld\n", pass[p].Verified, pass[p].Mismatch);
+		}
+		WipeReportAdd(rep, "pass=%d\r\npattern=%c%a\r\nseconds=%lld\r\nrate=%lld\r\nverified=%lld\r\nmismatch=%lld\r\n",
+			(UINT32)(p + 1), pass[p].Pattern, pass[p].Invert ? "~" : "",
+			pass[p].Us / 1000000,
+			pass[p].Us > 0 ? sectors * 512 * 1000000 / pass[p].Us : 0,
+			pass[p].Verified, pass[p].Mismatch);
+	}
+	res = mismatch > 0 ? EFI_CRC_ERROR : EFI_SUCCESS;
+
+error:
+	if (pending) {
+		UINTN idx;
+		gBS->WaitForEvent(1, &token.Event, &idx);
+	}
+	if (started) {
+		RangeCryptProgressEnd(EFI_ERROR(res) ? CryptPhaseFailed : CryptPhaseDone);
+	}
+	if (token.Event != NULL) gBS->CloseEvent(token.Event);
+	RndStreamClose(&stream);
+	MEM_FREE(buf[0]);
+	MEM_FREE(buf[1]);
+	return res;
+}
+
 EFI_STATUS
 BlockRangeWipe(
 	IN EFI_HANDLE h,
@@ -851,10 +1679,8 @@ BlockRangeWipe(
 {
 	EFI_STATUS              res;
 	EFI_BLOCK_IO_PROTOCOL*  bio;
-	VOID*                   buf;
-	UINT64                  remains;
-	UINT64                  pos;
-	UINTN                   rd;
+	UINTN                   method;
+	WIPE_REPORT             rep;
 	bio = EfiGetBlockIO(h);
 	if (bio == 0) {
 		ERR_PRINT(L"No block device");
@@ -871,80 +1697,323 @@ BlockRangeWipe(
 
 	OUT_PRINT(L"\nSectors [%lld, %lld]", start, end);
 	if (AskConfirm(", Wipe data?", 1) == 0) return EFI_NOT_READY;
-	buf = MEM_ALLOC(CRYPT_BUF_SECTORS << 9);
-	if (!buf) {
-		ERR_PRINT(L"can not get buffer\n");
-		return EFI_INVALID_PARAMETER;
+
+	rep.Size = 4096;
+	rep.Len = 0;
+	rep.Buf = MEM_ALLOC(rep.Size);
+	if (gWipePasses != NULL) {
+		method = BlockEraseSoftware;
+		WipeReportAdd(&rep, "method=%s\r\n", BlockEraseMethodName(method));
+		res = BlockRangeWipePasses(h, start, end, gWipePasses, gWipeVerify, &rep);
+	}	else {
+		res = BlockRangeErase(h, start, end, &method);
+		if (res == EFI_UNSUPPORTED) {
+			method = BlockEraseSoftware;
+			res = BlockRangeOverwrite(h, start, end);
+		}
+		WipeReportAdd(&rep, "method=%s\r\nstart=%lld\r\nend=%lld\r\n", BlockEraseMethodName(method), start, end);
+	}
+	WipeReportAdd(&rep, "result=%r\r\n", res);
+	WipeReportSave(&rep);
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"Wipe(%s): %r\n", BlockEraseMethodName(method), res);
+		return res;
 	}
-	remains = end -start + 1;
-	pos = start;
+	OUT_PRINT(L"\nDone (%s)\n", BlockEraseMethodName(method));
+	return res;
+}
+
+EFI_STATUS
+BlockRangeOverwrite(
+	IN EFI_HANDLE h,
+	IN UINT64 start,
+	IN UINT64 end
+	)
+{
+	return BlockRangeWipePasses(h, start, end, L"r", 0, NULL);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// KDF benchmark
+//////////////////////////////////////////////////////////////////////////
+// PBKDF2 rate of every PRF is measured here (pre-boot, BSP only).
+// Time of header try is iterations / rate.
+#define KDF_BENCH_MIN_US 250000
+#define KDF_BENCH_MAX_PIM 2147468
+#define KDF_BENCH_MAX_ITERATIONS 0x7FFFFFFF
+#ifndef MAX_BOOT_PIM_VALUE
+#define MAX_BOOT_PIM_VALUE 65535
+#endif
+
+CHAR16* gKdfBenchFile = L"DcsKdfBench.txt";
+
+VOID
+KdfBenchDerive(
+	IN  int     prf,
+	IN  uint32  iterations,
+	OUT char    *dk
+	)
+{
+	char pwd[] = "DcsKdfBench";
+	char salt[PKCS5_SALT_SIZE];
+	SetMem(salt, sizeof(salt), 0x5A);
+	switch (prf) {
+	case SHA512:
+		derive_key_sha512(pwd, sizeof(pwd) - 1, salt, sizeof(salt), iterations, dk, MASTER_KEYDATA_SIZE);
+		break;
+	case WHIRLPOOL:
+		derive_key_whirlpool(pwd, sizeof(pwd) - 1, salt, sizeof(salt), iterations, dk, MASTER_KEYDATA_SIZE);
+		break;
+	case SHA256:
+		derive_key_sha256(pwd, sizeof(pwd) - 1, salt, sizeof(salt), iterations, dk, MASTER_KEYDATA_SIZE);
+		break;
+	case RIPEMD160:
+		derive_key_ripemd160(pwd, sizeof(pwd) - 1, salt, sizeof(salt), iterations, dk, MASTER_KEYDATA_SIZE);
+		break;
+	case STREEBOG:
+		derive_key_streebog(pwd, sizeof(pwd) - 1, salt, sizeof(salt), iterations, dk, MASTER_KEYDATA_SIZE);
+		break;
+	}
+}
+
+/**
+Iterations per second of PRF. Iterations are doubled until run takes KDF_BENCH_MIN_US.
+*/
+UINT64
+KdfBenchRate(
+	IN int prf
+	)
+{
+	char    dk[MASTER_KEYDATA_SIZE];
+	uint32  iterations = 1000;
+	UINT64  start;
+	UINT64  us;
 	do {
-		rd = (UINTN)((remains > CRYPT_BUF_SECTORS) ? CRYPT_BUF_SECTORS : remains);
-		RandgetBytes(buf, (UINT32)(rd << 9), FALSE);
-		res = bio->WriteBlocks(bio, bio->Media->MediaId, pos, rd << 9, buf);
-		if (EFI_ERROR(res)) {
-			ERR_PRINT(L"Write error: %r\n", res);
-			MEM_FREE(buf);
-			return res;
+		start = EfiTimeStampUs();
+		KdfBenchDerive(prf, iterations, dk);
+		us = EfiTimeStampUs() - start;
+		if (us >= KDF_BENCH_MIN_US) break;
+		iterations *= 2;
+	} while (iterations < (1u << 28));
+	burn(dk, sizeof(dk));
+	if (us == 0) us = 1;
+	return DivU64x64Remainder(MultU64x32(iterations, 1000000), us, NULL);
+}
+
+/**
+Highest PIM accepted in current mode (boot PIM is limited to 16 bits)
+*/
+int
+KdfBenchMaxPim()
+{
+	return gAuthBoot ? MAX_BOOT_PIM_VALUE : KDF_BENCH_MAX_PIM;
+}
+
+/**
+Iterations of PIM in 64-bit (get_pkcs5_iteration_count is int and overflows
+for big PIM), clamped to what PBKDF2 accepts
+*/
+UINT64
+KdfBenchIterations(
+	IN int     prf,
+	IN int     pim
+	)
+{
+	UINT64 iterations;
+	if (pim <= 0) return (UINT64)get_pkcs5_iteration_count(prf, 0, FALSE, gAuthBoot);
+	if (gAuthBoot) {
+		iterations = MultU64x32((UINT64)pim, 2048);
+	}	else {
+		iterations = 15000 + MultU64x32((UINT64)pim, 1000);
+	}
+	if (iterations > KDF_BENCH_MAX_ITERATIONS) iterations = KDF_BENCH_MAX_ITERATIONS;
+	return iterations;
+}
+
+UINT64
+KdfBenchMs(
+	IN int     prf,
+	IN int     pim,
+	IN UINT64  rate
+	)
+{
+	UINT64 iterations = KdfBenchIterations(prf, pim);
+	return DivU64x64Remainder(MultU64x32(iterations, 1000), rate, NULL);
+}
+
+/**
+Highest PIM with header try not longer than targetMs (1 if even PIM 1 is too slow,
+PIM 0 is default iterations)
+*/
+int
+KdfBenchPim(
+	IN int     prf,
+	IN UINT64  rate,
+	IN UINT64  targetMs
+	)
+{
+	int lo = 1;
+	int hi = KdfBenchMaxPim();
+	while (lo < hi) {
+		int mid = lo + (hi - lo + 1) / 2;
+		if (KdfBenchMs(prf, mid, rate) <= targetMs) {
+			lo = mid;
+		}	else {
+			hi = mid - 1;
 		}
-		pos += rd;
-		remains -= rd;
-		OUT_PRINT(L"%lld %lld       \r", pos, remains);
-	} while (remains > 0);
-	OUT_PRINT(L"\nDone\n", pos, remains);
+	}
+	return lo;
+}
+
+EFI_STATUS
+KdfBenchmark(
+	IN UINTN targetMs
+	)
+{
+	EFI_STATUS  res;
+	CHAR8       *buf;
+	UINTN       len = 0;
+	UINTN       size = 4096;
+	int         prf;
+	UINT64      serialMs = 0;
+	UINT64      parallelMs = 0;
+	int         allPim = KdfBenchMaxPim();
+	UINT64      rates[LAST_PRF_ID + 1];
+
+	buf = MEM_ALLOC(size);
+	if (buf == NULL) return EFI_BUFFER_TOO_SMALL;
+	if (targetMs == 0) targetMs = 2000;
+	OUT_PRINT(L"KDF benchmark (boot %d, target %d ms)\n", gAuthBoot, (UINT32)targetMs);
+	len += AsciiSPrint(buf + len, size - len, "boot=%d\r\ntarget_ms=%d\r\n", gAuthBoot, (UINT32)targetMs);
+
+	for (prf = FIRST_PRF_ID; prf <= LAST_PRF_ID; ++prf) {
+		UINT64  rate;
+		UINT64  defMs;
+		UINT64  pimMs;
+		int     pim;
+		Hash    *hash = HashGet(prf);
+		rate = KdfBenchRate(prf);
+		if (rate == 0) rate = 1;
+		rates[prf] = rate;
+		defMs = KdfBenchMs(prf, 0, rate);
+		pim = KdfBenchPim(prf, rate, targetMs);
+		pimMs = KdfBenchMs(prf, pim, rate);
+		if (pim < allPim) allPim = pim;
+		OUT_PRINT(L"%H%s%N %lld it/s, default %lld ms, PIM %H%d%N (%lld ms)%s\n",
+			hash != NULL ? hash->Name : L"?", rate, defMs, pim, pimMs,
+			pimMs > targetMs ? L" - target unreachable" : L"");
+		len += AsciiSPrint(buf + len, size - len, "prf=%s\r\nrate=%lld\r\ndefault_ms=%lld\r\npim=%d\r\npim_ms=%lld\r\nreachable=%d\r\n",
+			hash != NULL ? hash->Name : L"?", rate, defMs, pim, pimMs, pimMs <= targetMs ? 1 : 0);
+	}
+
+	// TEST ALL worst case at recommended PIM: sum serially, slowest PRF if all run on APs
+	for (prf = FIRST_PRF_ID; prf <= LAST_PRF_ID; ++prf) {
+		UINT64 ms = KdfBenchMs(prf, allPim, rates[prf]);
+		serialMs += ms;
+		if (ms > parallelMs) parallelMs = ms;
+	}
+	OUT_PRINT(L"TEST ALL PIM %d: %lld ms serial, %lld ms parallel\n", allPim, serialMs, parallelMs);
+	len += AsciiSPrint(buf + len, size - len, "testall_pim=%d\r\ntestall_serial_ms=%lld\r\ntestall_parallel_ms=%lld\r\n",
+		allPim, serialMs, parallelMs);
+
+	res = FileSave(NULL, gKdfBenchFile, buf, len);
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"Save %s: %r\n", gKdfBenchFile, res);
+	}	else {
+		OUT_PRINT(L"Saved to %s\n", gKdfBenchFile);
+	}
+	MEM_FREE(buf);
 	return res;
 }
 
 //////////////////////////////////////////////////////////////////////////
 // DCS authorization check
 //////////////////////////////////////////////////////////////////////////
+/**
+Read normal (and hidden if not boot) header of disk to probes
+*/
 EFI_STATUS
-IntCheckVolume(
-	UINTN index
+IntCheckVolumeRead(
+	IN     UINTN         index,
+	IN OUT HEADER_PROBE  *probes,
+	IN OUT UINTN         *count
 	)
 {
-	EFI_BLOCK_IO_PROTOCOL*  pBio;
 	EFI_STATUS              res;
-	EFI_LBA                 vhsector;
+	res = HeaderProbeRead(probes, count, index, gAuthBoot ? TC_BOOT_VOLUME_HEADER_SECTOR : 0);
+	if (EFI_ERROR(res)) return res;
+	if (gAuthBoot == 0) {
+		HeaderProbeRead(probes, count, index, TC_VOLUME_HEADER_SIZE / 512);
+	}
+	return EFI_SUCCESS;
+}
 
+/**
+Print result of probes of disk index
+*/
+EFI_STATUS
+IntCheckVolumePrint(
+	IN UINTN         index,
+	IN HEADER_PROBE  *probes,
+	IN UINTN         count
+	)
+{
+	UINTN i;
 	BioPrintDevicePath(index);
-	pBio = EfiGetBlockIO(gBIOHandles[index]);
-	if (pBio == NULL) {
-		ERR_PRINT(L" No BIO protocol\n");
-		return EFI_NOT_FOUND;
+	for (i = 0; i < count; ++i) {
+		if (probes[i].Disk != index || probes[i].CryptoInfo == NULL) continue;
+		if (probes[i].Sector == TC_VOLUME_HEADER_SIZE / 512 && gAuthBoot == 0) {
+			OUT_PRINT(L"hidden ");
+		}
+		CryptoInfoPrint(probes[i].CryptoInfo);
+		return EFI_SUCCESS;
 	}
+	ERR_PRINT(L"Authorization failed. Wrong password, PIM or hash.\n");
+	return EFI_INVALID_PARAMETER;
+}
 
-	vhsector = gAuthBoot ? TC_BOOT_VOLUME_HEADER_SECTOR : 0;
-	res = pBio->ReadBlocks(pBio, pBio->Media->MediaId, vhsector, 512, Header);
+EFI_STATUS
+IntCheckVolume(
+	UINTN index
+	)
+{
+	EFI_STATUS              res;
+	HEADER_PROBE            probes[2];
+	UINTN                   count = 0;
+
+	res = IntCheckVolumeRead(index, probes, &count);
 	if (EFI_ERROR(res)) {
+		BioPrintDevicePath(index);
 		ERR_PRINT(L" %r(%x)\n", res, res);
 		return res;
 	}
-	
-	res = TryHeaderDecrypt(Header, &gAuthCryptInfo, NULL);
-	if (res != 0) {
-		if (gAuthBoot == 0) {
-			OUT_PRINT(L"Try hidden...");
-			res = pBio->ReadBlocks(pBio, pBio->Media->MediaId, TC_VOLUME_HEADER_SIZE / 512, 512, Header);
-			if (EFI_ERROR(res)) {
-				ERR_PRINT(L" %r(%x)\n", res, res);
-				return res;
-			}
-			res = TryHeaderDecrypt(Header, &gAuthCryptInfo, NULL);
-		}
-	}
+	HeaderProbeAll(probes, count, TRUE, FALSE);
+	res = IntCheckVolumePrint(index, probes, count);
+	HeaderProbeFree(probes, count);
 	return res;
 }
 
 VOID
 DisksAuthCheck() {
-	UINTN i;
+	UINTN          i;
+	UINTN          end;
+	HEADER_PROBE   *probes;
+	UINTN          count = 0;
 	if (BioIndexStart >= gBIOCount) return;
-	i = BioIndexStart;
-	do {
-		IntCheckVolume(i);
-		++i;
-	} while ((i < gBIOCount) && (i <= BioIndexEnd));
+	end = (BioIndexEnd < gBIOCount) ? BioIndexEnd : gBIOCount - 1;
+	if (end < BioIndexStart) end = BioIndexStart;
+	probes = MEM_ALLOC(sizeof(HEADER_PROBE) * 2 * (end - BioIndexStart + 1));
+	if (probes == NULL) return;
+	for (i = BioIndexStart; i <= end; ++i) {
+		IntCheckVolumeRead(i, probes, &count);
+	}
+	OUT_PRINT(L"Authorizing %d headers...\n", count);
+	HeaderProbeAll(probes, count, FALSE, FALSE);
+	for (i = BioIndexStart; i <= end; ++i) {
+		IntCheckVolumePrint(i, probes, count);
+	}
+	HeaderProbeFree(probes, count);
+	MEM_FREE(probes);
 }
 
 VOID
@@ -1030,7 +2099,7 @@ void UsbIoPrintDevicePath(UINTN uioIndex) {
 	UsbGetId(gUSBHandles[uioIndex], &id);
 	if (id != NULL) {
 		UINT32 rud;
-		rud = (UINT32)GetCrc32((unsigned char*)id, (int)AsciiStrLen(id));
+		rud = EfiCrc32(id, AsciiStrLen(id));
 		OUT_PRINT(L" -(%d) %a", rud, id);
 		MEM_FREE(id);
 	}
@@ -1112,12 +2181,7 @@ SecRigionMark()
 
 	adm->AuthDataSize = (UINT32)gSecRigonCount;
 	adm->PlatformCrc = crc;
-	res = gBS->CalculateCrc32(&adm->PlatformCrc, sizeof(*adm) - 4, &adm->HeaderCrc);
-
-	if (EFI_ERROR(res)) {
-		ERR_PRINT(L"CRC: %r\n", res);
-		return res;
-	}
+	adm->HeaderCrc = EfiCrc32(&adm->PlatformCrc, sizeof(*adm) - 4);
 
 	bio = EfiGetBlockIO(gBIOHandles[BioIndexStart]);
 	if (bio == NULL) {
@@ -1140,7 +2204,9 @@ SecRigionWipe()
 	CHAR8*      buf;
 	UINTN       i;
 	EFI_BLOCK_IO_PROTOCOL* bio;
+	RND_STREAM  stream;
 
+	ZeroMem(&stream, sizeof(stream));
 	buf = MEM_ALLOC(128 * 1024);
 	if (buf == NULL) {
 		ERR_PRINT(L"no memory\n");
@@ -1154,12 +2220,13 @@ SecRigionWipe()
 		goto error;
 	}
 
-	if (!RandgetBytes(buf, 512, FALSE)) {
+	res = RndStreamInit(&stream);
+	if (EFI_ERROR(res)) {
 		ERR_PRINT(L"No randoms\n");
-		res = EFI_CRC_ERROR;
 		goto error;
-	}	
-	
+	}
+	RndStreamGetBytes(&stream, buf, 512);
+
 	// Wipe mark
 	res = bio->WriteBlocks(bio, bio->Media->MediaId, 61, 512, buf);
 	if (EFI_ERROR(res)) {
@@ -1167,22 +2234,26 @@ SecRigionWipe()
 		goto error;
 	}
 
-	// Wipe region
-	for (i = 0; i < gSecRigonCount; ++i) {
-		if (!RandgetBytes(buf, 128 * 1024, FALSE)) {
-			ERR_PRINT(L"No randoms\n");
-			res = EFI_CRC_ERROR;
-			goto error;
+	// Wipe region (discard old data on flash before random data)
+	if (gSecRigonCount > 0 && gBlockEraseHardware) {
+		UINTN method;
+		res = BlockRangeErase(gBIOHandles[BioIndexStart], 62, 62 + gSecRigonCount * (128 * 1024 / 512) - 1, &method);
+		if (!EFI_ERROR(res)) {
+			OUT_PRINT(L"Erased (%s)\n", BlockEraseMethodName(method));
 		}
+	}
+	for (i = 0; i < gSecRigonCount; ++i) {
+		RndStreamGetBytes(&stream, buf, 128 * 1024);
 		res = bio->WriteBlocks(bio, bio->Media->MediaId, 62 + i * (128 * 1024 / 512), 128 * 1024, buf);
 		if (EFI_ERROR(res)) {
 			ERR_PRINT(L"Write: %r\n", res);
 			goto error;
 		}
 	}
-	return EFI_SUCCESS;
+	res = EFI_SUCCESS;
 
 error:
+	RndStreamClose(&stream);
 	MEM_FREE(buf);
 	return res;
 }
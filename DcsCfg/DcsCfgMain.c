@@ -76,8 +76,23 @@ https://opensource.org/licenses/LGPL-3.0
 #define OPT_SECREGION_WIPE L"-srw"
 #define OPT_SECREGION_ADD L"-sra"
 #define OPT_WIPE L"-wipe"
+#define OPT_WIPE_SOFTWARE L"-wipesw"
+#define OPT_WIPE_PASSES L"-wipep"
+#define OPT_WIPE_VERIFY L"-wipev"
+#define OPT_WIPE_REPORT L"-wiperf"
 #define OPT_OS_DECRYPT L"-osdecrypt"
 #define OPT_OS_RESTORE_KEY L"-osrestorekey"
+#define OPT_BATCH L"-batch"
+#define OPT_BATCH_LOG L"-blog"
+#define OPT_STATUS_FILE L"-sf"
+#define OPT_KDF_BENCH L"-kdfb"
+#define OPT_REBOOT_TOKEN L"-rtk"
+#define OPT_KDF_BENCH_FILE L"-kdfbf"
+#define OPT_ANSWERS L"-ans"
+#define OPT_NO_INPUT L"-noinput"
+#define OPT_CMD_FILE L"-cmd"
+#define OPT_CMD_STATUS_FILE L"-cmdsf"
+#define OPT_CMD_KEEP_GOING L"-cmdkeep"
 
 STATIC CONST SHELL_PARAM_ITEM ParamList[] = {
    { OPT_DISK_LIST,     TypeValue },
@@ -122,8 +137,23 @@ STATIC CONST SHELL_PARAM_ITEM ParamList[] = {
 	{ OPT_SECREGION_WIPE,       TypeValue },
 	{ OPT_SECREGION_ADD,        TypeValue },
 	{ OPT_WIPE,                 TypeDoubleValue },
+	{ OPT_WIPE_SOFTWARE,        TypeFlag },
+	{ OPT_WIPE_PASSES,          TypeValue },
+	{ OPT_WIPE_VERIFY,          TypeValue },
+	{ OPT_WIPE_REPORT,          TypeValue },
 	{ OPT_OS_DECRYPT,     TypeFlag },
 	{ OPT_OS_RESTORE_KEY, TypeFlag },
+	{ OPT_BATCH,          TypeFlag },
+	{ OPT_BATCH_LOG,      TypeValue },
+	{ OPT_STATUS_FILE,    TypeValue },
+	{ OPT_KDF_BENCH,      TypeValue },
+	{ OPT_REBOOT_TOKEN,   TypeDoubleValue },
+	{ OPT_KDF_BENCH_FILE, TypeValue },
+	{ OPT_ANSWERS,        TypeValue },
+	{ OPT_NO_INPUT,       TypeFlag },
+	{ OPT_CMD_FILE,       TypeValue },
+	{ OPT_CMD_STATUS_FILE, TypeValue },
+	{ OPT_CMD_KEEP_GOING, TypeFlag },
 	{ NULL, TypeMax }
 };
 
@@ -223,8 +253,51 @@ DcsCfgMain(
 		DcsDiskEntrysFileName = ShellCommandLineGetValue(Package, OPT_PARTITION_FILE);
 	}
 
+	if (ShellCommandLineGetFlag(Package, OPT_BATCH)) {
+		gCryptBatch = TRUE;
+	}
+
+	if (ShellCommandLineGetFlag(Package, OPT_BATCH_LOG)) {
+		gCryptBadLbaLog = (CHAR16*)ShellCommandLineGetValue(Package, OPT_BATCH_LOG);
+	}
+
+	if (ShellCommandLineGetFlag(Package, OPT_STATUS_FILE)) {
+		gCryptStatusFile = (CHAR16*)ShellCommandLineGetValue(Package, OPT_STATUS_FILE);
+	}
+
+	if (ShellCommandLineGetFlag(Package, OPT_KDF_BENCH_FILE)) {
+		gKdfBenchFile = (CHAR16*)ShellCommandLineGetValue(Package, OPT_KDF_BENCH_FILE);
+	}
+
+	if (ShellCommandLineGetFlag(Package, OPT_ANSWERS)) {
+		gConsoleAnswers = (CHAR16*)ShellCommandLineGetValue(Package, OPT_ANSWERS);
+	}
+
+	if (ShellCommandLineGetFlag(Package, OPT_NO_INPUT)) {
+		gConsoleNoInput = TRUE;
+	}
+
+	// Command file
+	if (ShellCommandLineGetFlag(Package, OPT_CMD_FILE)) {
+		if (ShellCommandLineGetFlag(Package, OPT_CMD_STATUS_FILE)) {
+			gCmdStatusFile = (CHAR16*)ShellCommandLineGetValue(Package, OPT_CMD_STATUS_FILE);
+		}
+		gCmdKeepGoing = ShellCommandLineGetFlag(Package, OPT_CMD_KEEP_GOING);
+		return DcsCfgRunCmdFile(ImageHandle, SystemTable, (CHAR16*)ShellCommandLineGetValue(Package, OPT_CMD_FILE));
+	}
+
 	if (ShellCommandLineGetFlag(Package, OPT_AUTH_ASK)) {
-		TestAuthAsk();
+		// one authorization for all lines of command file
+		if (!gCmdRunning || !gCmdAuthDone) {
+			TestAuthAsk();
+			gCmdAuthDone = gCmdRunning;
+		}
+	}
+
+	if (ShellCommandLineGetFlag(Package, OPT_KDF_BENCH)) {
+		CONST CHAR16* opt = NULL;
+		opt = ShellCommandLineGetValue(Package, OPT_KDF_BENCH);
+		return KdfBenchmark(StrDecimalToUintn(opt));
 	}
 
 	// Rescue
@@ -435,11 +508,12 @@ DcsCfgMain(
 		DcsHidePart.StartingLBA = StrDecimalToUint64(opt1);
 		opt2 = StrStr(opt1, L" ");
 		if (opt2 == NULL) {
-			EFI_ERROR(L"Select end sector\n");
+			ERR_PRINT(L"Select end sector\n");
 			return EFI_INVALID_PARAMETER;
 		}
 		DcsHidePart.EndingLBA = StrDecimalToUint64(opt2);
-		GptHideParts();
+		res = GptHideParts();
+		if (EFI_ERROR(res)) return res;
 	}
 
 	if (ShellCommandLineGetFlag(Package, OPT_PARTITION_EDIT_EXEC)) {
@@ -447,7 +521,8 @@ DcsCfgMain(
 		if (EFI_ERROR(res)) {
 			return res;
 		}
-		DeListExecEdit();
+		res = DeListExecEdit();
+		if (EFI_ERROR(res)) return res;
 	}
 
 	if (ShellCommandLineGetFlag(Package, OPT_PARTITION_EDIT_PWD_CACHE)) {
@@ -455,7 +530,8 @@ DcsCfgMain(
 		if (EFI_ERROR(res)) {
 			return res;
 		}
-		DeListPwdCacheEdit();
+		res = DeListPwdCacheEdit();
+		if (EFI_ERROR(res)) return res;
 	}
 
 	if (ShellCommandLineGetFlag(Package, OPT_PARTITION_EDIT)) {
@@ -468,7 +544,8 @@ DcsCfgMain(
 
 		opt1 = ShellCommandLineGetValue(Package, OPT_PARTITION_EDIT);
 		idx = StrDecimalToUintn(opt1);
-		GptEdit(idx);
+		res = GptEdit(idx);
+		if (EFI_ERROR(res)) return res;
 	}
 
 
@@ -482,7 +559,7 @@ DcsCfgMain(
 			} else {
 				res = DeListLoadFromFile();
 				if (EFI_ERROR(res)) {
-					EFI_ERROR(L"Select file or disk\n");
+					ERR_PRINT(L"Select file or disk\n");
 					return res;
 				}
 			}
@@ -491,11 +568,13 @@ DcsCfgMain(
 	}
 
 	if (ShellCommandLineGetFlag(Package, OPT_PARTITION_ENCRYPT)) {
-		GptCryptFile(TRUE);
+		res = GptCryptFile(TRUE);
+		if (EFI_ERROR(res)) return res;
 	}
 
 	if (ShellCommandLineGetFlag(Package, OPT_PARTITION_DECRYPT)) {
-		GptCryptFile(FALSE);
+		res = GptCryptFile(FALSE);
+		if (EFI_ERROR(res)) return res;
 	}
 
 	if (ShellCommandLineGetFlag(Package, OPT_PARTITION_ZERO)) {
@@ -503,14 +582,16 @@ DcsCfgMain(
 		if (EFI_ERROR(res)) {
 			return res;
 		}
-		DeListZero();
-		DeListSaveToFile();
+		res = DeListZero();
+		if (EFI_ERROR(res)) return res;
+		res = DeListSaveToFile();
+		if (EFI_ERROR(res)) return res;
 	}
 
 	if (ShellCommandLineGetFlag(Package, OPT_PARTITION_SAVE)) {
 		if (GptMainEntrys == NULL && DeList == NULL) {
 			if (!ShellCommandLineGetFlag(Package, OPT_DISK_START)) {
-				EFI_ERROR(L"Select disk\n");
+				ERR_PRINT(L"Select disk\n");
 				return EFI_INVALID_PARAMETER;
 			}
 			res = GptLoadFromDisk(BioIndexStart);
@@ -518,7 +599,8 @@ DcsCfgMain(
 				return res;
 			}
 		}
-		DeListSaveToFile();
+		res = DeListSaveToFile();
+		if (EFI_ERROR(res)) return res;
 	}
 
 	if (ShellCommandLineGetFlag(Package, OPT_PARTITION_APPLY)) {
@@ -529,9 +611,11 @@ DcsCfgMain(
 			if (EFI_ERROR(res)) {
 				return res;
 			}
-			DeListApplySectorsToDisk(BioIndexStart);
+			res = DeListApplySectorsToDisk(BioIndexStart);
+			if (EFI_ERROR(res)) return res;
 		}	else {
-			EFI_ERROR(L"Select file and disk\n");
+			ERR_PRINT(L"Select file and disk\n");
+			return EFI_INVALID_PARAMETER;
 		}
 	}
 
@@ -558,6 +642,24 @@ DcsCfgMain(
 		}
 	}
 
+	if (ShellCommandLineGetFlag(Package, OPT_WIPE_SOFTWARE)) {
+		gBlockEraseHardware = FALSE;
+	}
+
+	if (ShellCommandLineGetFlag(Package, OPT_WIPE_PASSES)) {
+		gWipePasses = (CHAR16*)ShellCommandLineGetValue(Package, OPT_WIPE_PASSES);
+	}
+
+	if (ShellCommandLineGetFlag(Package, OPT_WIPE_VERIFY)) {
+		gWipeVerify = StrDecimalToUintn(ShellCommandLineGetValue(Package, OPT_WIPE_VERIFY));
+		if (gWipeVerify > 1000) gWipeVerify = 1000;
+		if (gWipePasses == NULL) gWipePasses = L"r";
+	}
+
+	if (ShellCommandLineGetFlag(Package, OPT_WIPE_REPORT)) {
+		gWipeReportFile = (CHAR16*)ShellCommandLineGetValue(Package, OPT_WIPE_REPORT);
+	}
+
 	if (ShellCommandLineGetFlag(Package, OPT_WIPE)) {
 		CONST CHAR16* opt1 = NULL;
 		CONST CHAR16* opt2 = NULL;
@@ -581,7 +683,8 @@ DcsCfgMain(
 			CONST CHAR16* opt = NULL;
 			opt = ShellCommandLineGetValue(Package, OPT_SECREGION_MARK);
 			gSecRigonCount = StrDecimalToUintn(opt);
-			SecRigionMark();
+			res = SecRigionMark();
+			if (EFI_ERROR(res)) return res;
 		}	else {
 			ERR_PRINT(L"Select disk and security region count");
 			return EFI_INVALID_PARAMETER;
@@ -593,7 +696,8 @@ DcsCfgMain(
 			CONST CHAR16* opt = NULL;
 			opt = ShellCommandLineGetValue(Package, OPT_SECREGION_WIPE);
 			gSecRigonCount = StrDecimalToUintn(opt);
-			SecRigionWipe();
+			res = SecRigionWipe();
+			if (EFI_ERROR(res)) return res;
 		}
 		else {
 			ERR_PRINT(L"Select disk and security region count");
@@ -608,7 +712,8 @@ DcsCfgMain(
 			UINTN secRegionIdx;
 			opt = ShellCommandLineGetValue(Package, OPT_SECREGION_ADD);
 			secRegionIdx = StrDecimalToUintn(opt);
-			SecRigionAdd(secRegionIdx);
+			res = SecRigionAdd(secRegionIdx);
+			if (EFI_ERROR(res)) return res;
 		}
 		else {
 			ERR_PRINT(L"Select disk and GPT file");
@@ -616,6 +721,14 @@ DcsCfgMain(
 		}
 	}
 
+	if (ShellCommandLineGetFlag(Package, OPT_REBOOT_TOKEN)) {
+		CONST CHAR16* opt1 = NULL;
+		CONST CHAR16* opt2 = NULL;
+		opt1 = ShellCommandLineGetValue(Package, OPT_REBOOT_TOKEN);
+		opt2 = StrStr(opt1, L" ") + 1;
+		return RebootTokenCreate(StrDecimalToUintn(opt1), StrDecimalToUintn(opt2));
+	}
+
 	// Encrypt, decrypt, change password
 	if (ShellCommandLineGetFlag(Package, OPT_DISK_CHECK)) {
 		DisksAuthCheck();
@@ -626,7 +739,8 @@ DcsCfgMain(
 		UINTN disk;
 		opt = ShellCommandLineGetValue(Package, OPT_VOLUME_CHANGEPWD);
 		disk = StrDecimalToUintn(opt);
-		VolumeChangePassword(disk);
+		res = VolumeChangePassword(disk);
+		if (EFI_ERROR(res)) return res;
 	}
 
 	if (ShellCommandLineGetFlag(Package, OPT_VOLUME_ENCRYPT)) {
@@ -634,7 +748,8 @@ DcsCfgMain(
       UINTN disk;
       opt = ShellCommandLineGetValue(Package, OPT_VOLUME_ENCRYPT);
       disk = StrDecimalToUintn(opt);
-      VolumeEncrypt(disk);
+      res = VolumeEncrypt(disk);
+      if (EFI_ERROR(res)) return res;
    }
 
    if (ShellCommandLineGetFlag(Package, OPT_VOLUME_DECRYPT)) {
@@ -642,7 +757,8 @@ DcsCfgMain(
       UINTN disk;
       opt = ShellCommandLineGetValue(Package, OPT_VOLUME_DECRYPT);
       disk = StrDecimalToUintn(opt);
-      VolumeDecrypt(disk);
+      res = VolumeDecrypt(disk);
+      if (EFI_ERROR(res)) return res;
    }
 
 	
@@ -0,0 +1,345 @@
+/** @file
+Host (Linux) DeList and GPT builder for disk images
+
+Copyright (c) 2016. Disk Cryptography Services for EFI (DCS), Alex Kolotnikov
+
+This program and the accompanying materials
+are licensed and made available under the terms and conditions
+of the GNU Lesser General Public License, version 3.0 (LGPL-3.0).
+
+The full text of the license may be found at
+https://opensource.org/licenses/LGPL-3.0
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#undef NULL
+
+#include <Uefi.h>
+#include <Uefi/UefiGpt.h>
+#include <Guid/Gpt.h>
+#include <Library/BaseMemoryLib.h>
+
+#include <Library/CommonLib.h>
+#include <Library/DcsCfgLib.h>
+
+#include <common/Tcdefs.h>
+#include <BootCommon.h>
+
+#include "HostLib.h"
+
+// GptEdit.c
+extern EFI_PARTITION_TABLE_HEADER  *GptMainHdr;
+extern DCS_DEP_PWD_CACHE           *DePwdCache;
+
+#define OPT_IMAGE            "-img"
+#define OPT_PARTITION_FILE   "-pf"
+#define OPT_PARTITION_LIST   "-pl"
+#define OPT_PARTITION_SAVE   "-ps"
+#define OPT_PARTITION_APPLY  "-pa"
+#define OPT_PARTITION_IDX_TEMPLATE "-pnt"
+#define OPT_PARTITION_HIDE   "-phide"
+#define OPT_EXEC             "-exec"
+#define OPT_PWD              "-pwd"
+#define OPT_PWD_CLEAR        "-pwdclear"
+#define OPT_CHECK            "-check"
+#define OPT_YES              "-y"
+
+CHAR16  gDeFileName[256];
+
+//////////////////////////////////////////////////////////////////////////
+// DeList checks
+//////////////////////////////////////////////////////////////////////////
+/**
+Checks header of saved DeList (signature, CRC, entries are inside of file).
+Content of entries is checked by DeListParseSaved
+*/
+EFI_STATUS
+DeListCheckSaved(
+	IN UINT8  *buf,
+	IN UINTN  len
+	)
+{
+	DCS_DISK_ENTRY_LIST  *de;
+	UINT32               crcSaved;
+	UINT32               crc;
+	UINTN                i;
+
+	if (len < 1024) {
+		ERR_PRINT(L"DeList size %d\n", (UINT32)len);
+		return EFI_BAD_BUFFER_SIZE;
+	}
+	de = (DCS_DISK_ENTRY_LIST*)(buf + 512);
+	if (de->Signature != gDcsDiskEntryListHeaderID || de->HeaderSize != sizeof(*de)) {
+		ERR_PRINT(L"DeList signature\n");
+		return EFI_CRC_ERROR;
+	}
+	crcSaved = de->CRC32;
+	de->CRC32 = 0;
+	crc = EfiCrc32(de, 512);
+	de->CRC32 = crcSaved;
+	if (crc != crcSaved) {
+		ERR_PRINT(L"DeList crc %08x != %08x\n", crc, crcSaved);
+		return EFI_CRC_ERROR;
+	}
+	if (de->Count > DE_IDX_TOTAL || de->DataSize > len) {
+		ERR_PRINT(L"DeList count %d, data %d\n", de->Count, de->DataSize);
+		return EFI_BAD_BUFFER_SIZE;
+	}
+	for (i = 0; i < de->Count; ++i) {
+		if (de->DE[i].Type == DE_Unused || de->DE[i].Type == DE_DISKID) continue;
+		if ((UINT64)de->DE[i].Offset + de->DE[i].Length > len) {
+			ERR_PRINT(L"DeList entry %d [%d, %lld] out of file\n", (UINT32)i, de->DE[i].Offset, (UINT64)de->DE[i].Length);
+			return EFI_BAD_BUFFER_SIZE;
+		}
+	}
+	return EFI_SUCCESS;
+}
+
+EFI_STATUS
+DeListLoadChecked()
+{
+	EFI_STATUS  res;
+	UINT8       *buf;
+	UINTN       len;
+	res = FileLoad(NULL, gDeFileName, (VOID**)&buf, &len);
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"Load %s: %r\n", gDeFileName, res);
+		return res;
+	}
+	res = DeListCheckSaved(buf, len);
+	if (EFI_ERROR(res)) return res;
+	return DeListParseSaved(buf);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Edit
+//////////////////////////////////////////////////////////////////////////
+EFI_STATUS
+DeListSetExec(
+	IN CHAR8  *guid,
+	IN CHAR8  *cmd
+	)
+{
+	UINTN  i;
+	if (DeExecParams == NULL) {
+		DeExecParams = MEM_ALLOC(sizeof(*DeExecParams));
+		if (DeExecParams == NULL) return EFI_OUT_OF_RESOURCES;
+	}
+	if (AsciiStrCmp(guid, "efi") == 0) {
+		if (GptMainHdr == NULL) {
+			ERR_PRINT(L"No GPT to find EFI partition\n");
+			return EFI_NOT_FOUND;
+		}
+		for (i = 0; i < GptMainHdr->NumberOfPartitionEntries; ++i) {
+			if (CompareGuid(&gEfiPartTypeSystemPartGuid, &GptMainEntrys[i].PartitionTypeGUID)) {
+				CopyMem(&DeExecParams->ExecPartGuid, &GptMainEntrys[i].UniquePartitionGUID, sizeof(EFI_GUID));
+				break;
+			}
+		}
+		if (i == GptMainHdr->NumberOfPartitionEntries) {
+			ERR_PRINT(L"No EFI partition\n");
+			return EFI_NOT_FOUND;
+		}
+	}	else if (!AsciiStrToGuid((EFI_GUID*)&DeExecParams->ExecPartGuid, guid)) {
+		ERR_PRINT(L"GUID %a\n", guid);
+		return EFI_INVALID_PARAMETER;
+	}
+	ZeroMem(&DeExecParams->ExecCmd, sizeof(DeExecParams->ExecCmd));
+	HostAsciiToStr((CHAR16*)&DeExecParams->ExecCmd, cmd, sizeof(DeExecParams->ExecCmd) / 2);
+	return EFI_SUCCESS;
+}
+
+/**
+Adds password to cache. Cache is rebuilt if clear is set
+*/
+EFI_STATUS
+DeListAddPwd(
+	IN CHAR8    *pwd,
+	IN UINTN    pim,
+	IN BOOLEAN  clear
+	)
+{
+	UINTN len = strlen(pwd);
+	if (DePwdCache == NULL || clear) {
+		DePwdCache = MEM_ALLOC(sizeof(*DePwdCache));
+		if (DePwdCache == NULL) return EFI_OUT_OF_RESOURCES;
+		DePwdCache->Sign = DCS_DEP_PWD_CACHE_SIGN;
+	}
+	if (DePwdCache->Count >= 4 || len > MAX_PASSWORD) {
+		ERR_PRINT(L"Password cache is full or password is too long\n");
+		return EFI_BUFFER_TOO_SMALL;
+	}
+	CopyMem(DePwdCache->Pwd[DePwdCache->Count].Text, pwd, len);
+	DePwdCache->Pwd[DePwdCache->Count].Length = (uint32)len;
+	DePwdCache->Pim[DePwdCache->Count] = (uint32)pim;
+	DePwdCache->Count++;
+	DePwdCache->CRC = 0;
+	DePwdCache->CRC = EfiCrc32(DePwdCache, sizeof(*DePwdCache));
+	return EFI_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Main
+//////////////////////////////////////////////////////////////////////////
+VOID
+PrintUsage()
+{
+	OUT_PRINT(L"DcsDeTool -img <image> [-pf <file>] [-exec <guid|efi> <cmd>] [-pwd <pwd> <pim>]... -ps\n");
+	OUT_PRINT(L"DcsDeTool -pf <file> [-pnt <PNT> -phide <HS> <HE>] [-exec <guid|efi> <cmd>] [-pwdclear] [-pwd <pwd> <pim>]... [-check] [-pl] [-ps]\n");
+	OUT_PRINT(L"DcsDeTool -pf <file> -img <image> [-y] -pa\n");
+}
+
+int
+main(
+	int   argc,
+	char  **argv
+	)
+{
+	EFI_STATUS  res = EFI_SUCCESS;
+	EFI_HANDLE  disk = NULL;
+	CHAR8       *image = NULL;
+	BOOLEAN     list = FALSE;
+	BOOLEAN     save = FALSE;
+	BOOLEAN     apply = FALSE;
+	BOOLEAN     check = FALSE;
+	BOOLEAN     pwdClear = FALSE;
+	BOOLEAN     hide = FALSE;
+	UINTN       templateIdx = 0;
+	BOOLEAN     templateSet = FALSE;
+	UINT64      hideStart = 0;
+	UINT64      hideEnd = 0;
+	CHAR8       *execGuid = NULL;
+	CHAR8       *execCmd = NULL;
+	int         pwdArg[4];
+	UINTN       pwdCount = 0;
+	int         i;
+
+	HostAsciiToStr(gDeFileName, "DcsDiskEntrys", sizeof(gDeFileName) / 2);
+	for (i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], OPT_IMAGE) == 0 && i + 1 < argc) {
+			image = argv[++i];
+		} else if (strcmp(argv[i], OPT_PARTITION_FILE) == 0 && i + 1 < argc) {
+			HostAsciiToStr(gDeFileName, argv[++i], sizeof(gDeFileName) / 2);
+		} else if (strcmp(argv[i], OPT_PARTITION_LIST) == 0) {
+			list = TRUE;
+		} else if (strcmp(argv[i], OPT_PARTITION_SAVE) == 0) {
+			save = TRUE;
+		} else if (strcmp(argv[i], OPT_PARTITION_APPLY) == 0) {
+			apply = TRUE;
+		} else if (strcmp(argv[i], OPT_CHECK) == 0) {
+			check = TRUE;
+		} else if (strcmp(argv[i], OPT_YES) == 0) {
+			gHostAssumeYes = TRUE;
+		} else if (strcmp(argv[i], OPT_PARTITION_IDX_TEMPLATE) == 0 && i + 1 < argc) {
+			templateIdx = (UINTN)strtoull(argv[++i], NULL, 10);
+			templateSet = TRUE;
+		} else if (strcmp(argv[i], OPT_PARTITION_HIDE) == 0 && i + 2 < argc) {
+			hideStart = strtoull(argv[++i], NULL, 10);
+			hideEnd = strtoull(argv[++i], NULL, 10);
+			hide = TRUE;
+		} else if (strcmp(argv[i], OPT_EXEC) == 0 && i + 2 < argc) {
+			execGuid = argv[++i];
+			execCmd = argv[++i];
+		} else if (strcmp(argv[i], OPT_PWD_CLEAR) == 0) {
+			pwdClear = TRUE;
+		} else if (strcmp(argv[i], OPT_PWD) == 0 && i + 2 < argc && pwdCount < 4) {
+			pwdArg[pwdCount++] = i + 1;
+			i += 2;
+		} else {
+			ERR_PRINT(L"Unknown option %a\n", argv[i]);
+			PrintUsage();
+			return 1;
+		}
+	}
+	DcsDiskEntrysFileName = gDeFileName;
+
+	// Source: GPT of image or saved DeList
+	if (image != NULL && !apply) {
+		res = HostDiskOpen(image, FALSE, &disk);
+		if (EFI_ERROR(res)) {
+			ERR_PRINT(L"Open %a: %r\n", image, res);
+			return 1;
+		}
+		gBIOHandles = &disk;
+		gBIOCount = 1;
+		res = GptLoadFromDisk(0);
+	}	else {
+		res = DeListLoadChecked();
+	}
+	if (EFI_ERROR(res)) goto error;
+
+	if (hide) {
+		if (GptMainHdr == NULL || !templateSet || templateIdx >= GptMainHdr->NumberOfPartitionEntries) {
+			ERR_PRINT(L"Select GPT and base partition index\n");
+			res = EFI_INVALID_PARAMETER;
+			goto error;
+		}
+		CopyMem(&DcsHidePart, &GptMainEntrys[templateIdx], sizeof(DcsHidePart));
+		DcsHidePart.StartingLBA = hideStart;
+		DcsHidePart.EndingLBA = hideEnd;
+		res = GptHideParts();
+		if (EFI_ERROR(res)) goto error;
+	}
+
+	if (execGuid != NULL) {
+		res = DeListSetExec(execGuid, execCmd);
+		if (EFI_ERROR(res)) goto error;
+	}
+
+	if (pwdClear && pwdCount == 0) {
+		DePwdCache = NULL;
+	}
+	for (i = 0; i < (int)pwdCount; ++i) {
+		res = DeListAddPwd(argv[pwdArg[i]], (UINTN)strtoull(argv[pwdArg[i] + 1], NULL, 10), pwdClear && i == 0);
+		if (EFI_ERROR(res)) goto error;
+	}
+
+	if (check) {
+		OUT_PRINT(L"DeList %s: %r\n", gDeFileName, res);
+	}
+
+	if (list) {
+		DeListPrint();
+	}
+
+	if (save) {
+		res = DeListSaveToFile();
+		if (EFI_ERROR(res)) goto error;
+		// re-read to check what is written (DeList is released by save)
+		res = DeListLoadChecked();
+		if (EFI_ERROR(res)) goto error;
+		OUT_PRINT(L"Saved %s\n", gDeFileName);
+	}
+
+	if (apply) {
+		if (image == NULL) {
+			ERR_PRINT(L"Select image\n");
+			res = EFI_INVALID_PARAMETER;
+			goto error;
+		}
+		OUT_PRINT(L"Apply %s to %a", gDeFileName, image);
+		if (!AskConfirm("?", 1)) {
+			res = EFI_ABORTED;
+			goto error;
+		}
+		res = HostDiskOpen(image, TRUE, &disk);
+		if (EFI_ERROR(res)) {
+			ERR_PRINT(L"Open %a: %r\n", image, res);
+			goto error;
+		}
+		gBIOHandles = &disk;
+		gBIOCount = 1;
+		res = DeListApplySectorsToDisk(0);
+		if (EFI_ERROR(res)) goto error;
+	}
+
+error:
+	HostDiskClose(disk);
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"%r\n", res);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,720 @@
+/** @file
+Host (Linux) replacement of CommonLib subset used by GptEdit.c
+
+Copyright (c) 2016. Disk Cryptography Services for EFI (DCS), Alex Kolotnikov
+
+This program and the accompanying materials
+are licensed and made available under the terms and conditions
+of the GNU Lesser General Public License, version 3.0 (LGPL-3.0).
+
+The full text of the license may be found at
+https://opensource.org/licenses/LGPL-3.0
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#undef NULL
+
+#include <Uefi.h>
+#include <Uefi/UefiGpt.h>
+#include <Guid/Gpt.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/CommonLib.h>
+#include <Library/DcsCfgLib.h>
+#include "HostLib.h"
+
+EFI_GUID    gEfiPartTypeUnusedGuid = EFI_PART_TYPE_UNUSED_GUID;
+EFI_GUID    gEfiPartTypeSystemPartGuid = EFI_PART_TYPE_EFI_SYSTEM_PART_GUID;
+
+EFI_HANDLE* gBIOHandles = NULL;
+UINTN       gBIOCount = 0;
+
+DCS_RND*    gRnd = NULL;
+BOOLEAN     gHostAssumeYes = FALSE;
+
+//////////////////////////////////////////////////////////////////////////
+// Memory
+//////////////////////////////////////////////////////////////////////////
+VOID*
+MemAlloc(
+	IN UINTN size
+	)
+{
+	return calloc(1, size);
+}
+
+VOID
+MemFree(
+	IN VOID* ptr
+	)
+{
+	free(ptr);
+}
+
+VOID*
+EFIAPI
+CopyMem(
+	OUT VOID       *DestinationBuffer,
+	IN CONST VOID  *SourceBuffer,
+	IN UINTN       Length
+	)
+{
+	return memmove(DestinationBuffer, SourceBuffer, Length);
+}
+
+VOID*
+EFIAPI
+SetMem(
+	OUT VOID  *Buffer,
+	IN UINTN  Length,
+	IN UINT8  Value
+	)
+{
+	return memset(Buffer, Value, Length);
+}
+
+VOID*
+EFIAPI
+ZeroMem(
+	OUT VOID  *Buffer,
+	IN UINTN  Length
+	)
+{
+	return memset(Buffer, 0, Length);
+}
+
+INTN
+EFIAPI
+CompareMem(
+	IN CONST VOID  *DestinationBuffer,
+	IN CONST VOID  *SourceBuffer,
+	IN UINTN       Length
+	)
+{
+	return memcmp(DestinationBuffer, SourceBuffer, Length);
+}
+
+BOOLEAN
+EFIAPI
+CompareGuid(
+	IN CONST GUID  *Guid1,
+	IN CONST GUID  *Guid2
+	)
+{
+	return memcmp(Guid1, Guid2, sizeof(GUID)) == 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Strings
+//////////////////////////////////////////////////////////////////////////
+UINTN
+EFIAPI
+StrLen(
+	IN CONST CHAR16  *String
+	)
+{
+	UINTN len = 0;
+	while (String[len] != 0) len++;
+	return len;
+}
+
+INTN
+EFIAPI
+AsciiStrCmp(
+	IN CONST CHAR8  *FirstString,
+	IN CONST CHAR8  *SecondString
+	)
+{
+	return strcmp(FirstString, SecondString);
+}
+
+VOID
+HostAsciiToStr(
+	OUT CHAR16        *dst,
+	IN  CONST CHAR8   *src,
+	IN  UINTN         max
+	)
+{
+	UINTN i;
+	for (i = 0; i + 1 < max && src[i] != 0; ++i) {
+		dst[i] = (CHAR16)(UINT8)src[i];
+	}
+	dst[i] = 0;
+}
+
+STATIC
+CHAR8*
+HostStrToAscii(
+	IN CONST CHAR16  *src
+	)
+{
+	UINTN  len = StrLen(src);
+	UINTN  i;
+	CHAR8  *dst = MemAlloc(len + 1);
+	if (dst == NULL) return NULL;
+	for (i = 0; i < len; ++i) {
+		dst[i] = (src[i] < 0x80) ? (CHAR8)src[i] : '?';
+	}
+	return dst;
+}
+
+BOOLEAN
+AsciiHexToDigit(
+	OUT UINT8  *b,
+	IN  CHAR8  *str
+	)
+{
+	CHAR8 ch;
+	ch = str[0];
+	if (ch >= '0' && ch <= '9') {
+		*b = ch - '0';
+		return TRUE;
+	}
+	ch = ch & ~0x20;
+	if (ch >= 'A' && ch <= 'F') {
+		*b = ch - 'A' + 10;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+BOOLEAN
+AsciiHexToByte(
+	OUT UINT8  *b,
+	IN  CHAR8  *str
+	)
+{
+	UINT8 low = 0;
+	UINT8 high = 0;
+	BOOLEAN res;
+	res = AsciiHexToDigit(&high, str);
+	res = res && AsciiHexToDigit(&low, str + 1);
+	*b = low | high << 4;
+	return res;
+}
+
+BOOLEAN
+AsciiStrToGuid(
+	OUT EFI_GUID  *guid,
+	IN  CHAR8     *str
+	)
+{
+	UINT8 b[16];
+	int i;
+	CHAR8* pos = str;
+	if (guid == NULL || str == NULL) return FALSE;
+	for (i = 0; i < 16; ++i) {
+		if (*pos == '-') pos++;
+		if (!AsciiHexToByte(&b[i], pos)) return FALSE;
+		pos += 2;
+	}
+	guid->Data1 = b[0] << 24 | b[1] << 16 | b[2] << 8 | b[3];
+	guid->Data2 = b[4] << 8 | b[5];
+	guid->Data3 = b[6] << 8 | b[7];
+	CopyMem(&guid->Data4, &b[8], 8);
+	return TRUE;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Print
+// Subset of PrintLib format used by DCS: %a %s %c %g %r %d %x %X %u with
+// l/ll, width and 0 flag. Attributes %H %N %E %B %V are dropped.
+//////////////////////////////////////////////////////////////////////////
+typedef struct _HOST_STATUS_NAME {
+	EFI_STATUS  Status;
+	CONST char  *Name;
+} HOST_STATUS_NAME;
+
+STATIC HOST_STATUS_NAME gHostStatusNames[] = {
+	{ EFI_SUCCESS,              "Success" },
+	{ EFI_LOAD_ERROR,           "Load Error" },
+	{ EFI_INVALID_PARAMETER,    "Invalid Parameter" },
+	{ EFI_UNSUPPORTED,          "Unsupported" },
+	{ EFI_BAD_BUFFER_SIZE,      "Bad Buffer Size" },
+	{ EFI_BUFFER_TOO_SMALL,     "Buffer Too Small" },
+	{ EFI_NOT_READY,            "Not Ready" },
+	{ EFI_DEVICE_ERROR,         "Device Error" },
+	{ EFI_WRITE_PROTECTED,      "Write Protected" },
+	{ EFI_OUT_OF_RESOURCES,     "Out of Resources" },
+	{ EFI_VOLUME_CORRUPTED,     "Volume Corrupt" },
+	{ EFI_NOT_FOUND,            "Not Found" },
+	{ EFI_ACCESS_DENIED,        "Access Denied" },
+	{ EFI_END_OF_FILE,          "End of File" },
+	{ EFI_CRC_ERROR,            "CRC Error" },
+	{ EFI_ABORTED,              "Aborted" },
+};
+
+STATIC
+VOID
+HostPrintStatus(
+	IN FILE        *out,
+	IN EFI_STATUS  status
+	)
+{
+	UINTN i;
+	for (i = 0; i < sizeof(gHostStatusNames) / sizeof(gHostStatusNames[0]); ++i) {
+		if (gHostStatusNames[i].Status == status) {
+			fputs(gHostStatusNames[i].Name, out);
+			return;
+		}
+	}
+	fprintf(out, "%llx", (unsigned long long)status);
+}
+
+EFI_STATUS
+EFIAPI
+AttrPrintEx(
+	IN INT32                Col OPTIONAL,
+	IN INT32                Row OPTIONAL,
+	IN CONST CHAR16         *Format,
+	...
+	)
+{
+	VA_LIST      args;
+	CONST CHAR16 *f = Format;
+	FILE         *out = stdout;
+	char         spec[16];
+	UINTN        n;
+	int          lcount;
+
+	VA_START(args, Format);
+	while (*f != 0) {
+		if (*f != L'%') {
+			fputc(*f < 0x80 ? (char)*f : '?', out);
+			f++;
+			continue;
+		}
+		f++;
+		n = 0;
+		spec[n++] = '%';
+		while ((*f == L'0' || (*f >= L'1' && *f <= L'9') || *f == L'-') && n < 8) {
+			spec[n++] = (char)*f++;
+		}
+		lcount = 0;
+		while (*f == L'l') {
+			lcount++;
+			f++;
+		}
+		switch (*f) {
+		case L'd':
+		case L'u':
+		case L'x':
+		case L'X':
+			spec[n++] = 'l';
+			spec[n++] = 'l';
+			spec[n++] = (char)*f;
+			spec[n] = 0;
+			if (lcount > 0) {
+				unsigned long long v = VA_ARG(args, unsigned long long);
+				fprintf(out, spec, v);
+			} else if (*f == L'd') {
+				long long v = VA_ARG(args, int);
+				fprintf(out, spec, v);
+			} else {
+				unsigned long long v = VA_ARG(args, unsigned int);
+				fprintf(out, spec, v);
+			}
+			break;
+		case L'a':
+			spec[n++] = 's';
+			spec[n] = 0;
+			fprintf(out, spec, VA_ARG(args, char*));
+			break;
+		case L's':
+		case L'S': {
+			CHAR8 *s = HostStrToAscii(VA_ARG(args, CHAR16*));
+			spec[n++] = 's';
+			spec[n] = 0;
+			fprintf(out, spec, s != NULL ? s : "");
+			MemFree(s);
+			break;
+		}
+		case L'c': {
+			int ch = VA_ARG(args, int);
+			fputc(ch < 0x80 ? ch : '?', out);
+			break;
+		}
+		case L'g': {
+			EFI_GUID *g = VA_ARG(args, EFI_GUID*);
+			fprintf(out, "%08x-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+				g->Data1, g->Data2, g->Data3,
+				g->Data4[0], g->Data4[1], g->Data4[2], g->Data4[3],
+				g->Data4[4], g->Data4[5], g->Data4[6], g->Data4[7]);
+			break;
+		}
+		case L'r':
+			HostPrintStatus(out, VA_ARG(args, EFI_STATUS));
+			break;
+		case L'E':
+			out = stderr;
+			break;
+		case L'N':
+			out = stdout;
+			break;
+		case L'H':
+		case L'B':
+		case L'V':
+			break;
+		case L'%':
+			fputc('%', out);
+			break;
+		case 0:
+			f--;
+			break;
+		default:
+			break;
+		}
+		f++;
+	}
+	VA_END(args);
+	fflush(stdout);
+	return EFI_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Input
+//////////////////////////////////////////////////////////////////////////
+VOID
+GetLine(
+	UINTN    *length,
+	CHAR16   *line,
+	CHAR8    *asciiLine,
+	UINTN    line_max,
+	UINT8    show)
+{
+	char   buf[1024];
+	UINTN  len;
+	if (fgets(buf, sizeof(buf), stdin) == NULL) buf[0] = 0;
+	buf[strcspn(buf, "\r\n")] = 0;
+	len = strlen(buf);
+	if (line_max > 0 && len > line_max - 1) len = line_max - 1;
+	buf[len] = 0;
+	if (line != NULL) HostAsciiToStr(line, buf, line_max);
+	if (asciiLine != NULL) {
+		CopyMem(asciiLine, buf, len + 1);
+	}
+	*length = len;
+}
+
+UINT8
+AskConfirm(
+	CHAR8* prompt,
+	UINT8 visible)
+{
+	CHAR16  buf[2];
+	UINTN   len = 0;
+	OUT_PRINT(L"%a", prompt);
+	if (gHostAssumeYes) {
+		OUT_PRINT(L"y\n");
+		return 1;
+	}
+	GetLine(&len, buf, NULL, sizeof(buf) / 2, visible);
+	return (buf[0] == 'y') || (buf[0] == 'Y') ? 1 : 0;
+}
+
+UINTN
+AskUINTN(
+	IN char* prompt,
+	IN UINTN def)
+{
+	CHAR8   buf[128];
+	UINTN   len = 0;
+	OUT_PRINT(L"[%lld] %a", (UINT64)def, prompt);
+	GetLine(&len, NULL, buf, sizeof(buf), 1);
+	return (len == 0) ? def : (UINTN)strtoull(buf, NULL, 10);
+}
+
+int
+AskInt(
+	CHAR8* prompt,
+	UINT8 visible)
+{
+	CHAR8   buf[32];
+	UINTN   len = 0;
+	OUT_PRINT(L"%a", prompt);
+	GetLine(&len, NULL, buf, sizeof(buf), visible);
+	return (int)strtoul(buf, NULL, 10);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Files. EFI_FILE* is FILE* of host, root is current directory
+//////////////////////////////////////////////////////////////////////////
+EFI_STATUS
+InitFS()
+{
+	return EFI_SUCCESS;
+}
+
+EFI_STATUS
+FileOpen(
+	IN    EFI_FILE*   root,
+	IN    CHAR16*     name,
+	OUT   EFI_FILE**  file,
+	IN    UINT64      mode,
+	IN    UINT64      attributes
+	)
+{
+	FILE   *f;
+	CHAR8  *path = HostStrToAscii(name);
+	if (path == NULL) return EFI_OUT_OF_RESOURCES;
+	if (mode & EFI_FILE_MODE_CREATE) {
+		f = fopen(path, "w+b");
+	} else if (mode & EFI_FILE_MODE_WRITE) {
+		f = fopen(path, "r+b");
+	} else {
+		f = fopen(path, "rb");
+	}
+	MemFree(path);
+	if (f == NULL) return EFI_NOT_FOUND;
+	*file = (EFI_FILE*)f;
+	return EFI_SUCCESS;
+}
+
+EFI_STATUS
+FileClose(
+	IN EFI_FILE* f)
+{
+	return fclose((FILE*)f) == 0 ? EFI_SUCCESS : EFI_DEVICE_ERROR;
+}
+
+EFI_STATUS
+FileDelete(
+	IN    EFI_FILE*   root,
+	IN    CHAR16*     name
+	)
+{
+	int    res;
+	CHAR8  *path = HostStrToAscii(name);
+	if (path == NULL) return EFI_OUT_OF_RESOURCES;
+	res = remove(path);
+	MemFree(path);
+	return res == 0 ? EFI_SUCCESS : EFI_NOT_FOUND;
+}
+
+EFI_STATUS
+FileWrite(
+	IN       EFI_FILE*   f,
+	IN       VOID*       data,
+	IN OUT   UINTN*      bytes,
+	IN OUT   UINT64*     position)
+{
+	if (position != NULL && fseeko((FILE*)f, (off_t)*position, SEEK_SET) != 0) {
+		return EFI_DEVICE_ERROR;
+	}
+	*bytes = fwrite(data, 1, *bytes, (FILE*)f);
+	if (position != NULL) *position += *bytes;
+	return ferror((FILE*)f) ? EFI_DEVICE_ERROR : EFI_SUCCESS;
+}
+
+EFI_STATUS
+FileLoad(
+	IN    EFI_FILE*   root,
+	IN    CHAR16*     name,
+	OUT   VOID**      data,
+	OUT   UINTN*      size
+	)
+{
+	EFI_STATUS  res;
+	EFI_FILE    *file;
+	FILE        *f;
+	long        len;
+	UINT8       *buf;
+	res = FileOpen(root, name, &file, EFI_FILE_MODE_READ, 0);
+	if (EFI_ERROR(res)) return res;
+	f = (FILE*)file;
+	fseek(f, 0, SEEK_END);
+	len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	buf = MemAlloc(len > 0 ? len : 1);
+	if (buf == NULL) {
+		fclose(f);
+		return EFI_OUT_OF_RESOURCES;
+	}
+	if (fread(buf, 1, len, f) != (size_t)len) {
+		fclose(f);
+		MemFree(buf);
+		return EFI_DEVICE_ERROR;
+	}
+	fclose(f);
+	*data = buf;
+	if (size != NULL) *size = (UINTN)len;
+	return EFI_SUCCESS;
+}
+
+EFI_STATUS
+FileSave(
+	IN    EFI_FILE*   root,
+	IN    CHAR16*     name,
+	IN    VOID*       data,
+	IN    UINTN       size
+	)
+{
+	EFI_STATUS  res;
+	EFI_FILE    *file;
+	res = FileOpen(root, name, &file, EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE, 0);
+	if (EFI_ERROR(res)) return res;
+	res = FileWrite(file, data, &size, NULL);
+	FileClose(file);
+	return res;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Block IO over disk image (or /dev/sdX). Handle is the protocol itself
+//////////////////////////////////////////////////////////////////////////
+typedef struct _HOST_DISK {
+	EFI_BLOCK_IO_PROTOCOL  BlockIo;
+	EFI_BLOCK_IO_MEDIA     Media;
+	int                    Fd;
+} HOST_DISK;
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostDiskRW(
+	IN  EFI_BLOCK_IO_PROTOCOL  *This,
+	IN  EFI_LBA                Lba,
+	IN  UINTN                  BufferSize,
+	IN  VOID                   *Buffer,
+	IN  BOOLEAN                write
+	)
+{
+	HOST_DISK  *disk = (HOST_DISK*)This;
+	off_t      pos = (off_t)(Lba * disk->Media.BlockSize);
+	ssize_t    done;
+	if (BufferSize % disk->Media.BlockSize != 0) return EFI_BAD_BUFFER_SIZE;
+	if (Lba > disk->Media.LastBlock) return EFI_INVALID_PARAMETER;
+	if (write && disk->Media.ReadOnly) return EFI_WRITE_PROTECTED;
+	while (BufferSize > 0) {
+		done = write ? pwrite(disk->Fd, Buffer, BufferSize, pos) : pread(disk->Fd, Buffer, BufferSize, pos);
+		if (done <= 0) return EFI_DEVICE_ERROR;
+		Buffer = (UINT8*)Buffer + done;
+		BufferSize -= done;
+		pos += done;
+	}
+	return EFI_SUCCESS;
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostDiskRead(
+	IN  EFI_BLOCK_IO_PROTOCOL  *This,
+	IN  UINT32                 MediaId,
+	IN  EFI_LBA                Lba,
+	IN  UINTN                  BufferSize,
+	OUT VOID                   *Buffer
+	)
+{
+	return HostDiskRW(This, Lba, BufferSize, Buffer, FALSE);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostDiskWrite(
+	IN  EFI_BLOCK_IO_PROTOCOL  *This,
+	IN  UINT32                 MediaId,
+	IN  EFI_LBA                Lba,
+	IN  UINTN                  BufferSize,
+	IN  VOID                   *Buffer
+	)
+{
+	return HostDiskRW(This, Lba, BufferSize, Buffer, TRUE);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+HostDiskFlush(
+	IN  EFI_BLOCK_IO_PROTOCOL  *This
+	)
+{
+	return fsync(((HOST_DISK*)This)->Fd) == 0 ? EFI_SUCCESS : EFI_DEVICE_ERROR;
+}
+
+EFI_STATUS
+HostDiskOpen(
+	IN  CONST CHAR8  *path,
+	IN  BOOLEAN      writable,
+	OUT EFI_HANDLE   *handle
+	)
+{
+	HOST_DISK  *disk;
+	off_t      size;
+	int        fd;
+	fd = open(path, writable ? O_RDWR : O_RDONLY);
+	if (fd < 0) return EFI_NOT_FOUND;
+	size = lseek(fd, 0, SEEK_END);
+	if (size < 512 * 3) {
+		close(fd);
+		return EFI_VOLUME_CORRUPTED;
+	}
+	disk = MemAlloc(sizeof(*disk));
+	if (disk == NULL) {
+		close(fd);
+		return EFI_OUT_OF_RESOURCES;
+	}
+	disk->Fd = fd;
+	disk->Media.MediaPresent = TRUE;
+	disk->Media.ReadOnly = !writable;
+	disk->Media.BlockSize = 512;
+	disk->Media.LastBlock = (EFI_LBA)(size / 512) - 1;
+	disk->BlockIo.Revision = EFI_BLOCK_IO_PROTOCOL_REVISION;
+	disk->BlockIo.Media = &disk->Media;
+	disk->BlockIo.ReadBlocks = HostDiskRead;
+	disk->BlockIo.WriteBlocks = HostDiskWrite;
+	disk->BlockIo.FlushBlocks = HostDiskFlush;
+	*handle = (EFI_HANDLE)disk;
+	return EFI_SUCCESS;
+}
+
+VOID
+HostDiskClose(
+	IN EFI_HANDLE  handle
+	)
+{
+	HOST_DISK  *disk = (HOST_DISK*)handle;
+	if (disk == NULL) return;
+	fsync(disk->Fd);
+	close(disk->Fd);
+	MemFree(disk);
+}
+
+EFI_STATUS
+InitBio()
+{
+	return (gBIOCount > 0) ? EFI_SUCCESS : EFI_NOT_FOUND;
+}
+
+EFI_BLOCK_IO_PROTOCOL*
+EfiGetBlockIO(
+	IN EFI_HANDLE handle
+	)
+{
+	return (EFI_BLOCK_IO_PROTOCOL*)handle;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Random is not available on host (DE_Rnd is kept as is)
+//////////////////////////////////////////////////////////////////////////
+EFI_STATUS
+RndLoad(
+	IN DCS_RND_SAVED *rndSaved,
+	OUT DCS_RND      **rndOut
+	)
+{
+	return EFI_UNSUPPORTED;
+}
+
+EFI_STATUS
+RndSave(
+	DCS_RND         *rnd,
+	DCS_RND_SAVED  **rndSaved)
+{
+	return EFI_UNSUPPORTED;
+}
@@ -0,0 +1,47 @@
+/** @file
+Host (Linux) replacement of CommonLib subset used by GptEdit.c
+
+Copyright (c) 2016. Disk Cryptography Services for EFI (DCS), Alex Kolotnikov
+
+This program and the accompanying materials
+are licensed and made available under the terms and conditions
+of the GNU Lesser General Public License, version 3.0 (LGPL-3.0).
+
+The full text of the license may be found at
+https://opensource.org/licenses/LGPL-3.0
+**/
+
+#ifndef __HOSTLIB_H__
+#define __HOSTLIB_H__
+
+#include <Uefi.h>
+#include <Protocol/BlockIo.h>
+
+//////////////////////////////////////////////////////////////////////////
+// Disk image as block device
+//////////////////////////////////////////////////////////////////////////
+EFI_STATUS
+HostDiskOpen(
+	IN  CONST CHAR8  *path,
+	IN  BOOLEAN      writable,
+	OUT EFI_HANDLE   *handle
+	);
+
+VOID
+HostDiskClose(
+	IN EFI_HANDLE  handle
+	);
+
+//////////////////////////////////////////////////////////////////////////
+// Strings
+//////////////////////////////////////////////////////////////////////////
+VOID
+HostAsciiToStr(
+	OUT CHAR16        *dst,
+	IN  CONST CHAR8   *src,
+	IN  UINTN         max
+	);
+
+extern BOOLEAN gHostAssumeYes;
+
+#endif
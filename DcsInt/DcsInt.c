@@ -109,7 +109,6 @@ SetSecRegionParamsMemory() {
 	EFI_STATUS              status = 0;
 	UINTN                   index;
 	UINT8*                  secRegion = NULL;
-	UINT32                  crc;
 	if (bootParams == NULL) return EFI_NOT_READY;
 
 	bootParams->SecRegion.Ptr = 0;
@@ -126,9 +125,8 @@ SetSecRegionParamsMemory() {
 			}
 		}
 	}
-	status = gBS->CalculateCrc32(&bootParams->SecRegion, sizeof(SECREGION_BOOT_PARAMS) - 4, &crc);
-	bootParams->SecRegion.Crc = crc;
-	return status;
+	bootParams->SecRegion.Crc = EfiCrc32(&bootParams->SecRegion, sizeof(SECREGION_BOOT_PARAMS) - 4);
+	return EFI_SUCCESS;
 }
 
 EFI_STATUS
@@ -149,7 +147,7 @@ PrepareBootParams(
 	bootArgs->DecoySystemPartitionStart = 0;
 	bootArgs->BootDriveSignature = bootDriveSignature;
 	bootArgs->Flags = (uint32)(gAuthPim << 16);
-	bootArgs->BootArgumentsCrc32 = GetCrc32((byte *)bootArgs, (int)((byte *)&bootArgs->BootArgumentsCrc32 - (byte *)bootArgs));
+	bootArgs->BootArgumentsCrc32 = EfiCrc32(bootArgs, (UINTN)((byte *)&bootArgs->BootArgumentsCrc32 - (byte *)bootArgs));
 	bootParams->BootCryptoInfo.ea = (uint16)cryptoInfo->ea;
 	bootParams->BootCryptoInfo.mode = (uint16)cryptoInfo->mode;
 	bootParams->BootCryptoInfo.pkcs5 = (uint16)cryptoInfo->pkcs5;
@@ -625,34 +623,488 @@ SelectDcsBootBySignature()
 	return EFI_NOT_FOUND;
 }
 
+DCS_HEADER_TRY          *SecRegionTries = NULL;
+
+/**
+Fill tries for all 128K slots of security region (and all PRFs for TEST ALL).
+Hinted slot and PRF (AuthHint) goes first. Returns number of tries.
+*/
+UINTN
+SecRegionTriesBuild(
+	OUT BOOLEAN  *hinted)
+{
+	DCS_AUTH_HINT   hint;
+	UINTN           slots;
+	UINTN           prfs;
+	UINTN           count = 0;
+	UINTN           slot;
+	UINTN           prf;
+
+	slots = (SecRegionSize + 1024 * 128 - 1) / (1024 * 128);
+	prfs = LAST_PRF_ID - FIRST_PRF_ID + 1;
+	if (SecRegionTries == NULL) {
+		SecRegionTries = MEM_ALLOC(sizeof(DCS_HEADER_TRY) * (slots * prfs + 1));
+		if (SecRegionTries == NULL) return 0;
+	}
+	ZeroMem(SecRegionTries, sizeof(DCS_HEADER_TRY) * (slots * prfs + 1));
+	if (gAuthHash != 0) prfs = 1;
+
+	*hinted = FALSE;
+	if (!EFI_ERROR(AuthHintLoad(&hint)) && hint.Slot < slots &&
+		(gAuthHash == 0 || hint.Prf == (UINT32)gAuthHash)) {
+		*hinted = TRUE;
+		SecRegionTries[0].Header = (char*)SecRegionData + hint.Slot * 1024 * 128;
+		SecRegionTries[0].Prf = (int)hint.Prf;
+		SecRegionTries[0].Tag = hint.Slot * 1024 * 128;
+		count++;
+	}
+
+	for (slot = 0; slot < slots; ++slot) {
+		for (prf = 0; prf < prfs; ++prf) {
+			int prfId = (gAuthHash == 0) ? (int)(FIRST_PRF_ID + prf) : gAuthHash;
+			if (*hinted && slot == hint.Slot && prfId == (int)hint.Prf) continue;
+			SecRegionTries[count].Header = (char*)SecRegionData + slot * 1024 * 128;
+			SecRegionTries[count].Prf = prfId;
+			SecRegionTries[count].Tag = slot * 1024 * 128;
+			count++;
+		}
+	}
+	return count;
+}
+
+/**
+Probe all slots at once (or take result of speculative derivation).
+Lowest slot (then PRF) that decrypts wins. Hinted try is done first alone.
+*/
+int
+SecRegionTryAllSlots()
+{
+	DCS_HEADER_TRY  *tries;
+	BOOLEAN         hinted = FALSE;
+	UINTN           count;
+	int             found;
+	int             vcres = ERR_PASSWORD_WRONG;
+
+	found = AuthSpecResult();
+	if (found == AUTH_SPEC_NONE) {
+		count = SecRegionTriesBuild(&hinted);
+		if (count == 0) return ERR_OUTOFMEMORY;
+		found = -1;
+		if (hinted) {
+			found = HeaderTryAll(gAuthBoot, &gAuthPassword, gAuthPim, gAuthTc, SecRegionTries, 1, TRUE);
+		}
+		if (found < 0) {
+			found = HeaderTryAll(gAuthBoot, &gAuthPassword, gAuthPim, gAuthTc, SecRegionTries + (hinted ? 1 : 0), count - (hinted ? 1 : 0), TRUE);
+			if (found >= 0 && hinted) found++;
+		}
+	}
+	tries = SecRegionTries;
+
+	if (found >= 0) {
+		SecRegionCryptInfo = tries[found].CryptoInfo;
+		SecRegionOffset = tries[found].Tag;
+		AuthHintSave((UINT32)(SecRegionOffset / (1024 * 128)), (UINT32)tries[found].Prf);
+		vcres = 0;
+	}	else if (tries[0].Result == ERR_OUTOFMEMORY) {
+		vcres = ERR_OUTOFMEMORY;
+	}
+	MEM_FREE(SecRegionTries);
+	SecRegionTries = NULL;
+	return vcres;
+}
+
+/**
+Register slot tries for speculative derivation during PIM/hash prompts
+*/
+VOID
+SecRegionSpeculate()
+{
+	BOOLEAN  hinted;
+	UINTN    count;
+	count = SecRegionTriesBuild(&hinted);
+	AuthSpecSet(SecRegionTries, count);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Reboot token
+//////////////////////////////////////////////////////////////////////////
+#define TOKEN_SLOT_SIZE  (1024 * 128)
+
+/**
+Try one-shot reboot token (DcsCfg -rtk). Token variable is deleted on read.
+Returns slot of token in *slot (to wipe) or -1.
+*/
+int
+SecRegionTokenTry(
+	OUT INTN *slot)
+{
+	EFI_STATUS        res;
+	DCS_REBOOT_TOKEN  token;
+	Password          pwd;
+	DCS_HEADER_TRY    try1;
+	UINTN             offset;
+	int               found = -1;
+
+	*slot = -1;
+	res = RebootTokenTake(&token);
+	if (EFI_ERROR(res)) {
+		if (res != EFI_NOT_FOUND) {
+			ERR_PRINT(L"Reboot token: %r\n", res);
+		}
+		// expired token - slot still holds header copy
+		if (res == EFI_TIMEOUT && (UINTN)token.Slot * TOKEN_SLOT_SIZE + TOKEN_SLOT_SIZE <= SecRegionSize) {
+			*slot = token.Slot;
+		}
+		burn(&token, sizeof(token));
+		return ERR_PASSWORD_WRONG;
+	}
+	offset = (UINTN)token.Slot * TOKEN_SLOT_SIZE;
+	if (offset + TOKEN_SLOT_SIZE <= SecRegionSize) {
+		*slot = token.Slot;
+		RebootTokenPassword(&token, &pwd);
+		ZeroMem(&try1, sizeof(try1));
+		try1.Header = SecRegionData + offset;
+		try1.Prf = SHA512;
+		try1.Tag = offset;
+		found = HeaderTryAll(gAuthBoot, &pwd, DCS_REBOOT_TOKEN_PIM, FALSE, &try1, 1, TRUE);
+		burn(&pwd, sizeof(pwd));
+	}
+	burn(&token, sizeof(token));
+	if (found != 0) return ERR_PASSWORD_WRONG;
+
+	SecRegionCryptInfo = try1.CryptoInfo;
+	SecRegionOffset = offset;
+	return 0;
+}
+
+/**
+Overwrite token slot with random data
+*/
+EFI_STATUS
+SecRegionTokenWipe(
+	IN UINTN slot)
+{
+	EFI_STATUS              res;
+	EFI_BLOCK_IO_PROTOCOL*  bio;
+	UINT8                   *data;
+
+	bio = EfiGetBlockIO(SecRegionHandle);
+	if (bio == NULL) return EFI_NOT_FOUND;
+	data = MEM_ALLOC(TOKEN_SLOT_SIZE);
+	if (data == NULL) return EFI_BUFFER_TOO_SMALL;
+	res = RndGetBytes(data, TOKEN_SLOT_SIZE);
+	if (EFI_ERROR(res)) {
+		res = RndHwSeed(data, TOKEN_SLOT_SIZE);
+	}
+	if (!EFI_ERROR(res)) {
+		res = bio->WriteBlocks(bio, bio->Media->MediaId, 62 + slot * (TOKEN_SLOT_SIZE / 512), TOKEN_SLOT_SIZE, data);
+	}
+	if (!EFI_ERROR(res)) {
+		// slot stays token slot for next -rtk
+		res = RebootTokenSlotSave((UINT32)slot, data);
+	}
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"Token wipe: %r\n", res);
+	}
+	MEM_FREE(data);
+	return res;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// TPM slot
+//////////////////////////////////////////////////////////////////////////
+#define TPM_SLOT_SECRET_SIZE  64
+#define TPM_SLOT_PIM          1
+#define TPM_SLOT_SIZE         (1024 * 128)
+
+CHAR8     gTpmPin[MAX_PASSWORD + 1];
+UINT32    gTpmPinLen = 0;
+BOOLEAN   gTpmMeasured = FALSE;
+
+// Free slots are random data, so owner of TpmSlot is kept aside
+#define DCS_TPM_SLOT_SIGNATURE  SIGNATURE_32('D','C','T','S')
+
+#pragma pack(1)
+typedef struct _DCS_TPM_SLOT_OWNER {
+	UINT32        Signature;
+	UINT32        Slot;
+	UINT32        HeaderCrc;  // header written by last enroll
+} DCS_TPM_SLOT_OWNER;
+#pragma pack()
+
+CHAR16*   sTpmSlotVar = L"DcsTpmSlot";
+
+/**
+Unseal secret of TpmSlot and try it as password of the slot (SHA512, PIM 1).
+DcsProp is measured to PCR 8 first.
+*/
+int
+SecRegionTpmTry()
+{
+	EFI_STATUS      res;
+	UINT8           secret[TPM_SLOT_SECRET_SIZE];
+	Password        pwd;
+	DCS_HEADER_TRY  try1;
+	INT32           code = AskPwdRetLogin;
+	int             found;
+	UINTN           offset;
+
+	if (gAuthTpmSlot < 0) return ERR_PASSWORD_WRONG;
+	offset = (UINTN)gAuthTpmSlot * TPM_SLOT_SIZE;
+	if (offset + 512 > SecRegionSize) return ERR_PASSWORD_WRONG;
+
+	if (!gTpmMeasured && ConfigBuffer != NULL) {
+		res = DcsTpmMeasure(DCS_TPM_CONFIG_PCR, ConfigBuffer, ConfigBufferSize);
+		if (EFI_ERROR(res)) {
+			ERR_PRINT(L"TPM measure: %r\n", res);
+		}
+		gTpmMeasured = TRUE;
+	}
+
+	gTpmPinLen = 0;
+	if (gAuthTpmPin) {
+		OUT_PRINT(L"TPM PIN:");
+		AskConsolePwdInt(&gTpmPinLen, gTpmPin, &code, sizeof(gTpmPin), gPasswordVisible);
+		if (code == AskPwdRetCancel) {
+			gTpmPinLen = 0;
+			return ERR_PASSWORD_WRONG;
+		}
+	}
+
+	res = DcsTpmUnseal(gAuthTpmPcrs, gTpmPin, gTpmPinLen, secret, sizeof(secret));
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"TPM unseal: %r\n", res);
+		return ERR_PASSWORD_WRONG;
+	}
+
+	ZeroMem(&pwd, sizeof(pwd));
+	pwd.Length = sizeof(secret);
+	CopyMem(pwd.Text, secret, sizeof(secret));
+	ZeroMem(&try1, sizeof(try1));
+	try1.Header = SecRegionData + offset;
+	try1.Prf = SHA512;
+	try1.Tag = offset;
+	found = HeaderTryAll(gAuthBoot, &pwd, TPM_SLOT_PIM, FALSE, &try1, 1, TRUE);
+	burn(secret, sizeof(secret));
+	burn(&pwd, sizeof(pwd));
+	if (found != 0) return try1.Result != 0 ? try1.Result : ERR_PASSWORD_WRONG;
+
+	SecRegionCryptInfo = try1.CryptoInfo;
+	SecRegionOffset = offset;
+	return 0;
+}
+
+/**
+Owner of TpmSlot. EFI_SUCCESS if slot still holds header written by TPM enroll,
+EFI_NOT_FOUND if never enrolled (or NVRAM was reset), EFI_ACCESS_DENIED if header was changed.
+*/
+EFI_STATUS
+SecRegionTpmSlotOwner(
+	IN UINTN offset)
+{
+	DCS_TPM_SLOT_OWNER  *owner = NULL;
+	UINTN               size = 0;
+	UINT32              attr;
+	BOOLEAN             owned;
+
+	if (EFI_ERROR(EfiGetVar(sTpmSlotVar, NULL, (VOID**)&owner, &size, &attr))) return EFI_NOT_FOUND;
+	owned = size == sizeof(DCS_TPM_SLOT_OWNER) &&
+		owner->Signature == DCS_TPM_SLOT_SIGNATURE &&
+		owner->Slot == (UINT32)gAuthTpmSlot &&
+		owner->HeaderCrc == EfiCrc32(SecRegionData + offset, 512);
+	MEM_FREE(owner);
+	return owned ? EFI_SUCCESS : EFI_ACCESS_DENIED;
+}
+
+/**
+Copy slot opened by password to TpmSlot under new random secret and seal the secret to TPM.
+Secret is sealed first, slot is written only after successful seal.
+Slot without owner record is overwritten only if user confirms it is free.
+*/
+EFI_STATUS
+SecRegionTpmEnroll()
+{
+	EFI_STATUS              res;
+	EFI_BLOCK_IO_PROTOCOL*  bio = NULL;
+	PCRYPTO_INFO            cryptoInfo, ci = NULL;
+	UINT8                   secret[TPM_SLOT_SECRET_SIZE];
+	Password                pwd;
+	UINT8                   *slot = NULL;
+	UINTN                   offset;
+	INT32                   vcres;
+	DCS_TPM_SLOT_OWNER      owner;
+
+	if (gAuthTpmSlot < 0) return EFI_NOT_READY;
+	offset = (UINTN)gAuthTpmSlot * TPM_SLOT_SIZE;
+	if (gAuthTpmPin && gTpmPinLen == 0) {
+		res = EFI_NOT_READY;
+		goto error;
+	}
+
+	// No TPM - nothing to pay for (PBKDF2, disk write)
+	res = DcsTpmSealReady(gAuthTpmPcrs);
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"TPM seal: %r\n", res);
+		goto error;
+	}
+	if (offset + TPM_SLOT_SIZE > SecRegionSize || offset == SecRegionOffset) {
+		ERR_PRINT(L"TPM slot %d is not usable\n", gAuthTpmSlot);
+		res = EFI_ACCESS_DENIED;
+		goto error;
+	}
+	res = SecRegionTpmSlotOwner(offset);
+	if (res == EFI_NOT_FOUND) {
+		// Free slots and headers of other passwords look the same
+		OUT_PRINT(L"TPM slot %d is not enrolled. It is overwritten and has to be free.\n", gAuthTpmSlot);
+		if (!AskConfirm("Enroll TPM slot [N]?", 1)) {
+			res = EFI_ABORTED;
+			goto error;
+		}
+		res = EFI_SUCCESS;
+	}
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"TPM slot %d is not TPM slot\n", gAuthTpmSlot);
+		goto error;
+	}
+
+	res = RndPreapare();
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"Rnd: %r\n", res);
+		goto error;
+	}
+	bio = EfiGetBlockIO(SecRegionHandle);
+	if (bio == NULL) {
+		ERR_PRINT(L"Block io not supported\n,");
+		res = EFI_NOT_FOUND;
+		goto error;
+	}
+	slot = MEM_ALLOC(TPM_SLOT_SIZE);
+	if (slot == NULL) {
+		res = EFI_BUFFER_TOO_SMALL;
+		goto error;
+	}
+
+	// Data units of slot are encrypted by master key, only header is changed
+	res = bio->ReadBlocks(bio, bio->Media->MediaId, 62 + SecRegionOffset / 512, TPM_SLOT_SIZE, slot);
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"Read: %r\n", res);
+		goto error;
+	}
+	res = RndGetBytes(secret, sizeof(secret));
+	if (EFI_ERROR(res)) goto error;
+
+	ZeroMem(&pwd, sizeof(pwd));
+	pwd.Length = sizeof(secret);
+	CopyMem(pwd.Text, secret, sizeof(secret));
+	cryptoInfo = SecRegionCryptInfo;
+	vcres = CreateVolumeHeaderInMemory(
+		gAuthBoot, (char*)slot,
+		cryptoInfo->ea,
+		cryptoInfo->mode,
+		&pwd,
+		SHA512,
+		TPM_SLOT_PIM,
+		cryptoInfo->master_keydata,
+		&ci,
+		cryptoInfo->VolumeSize.Value,
+		0,
+		cryptoInfo->EncryptedAreaStart.Value,
+		cryptoInfo->EncryptedAreaLength.Value,
+		cryptoInfo->RequiredProgramVersion,
+		cryptoInfo->HeaderFlags,
+		cryptoInfo->SectorSize,
+		FALSE);
+	burn(&pwd, sizeof(pwd));
+	if (ci != NULL) crypto_close(ci);
+	if (vcres != 0) {
+		ERR_PRINT(L"header create error(%x)\n", vcres);
+		res = EFI_INVALID_PARAMETER;
+		goto error;
+	}
+
+	res = DcsTpmSeal(gAuthTpmPcrs, gTpmPin, gTpmPinLen, secret, sizeof(secret));
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"TPM seal: %r\n", res);
+		goto error;
+	}
+
+	res = bio->WriteBlocks(bio, bio->Media->MediaId, 62 + offset / 512, TPM_SLOT_SIZE, slot);
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"Write: %r\n", res);
+		// sealed secret opens nothing
+		DcsTpmClear();
+		goto error;
+	}
+	CopyMem(SecRegionData + offset, slot, 512);
+
+	owner.Signature = DCS_TPM_SLOT_SIGNATURE;
+	owner.Slot = (UINT32)gAuthTpmSlot;
+	owner.HeaderCrc = EfiCrc32(slot, 512);
+	res = EfiSetVar(sTpmSlotVar, NULL, &owner, sizeof(owner), EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS);
+	if (EFI_ERROR(res)) {
+		ERR_PRINT(L"TPM slot owner: %r\n", res);
+		goto error;
+	}
+	OUT_PRINT(L"TPM slot %d sealed\n", gAuthTpmSlot);
+
+error:
+	burn(secret, sizeof(secret));
+	burn(gTpmPin, sizeof(gTpmPin));
+	gTpmPinLen = 0;
+	MEM_FREE(slot);
+	return res;
+}
+
 EFI_STATUS
 SecRegionTryDecrypt() 
 {
 	int          vcres = 1;
 	EFI_STATUS   res = EFI_SUCCESS;
+	BOOLEAN      tpmUnlock = FALSE;
+	INTN         tokenSlot;
 
 	PlatformGetID(SecRegionHandle, &gPlatformKeyFile, &gPlatformKeyFileSize);
 
-	do {
+	vcres = SecRegionTokenTry(&tokenSlot);
+	if (vcres == 0) {
+		OUT_PRINT(L"Reboot token unlock\n");
+	}	else {
+		if (tokenSlot >= 0) {
+			SecRegionTokenWipe(tokenSlot);
+			tokenSlot = -1;
+		}
+		tpmUnlock = (SecRegionTpmTry() == 0);
+		if (tpmUnlock) {
+			vcres = 0;
+			OUT_PRINT(L"TPM unlock\n");
+		}
+	}
+	if (vcres == 0) {
+		CopyMem(Header, SecRegionData + SecRegionOffset, 512);
+	}
+
+	while (vcres != 0) {
 		SecRegionOffset = 0;
+		SecRegionSpeculate();
 		VCAuthAsk();
 		if (gAuthPwdCode == AskPwdRetCancel) {
+			AuthSpecResult();
+			MEM_FREE(SecRegionTries);
+			SecRegionTries = NULL;
 			return EFI_NOT_READY;
 		}
 		OUT_PRINT(L"Authorizing...\n\r");
-		do {
-			CopyMem(Header, SecRegionData + SecRegionOffset, 512);
-			vcres = ReadVolumeHeader(gAuthBoot, Header, &gAuthPassword, gAuthHash, gAuthPim, gAuthTc, &SecRegionCryptInfo, NULL);
-		   SecRegionOffset += (vcres != 0) ? 1024 * 128 : 0;
-		} while (SecRegionOffset < SecRegionSize && vcres != 0);
+		vcres = SecRegionTryAllSlots();
 		if (vcres == 0) {
+			CopyMem(Header, SecRegionData + SecRegionOffset, 512);
 			OUT_PRINT(L"Success\n");
 			OUT_PRINT(L"start %lld len %lld\n", SecRegionCryptInfo->EncryptedAreaStart.Value, SecRegionCryptInfo->EncryptedAreaLength.Value);
 			break;
 		}	else {
 			ERR_PRINT(L"Authorization failed. Wrong password, PIM or hash. Decrypt error(%x)\n\r", vcres);
 		}
-	} while (vcres != 0 && gAuthRetry != 0);
+		if (gAuthRetry == 0) break;
+	}
 	if (vcres != 0) {
 		return EFI_CRC_ERROR;
 	}
@@ -735,7 +1187,17 @@ SecRegionTryDecrypt()
 			ERR_PRINT(L"Random: %r\n", res);
 		}
 	}
-	gHeaderSaltCrc32 = GetCrc32(SecRegionData + SecRegionOffset, PKCS5_SALT_SIZE);	
+
+	// Password opened other slot - (re)seal TPM slot to current PCRs
+	if (!tpmUnlock && tokenSlot < 0 && gAuthTpmSlot >= 0) {
+		SecRegionTpmEnroll();
+	}
+
+	// Reboot token is used once
+	if (tokenSlot >= 0) {
+		SecRegionTokenWipe(tokenSlot);
+	}
+	gHeaderSaltCrc32 = EfiCrc32(SecRegionData + SecRegionOffset, PKCS5_SALT_SIZE);	
 	return EFI_SUCCESS;
 }
 
@@ -969,7 +1431,7 @@ UefiMain(
 			res = UsbGetId(gUSBHandles[i], &id);
 			if (!EFI_ERROR(res) && id != NULL) {
 				INT32		rud;
-				rud = GetCrc32((unsigned char*)id, (int)AsciiStrLen(id));
+				rud = EfiCrc32(id, AsciiStrLen(id));
 				MEM_FREE(id);
 				if (rud == gRUD) {
 					devFound = TRUE;
@@ -205,6 +205,12 @@ KeyWait(
 EFI_INPUT_KEY
 GetKey(void);
 
+extern UINT64 gKeyStrokeTimes[8];
+extern UINTN  gKeyStrokeCount;
+
+VOID
+KeyStrokeTimeAdd();
+
 VOID
 ConsoleShowTip(
 	IN CHAR16* tip,
@@ -218,6 +224,9 @@ GetLine(
    UINTN    line_max,
    UINT8    show);
 
+extern CHAR16*  gConsoleAnswers;
+extern BOOLEAN  gConsoleNoInput;
+
 int
 AskAsciiString(
    CHAR8* prompt,
@@ -519,6 +528,43 @@ FileCopy(
 	IN    UINTN       bufSz
 	);
 
+//////////////////////////////////////////////////////////////////////////
+// CRC32
+//////////////////////////////////////////////////////////////////////////
+
+UINT32
+EfiCrc32Update(
+   IN UINT32      crc,
+   IN CONST VOID  *data,
+   IN UINTN       len
+   );
+
+UINT32
+EfiCrc32(
+   IN CONST VOID  *data,
+   IN UINTN       len
+   );
+
+//////////////////////////////////////////////////////////////////////////
+// Time stamp
+//////////////////////////////////////////////////////////////////////////
+
+extern UINT64 gTscTicksPerUs;
+
+EFI_STATUS
+EfiTscCalibrate();
+
+UINT64
+EfiTimeStampUs();
+
+UINT64
+EfiTimeToSeconds(
+   IN EFI_TIME *time
+   );
+
+UINT64
+EfiTimeNowSeconds();
+
 //////////////////////////////////////////////////////////////////////////
 // Exec
 //////////////////////////////////////////////////////////////////////////
@@ -65,7 +65,7 @@ DeListZero();
 VOID
 DeListPrint();
 
-VOID
+EFI_STATUS
 DeListSaveToFile();
 
 EFI_STATUS
@@ -90,7 +90,7 @@ GptLoadFromDisk(
 	IN UINTN   diskIdx
 	);
 
-VOID
+EFI_STATUS
 GptHideParts();
 
 VOID
@@ -174,12 +174,19 @@ typedef struct _DCS_RND_SAVED {
 #pragma pack()
 static_assert(sizeof(DCS_RND_SAVED) == 512, "Wrong size DCS_RND_SAVED");
 
+// HMAC DRBG output generated ahead, small requests are served from it
+#define RND_POOL_SIZE        4096
+// Generate calls between reseeds with hardware entropy (SP 800-90A allows 2^48)
+#define RND_RESEED_INTERVAL  1024
+
 typedef struct _DCS_RND {
 	DCS_RND_PREPARE    Prepare;
 	DCS_RND_GET_BYTES  GetBytes;
 	UINT32				Type;
 	UINT32				Pad;
 	DCS_RND_STATE		State;
+	UINTN              PoolPos;    // first unused byte of Pool
+	UINT8              Pool[RND_POOL_SIZE];
 } DCS_RND;
 
 EFI_STATUS
@@ -209,5 +216,74 @@ RndGetBytes(UINT8 *buf, UINTN len);
 EFI_STATUS
 RndPreapare();
 
+EFI_STATUS
+RndHwSeed(
+	OUT UINT8 *buf,
+	IN  UINTN len
+	);
+
+// Fast random stream (AES-CTR keyed from gRnd) for wipe
+typedef struct _RND_STREAM {
+	UINT8  *Ks;
+	UINT64 Nonce;
+	UINT64 Counter;
+} RND_STREAM;
+
+EFI_STATUS
+RndStreamInit(
+	OUT RND_STREAM *stream
+	);
+
+EFI_STATUS
+RndStreamGetBytes(
+	IN OUT RND_STREAM *stream,
+	OUT    UINT8      *buf,
+	IN     UINTN      len
+	);
+
+VOID
+RndStreamClose(
+	IN OUT RND_STREAM *stream
+	);
+
+//////////////////////////////////////////////////////////////////////////
+// TPM 2.0 sealed secret
+//////////////////////////////////////////////////////////////////////////
+#define DCS_TPM_NV_INDEX    0x01800DC5
+#define DCS_TPM_CONFIG_PCR  8
+
+EFI_STATUS
+DcsTpmMeasure(
+	IN UINT32  pcr,
+	IN VOID    *data,
+	IN UINTN   size
+	);
+
+EFI_STATUS
+DcsTpmSealReady(
+	IN UINT32  pcrMask
+	);
+
+EFI_STATUS
+DcsTpmSeal(
+	IN UINT32  pcrMask,
+	IN UINT8   *pin,
+	IN UINTN   pinLen,
+	IN UINT8   *secret,
+	IN UINTN   secretLen
+	);
+
+EFI_STATUS
+DcsTpmUnseal(
+	IN  UINT32  pcrMask,
+	IN  UINT8   *pin,
+	IN  UINTN   pinLen,
+	OUT UINT8   *secret,
+	IN  UINTN   secretLen
+	);
+
+EFI_STATUS
+DcsTpmClear();
+
 #endif
 
@@ -48,15 +48,21 @@ typedef struct _RECT {
 	UINT32 bottom;
 } RECT, *PRECT;
 
+#define BLT_DIRTY_MAX          8
+#define BLT_DIRTY_MERGE_WASTE  (64 * 64)   // pixels worth one extra GOP Blt
+
 #pragma pack(1)
 typedef struct {
 	UINT32   Width;
 	UINT32   Height;
-	RECT     Dirty;
+	UINT32   DirtyCount;
+	RECT     Dirty[BLT_DIRTY_MAX];  // inclusive, updated by ScreenUpdateDirty
 	EFI_GRAPHICS_OUTPUT_BLT_PIXEL	 Pixels[0];
 } BLT_HEADER;
 #pragma pack()
 
+#define BLT_SIZE(blt) (sizeof(BLT_HEADER) + (UINTN)(blt)->Width * (blt)->Height * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL))
+
 enum DRAW_OPERATION {
 	DrawOpSet = 0,
 	DrawOpOr,
@@ -127,6 +133,15 @@ RectMarkDirty(
 	IN UINTN y
 	);
 
+VOID
+BltMarkDirty(
+	IN OUT BLT_HEADER* blt,
+	IN INT32 x0,
+	IN INT32 y0,
+	IN INT32 x1,
+	IN INT32 y1
+	);
+
 EFI_STATUS
 BltPoint(
 	IN BLT_HEADER* blt,
@@ -135,6 +150,24 @@ BltPoint(
 	IN UINTN y
 	);
 
+VOID
+BltHSpan(
+	IN BLT_HEADER* blt,
+	IN PDRAW_CONTEXT draw,
+	IN INT32 x0,
+	IN INT32 x1,
+	IN INT32 y
+	);
+
+VOID
+BltVSpan(
+	IN BLT_HEADER* blt,
+	IN PDRAW_CONTEXT draw,
+	IN INT32 x,
+	IN INT32 y0,
+	IN INT32 y1
+	);
+
 VOID
 BltLine(
 	IN BLT_HEADER* blt,
@@ -171,6 +204,17 @@ BltText(
 	IN INT32 scale, // 0..256 reduce 256... enlarge
 	IN CONST CHAR8 *text);
 
+/**
+Load bitmap font (BMP, 95 cells ASCII 32..126 in one row).
+NULL - back to vector font
+*/
+EFI_STATUS
+BltFontLoad(
+	IN CHAR16* fileName);
+
+VOID
+BltTextCacheClear();
+
 
 EFI_STATUS
 BmpGetSize(
@@ -18,6 +18,7 @@ https://opensource.org/licenses/LGPL-3.0
 #include <Protocol/GraphicsOutput.h>
 
 extern CHAR16*	gPasswordPictureFileName;
+extern CHAR16*	gPasswordFontFileName;
 
 extern CHAR8*	gPasswordPictureChars;
 extern CHAR8*	gPasswordPictureCharsDefault;
@@ -13,6 +13,7 @@ https://opensource.org/licenses/LGPL-3.0
 
 #include <Library/CommonLib.h>
 #include <Library/UefiBootServicesTableLib.h>
+#include <Library/BaseLib.h>
 #include <Library/BaseMemoryLib.h>
 #include <Library/PrintLib.h>
 #include <Protocol/SimpleTextOut.h>
@@ -75,6 +76,7 @@ KeyWait(
 			if (EFI_ERROR(gST->ConIn->ReadKeyStroke(gST->ConIn, &key))) {
 				continue;
 			}
+			KeyStrokeTimeAdd();
          break;
       }
       else {
@@ -86,7 +88,22 @@ KeyWait(
    return key;
 }
 
-EFI_INPUT_KEY 
+//////////////////////////////////////////////////////////////////////////
+// Key strokes timing (entropy source for random seed)
+// Only time stamps are saved, not keys.
+//////////////////////////////////////////////////////////////////////////
+UINT64 gKeyStrokeTimes[8];
+UINTN  gKeyStrokeCount = 0;
+
+VOID
+KeyStrokeTimeAdd()
+{
+	UINTN idx = gKeyStrokeCount & 7;
+	gKeyStrokeTimes[idx] = LRotU64(gKeyStrokeTimes[idx], 13) ^ AsmReadTsc();
+	gKeyStrokeCount++;
+}
+
+EFI_INPUT_KEY
 GetKey(void) 
 {
    EFI_INPUT_KEY key;
@@ -97,6 +114,7 @@ GetKey(void)
 		res1 = gBS->WaitForEvent(1, &gST->ConIn->WaitForKey, &EventIndex);
 		res2 = gST->ConIn->ReadKeyStroke(gST->ConIn, &key);
 	} while (EFI_ERROR(res1) || EFI_ERROR(res2));
+	KeyStrokeTimeAdd();
    return key;
 }
 
@@ -127,7 +145,49 @@ ConsoleShowTip(
 }
 
 
-VOID 
+//////////////////////////////////////////////////////////////////////////
+// Scripted input
+// Visible answers are taken from gConsoleAnswers (';' separated) instead 
+// of keyboard. With gConsoleNoInput the rest answers are empty (defaults).
+// Hidden input (passwords, PIM) is always read from keyboard.
+//////////////////////////////////////////////////////////////////////////
+CHAR16*  gConsoleAnswers = NULL;
+BOOLEAN  gConsoleNoInput = FALSE;
+
+VOID
+GetLineScripted(
+   UINTN    *length,
+   CHAR16   *line,
+   CHAR8    *asciiLine,
+   UINTN    line_max)
+{
+   UINTN count = 0;
+   if (gConsoleAnswers != NULL) {
+      while (*gConsoleAnswers != 0 && *gConsoleAnswers != L';') {
+         if (count < line_max - 1) {
+            if (line != NULL) line[count] = *gConsoleAnswers;
+            if (asciiLine != NULL) asciiLine[count] = (CHAR8)*gConsoleAnswers;
+            count++;
+         }
+         gConsoleAnswers++;
+      }
+      if (*gConsoleAnswers == L';') {
+         gConsoleAnswers++;
+      } else {
+         gConsoleAnswers = NULL;
+      }
+   }
+   if (line != NULL) line[count] = '\0';
+   if (asciiLine != NULL) asciiLine[count] = '\0';
+   if (line != NULL) {
+      OUT_PRINT(L"%s\n", line);
+   } else if (asciiLine != NULL) {
+      OUT_PRINT(L"%a\n", asciiLine);
+   }
+   if (length != NULL) *length = count;
+}
+
+VOID
 GetLine (
    UINTN    *length, 
    CHAR16   *line, 
@@ -138,6 +198,11 @@ GetLine (
    EFI_INPUT_KEY key;
    UINT32 count = 0;
 
+   if (show && (gConsoleAnswers != NULL || gConsoleNoInput)) {
+      GetLineScripted(length, line, asciiLine, line_max);
+      return;
+   }
+
    do {
       key = GetKey();
 		// Remove dirty chars 0.1s
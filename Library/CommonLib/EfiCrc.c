@@ -0,0 +1,91 @@
+/** @file
+CRC32 (IEEE 802.3, reflected) slicing-by-8
+
+Copyright (c) 2016. Disk Cryptography Services for EFI (DCS), Alex Kolotnikov
+Copyright (c) 2016. VeraCrypt, Mounir IDRASSI 
+
+This program and the accompanying materials are licensed and made available
+under the terms and conditions of the GNU Lesser General Public License, version 3.0 (LGPL-3.0).
+
+The full text of the license may be found at
+https://opensource.org/licenses/LGPL-3.0
+**/
+
+#include <Library/CommonLib.h>
+
+//////////////////////////////////////////////////////////////////////////
+// CRC32
+// Same value as gBS->CalculateCrc32 and VeraCrypt GetCrc32. Tables are 
+// built on first use, 8 bytes are processed per step.
+//////////////////////////////////////////////////////////////////////////
+#define CRC32_POLY 0xEDB88320
+
+UINT32   gCrc32Table[8][256];
+BOOLEAN  gCrc32TableReady = FALSE;
+
+VOID
+EfiCrc32TableInit()
+{
+   UINT32   crc;
+   UINTN    i, k;
+   for (i = 0; i < 256; ++i) {
+      crc = (UINT32)i;
+      for (k = 0; k < 8; ++k) {
+         crc = (crc & 1) ? (crc >> 1) ^ CRC32_POLY : (crc >> 1);
+      }
+      gCrc32Table[0][i] = crc;
+   }
+   for (i = 0; i < 256; ++i) {
+      crc = gCrc32Table[0][i];
+      for (k = 1; k < 8; ++k) {
+         crc = gCrc32Table[0][crc & 0xFF] ^ (crc >> 8);
+         gCrc32Table[k][i] = crc;
+      }
+   }
+   gCrc32TableReady = TRUE;
+}
+
+/**
+Continue CRC32 of data. Start with crc = 0, result of previous call continues
+*/
+UINT32
+EfiCrc32Update(
+   IN UINT32      crc,
+   IN CONST VOID  *data,
+   IN UINTN       len
+   )
+{
+   CONST UINT8  *pos = (CONST UINT8*)data;
+   UINT32       lo, hi;
+
+   if (!gCrc32TableReady) EfiCrc32TableInit();
+   crc = ~crc;
+   while (len > 0 && ((UINTN)pos & 7) != 0) {
+      crc = gCrc32Table[0][(crc ^ *pos++) & 0xFF] ^ (crc >> 8);
+      len--;
+   }
+   while (len >= 8) {
+      lo = *(CONST UINT32*)pos ^ crc;
+      hi = *(CONST UINT32*)(pos + 4);
+      crc = gCrc32Table[7][lo & 0xFF] ^ gCrc32Table[6][(lo >> 8) & 0xFF] ^
+            gCrc32Table[5][(lo >> 16) & 0xFF] ^ gCrc32Table[4][lo >> 24] ^
+            gCrc32Table[3][hi & 0xFF] ^ gCrc32Table[2][(hi >> 8) & 0xFF] ^
+            gCrc32Table[1][(hi >> 16) & 0xFF] ^ gCrc32Table[0][hi >> 24];
+      pos += 8;
+      len -= 8;
+   }
+   while (len > 0) {
+      crc = gCrc32Table[0][(crc ^ *pos++) & 0xFF] ^ (crc >> 8);
+      len--;
+   }
+   return ~crc;
+}
+
+UINT32
+EfiCrc32(
+   IN CONST VOID  *data,
+   IN UINTN       len
+   )
+{
+   return EfiCrc32Update(0, data, len);
+}
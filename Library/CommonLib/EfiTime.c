@@ -0,0 +1,95 @@
+/** @file
+EFI time stamp helpers
+
+Copyright (c) 2016. Disk Cryptography Services for EFI (DCS), Alex Kolotnikov
+Copyright (c) 2016. VeraCrypt, Mounir IDRASSI 
+
+This program and the accompanying materials are licensed and made available
+under the terms and conditions of the GNU Lesser General Public License, version 3.0 (LGPL-3.0).
+
+The full text of the license may be found at
+https://opensource.org/licenses/LGPL-3.0
+**/
+
+#include <Library/CommonLib.h>
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/UefiRuntimeServicesTableLib.h>
+
+//////////////////////////////////////////////////////////////////////////
+// Time stamp
+// TSC is calibrated once against gBS->Stall. RTC (1 second resolution) is 
+// used if TSC does not run.
+//////////////////////////////////////////////////////////////////////////
+#define TSC_CALIBRATE_US 50000
+
+UINT64   gTscTicksPerUs = 0;
+BOOLEAN  gTscCalibrated = FALSE;
+
+EFI_STATUS
+EfiTscCalibrate() 
+{
+   UINT64   tsc0;
+   UINT64   tsc1;
+   gTscCalibrated = TRUE;
+   tsc0 = AsmReadTsc();
+   gBS->Stall(TSC_CALIBRATE_US);
+   tsc1 = AsmReadTsc();
+   if (tsc1 <= tsc0 + TSC_CALIBRATE_US) {
+      gTscTicksPerUs = 0;
+      return EFI_UNSUPPORTED;
+   }
+   gTscTicksPerUs = DivU64x32(tsc1 - tsc0, TSC_CALIBRATE_US);
+   return EFI_SUCCESS;
+}
+
+UINT64
+EfiTimeStampUs()
+{
+   EFI_STATUS  res;
+   EFI_TIME    time;
+   if (!gTscCalibrated) {
+      EfiTscCalibrate();
+   }
+   if (gTscTicksPerUs != 0) {
+      return DivU64x64Remainder(AsmReadTsc(), gTscTicksPerUs, NULL);
+   }
+   res = gRT->GetTime(&time, NULL);
+   if (EFI_ERROR(res)) return 0;
+   return MultU64x32(EfiTimeToSeconds(&time), 1000000);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Calendar time
+//////////////////////////////////////////////////////////////////////////
+
+/**
+Seconds since 1970-01-01 (TimeZone is ignored - RTC time)
+*/
+UINT64
+EfiTimeToSeconds(
+   IN EFI_TIME *time
+   )
+{
+   UINT32   y = time->Year;
+   UINT32   m = time->Month;
+   UINT32   era, yoe, doy, doe, days;
+   if (y < 1970) return 0;
+   if (m <= 2) y--;
+   era = y / 400;
+   yoe = y - era * 400;
+   doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + time->Day - 1;
+   doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+   days = era * 146097 + doe - 719468;
+   return MultU64x32(days, 24 * 60 * 60) + time->Hour * 60 * 60 + time->Minute * 60 + time->Second;
+}
+
+UINT64
+EfiTimeNowSeconds()
+{
+   EFI_TIME    time;
+   if (EFI_ERROR(gRT->GetTime(&time, NULL))) return 0;
+   return EfiTimeToSeconds(&time);
+}
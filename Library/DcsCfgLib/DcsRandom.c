@@ -15,11 +15,13 @@ https://opensource.org/licenses/LGPL-3.0
 
 #include <Uefi.h>
 #include <Library/UefiBootServicesTableLib.h>
+#include <Library/BaseLib.h>
 #include <Library/CommonLib.h>
 #include <Library/RngLib.h>
 #include <Library/DcsCfgLib.h>
 
 #include <common/Pkcs5.h>
+#include <common/Crypto.h>
 #include <crypto/sha2.h>
 
 DCS_RND* gRnd = NULL;
@@ -78,19 +80,122 @@ RndFileInit(
 	return res;
 }
 
+//////////////////////////////////////////////////////////////////////////
+// Hardware random health tests (NIST SP 800-90B 4.4)
+// Repetition count: any repeated 64 bit sample is failure.
+// Adaptive proportion: bytes in window of 512, cutoff 62 (H = 4 bits/byte, alpha = 2^-20).
+// Failure is latched until RndHealthReset.
+//////////////////////////////////////////////////////////////////////////
+#define RND_HEALTH_APT_WINDOW  512
+#define RND_HEALTH_APT_CUTOFF  62
+#define RND_HEALTH_STARTUP     128
+
+typedef struct _RND_HEALTH {
+	UINT64   Last;
+	BOOLEAN  HasLast;
+	BOOLEAN  Failed;
+	UINT8    AptFirst;
+	UINT32   AptCount;
+	UINT32   AptSamples;
+} RND_HEALTH;
+
+// RDRAND generator (reset by its startup test) and hardware seed
+RND_HEALTH gRndHealth;
+RND_HEALTH gRndSeedHealth;
+
+VOID
+RndHealthReset(
+	OUT RND_HEALTH *health
+	)
+{
+	ZeroMem(health, sizeof(RND_HEALTH));
+}
+
+BOOLEAN
+RndHealthTest(
+	IN OUT RND_HEALTH *health,
+	IN     UINT64     sample
+	)
+{
+	UINTN i;
+	UINT8 b;
+	if (health->Failed) return FALSE;
+	if (health->HasLast && health->Last == sample) {
+		health->Failed = TRUE;
+		return FALSE;
+	}
+	health->Last = sample;
+	health->HasLast = TRUE;
+	for (i = 0; i < 8; ++i) {
+		b = (UINT8)(sample >> (i * 8));
+		if (health->AptSamples == 0) {
+			health->AptFirst = b;
+			health->AptCount = 0;
+		}
+		if (b == health->AptFirst) {
+			health->AptCount++;
+			if (health->AptCount >= RND_HEALTH_APT_CUTOFF) {
+				health->Failed = TRUE;
+				return FALSE;
+			}
+		}
+		health->AptSamples++;
+		if (health->AptSamples >= RND_HEALTH_APT_WINDOW) {
+			health->AptSamples = 0;
+		}
+	}
+	return TRUE;
+}
+
 //////////////////////////////////////////////////////////////////////////
 // Random data from CPU RDRAND
+// RngLib does not check CPUID (RDRAND is #UD on older CPUs)
 //////////////////////////////////////////////////////////////////////////
+#define CPUID_RDRAND          BIT30
+
+BOOLEAN  gRndRDRandChecked = FALSE;
+BOOLEAN  gRndRDRandSupported = FALSE;
+
+BOOLEAN
+RndRDRandSupported()
+{
+	if (!gRndRDRandChecked) {
+#if defined(MDE_CPU_X64) || defined(MDE_CPU_IA32)
+		UINT32 ecx = 0;
+		AsmCpuid(1, NULL, NULL, &ecx, NULL);
+		gRndRDRandSupported = (ecx & CPUID_RDRAND) != 0;
+#else
+		gRndRDRandSupported = TRUE;
+#endif
+		gRndRDRandChecked = TRUE;
+	}
+	return gRndRDRandSupported;
+}
+
+BOOLEAN
+RndRDRand64(
+	IN OUT RND_HEALTH *health,
+	OUT    UINT64     *rnd64
+	)
+{
+	if (!RndRDRandSupported()) return FALSE;
+	return GetRandomNumber64(rnd64) && RndHealthTest(health, *rnd64);
+}
+
 EFI_STATUS
 RndRDRandPrepare(
 	IN DCS_RND* rnd
 	)
 {
 	UINT64 rndTmp;
+	UINTN  i;
 	if (rnd != NULL && rnd->Type == RndTypeRDRand) {
-		if (GetRandomNumber64((UINT64*)&rndTmp)) {
-			return EFI_SUCCESS;
+		// Startup test
+		RndHealthReset(&gRndHealth);
+		for (i = 0; i < RND_HEALTH_STARTUP; ++i) {
+			if (!RndRDRand64(&gRndHealth, &rndTmp)) return EFI_NOT_READY;
 		}
+		return EFI_SUCCESS;
 	}
 	return EFI_NOT_READY;
 }
@@ -101,20 +206,21 @@ RndRDRandGetBytes(
 	OUT UINT8   *buf,
 	IN  UINTN    len)
 {
-	UINT8 tmpRnd[8];
-	UINTN i = 0;
-	UINTN j = 0;
-	if (rnd != NULL && rnd->Type == RndTypeRDRand) {
-		for (i = 0; i < len; ++i, ++j) {
-			j &= 7;
-			if (j == 0) {
-				if (!GetRandomNumber64((UINT64*)tmpRnd)) return EFI_NOT_READY;
-			}
-			buf[i] = tmpRnd[j];
-		}
-	}	else {
+	UINT64 tmpRnd;
+	if (rnd == NULL || rnd->Type != RndTypeRDRand) {
 		return EFI_NOT_READY;
 	}
+	while (len >= sizeof(UINT64)) {
+		if (!RndRDRand64(&gRndHealth, &tmpRnd)) return EFI_DEVICE_ERROR;
+		WriteUnaligned64((UINT64*)buf, tmpRnd);
+		buf += sizeof(UINT64);
+		len -= sizeof(UINT64);
+	}
+	if (len > 0) {
+		if (!RndRDRand64(&gRndHealth, &tmpRnd)) return EFI_DEVICE_ERROR;
+		CopyMem(buf, &tmpRnd, len);
+	}
+	tmpRnd = 0;
 	return EFI_SUCCESS;
 }
 
@@ -132,68 +238,231 @@ RndRDRandInit(
 }
 
 //////////////////////////////////////////////////////////////////////////
-// DRBG HMAC (SHA512) (NIST SP 800-90A) (simplified)
+// Seed for DRBG
+// RDSEED (if supported), else RDRAND, both with health tests.
+// If hardware is absent or failed - timing jitter and key strokes timing.
 //////////////////////////////////////////////////////////////////////////
+#if defined(MDE_CPU_X64) || defined(MDE_CPU_IA32)
+BOOLEAN
+EFIAPI
+RdSeed64Step(
+	OUT UINT64 *Rand
+	);
+#define RND_RDSEED_RETRY      100
+#define RND_JITTER_SAMPLES    256
+#define CPUID_RDSEED          BIT18
+
+BOOLEAN
+RndRDSeedSupported()
+{
+	UINT32 ebx = 0;
+	UINT32 maxLeaf;
+	AsmCpuid(0, &maxLeaf, NULL, NULL, NULL);
+	if (maxLeaf < 7) return FALSE;
+	AsmCpuidEx(7, 0, NULL, &ebx, NULL, NULL);
+	return (ebx & CPUID_RDSEED) != 0;
+}
+
+BOOLEAN
+RndRDSeed64(
+	IN OUT RND_HEALTH *health,
+	OUT    UINT64     *rnd64
+	)
+{
+	UINTN i;
+	for (i = 0; i < RND_RDSEED_RETRY; ++i) {
+		if (RdSeed64Step(rnd64)) {
+			return RndHealthTest(health, *rnd64);
+		}
+		CpuPause();
+	}
+	return FALSE;
+}
+#endif
+
 EFI_STATUS
-HmacSha512(
-	IN  UINT8         *k,				/* secret key */
-	OUT UINT8         *out,				/* output buffer */
-   ...
+RndJitterGetBytes(
+	OUT UINT8 *buf,
+	IN  UINTN len
 	)
 {
 	sha512_ctx ctx;
-	char inner[SHA512_DIGEST_SIZE], outer[SHA512_DIGEST_SIZE];
-	char key[SHA512_DIGEST_SIZE];
+	UINT8      digest[SHA512_DIGEST_SIZE];
+	UINT64     t0;
+	UINT64     delta;
+	UINT64     round = 0;
+	UINTN      i;
+	UINTN      sz;
+	EFI_TIME   time;
+	while (len > 0) {
+		sha512_begin(&ctx);
+		sha512_hash((unsigned char*)&round, sizeof(round), &ctx);
+		sha512_hash((unsigned char*)gKeyStrokeTimes, sizeof(gKeyStrokeTimes), &ctx);
+		if (!EFI_ERROR(gST->RuntimeServices->GetTime(&time, NULL))) {
+			sha512_hash((unsigned char*)&time, sizeof(time), &ctx);
+		}
+		for (i = 0; i < RND_JITTER_SAMPLES; ++i) {
+			t0 = AsmReadTsc();
+			gBS->Stall(1);
+			delta = AsmReadTsc() - t0;
+			sha512_hash((unsigned char*)&delta, sizeof(delta), &ctx);
+		}
+		sha512_end(digest, &ctx);
+		sz = (len > sizeof(digest)) ? sizeof(digest) : len;
+		CopyMem(buf, digest, sz);
+		buf += sz;
+		len -= sz;
+		round++;
+	}
+	burn(&ctx, sizeof(ctx));
+	burn(digest, sizeof(digest));
+	return EFI_SUCCESS;
+}
+
+EFI_STATUS
+RndHwSeed(
+	OUT UINT8 *buf,
+	IN  UINTN len
+	)
+{
+	UINT64  tmpRnd;
+	UINT8   *pos = buf;
+	UINTN   remains = len;
+	BOOLEAN seed = FALSE;
+	BOOLEAN ok = TRUE;
+	// gRndSeedHealth - failure latched by RDRAND generator stays
+#if defined(MDE_CPU_X64) || defined(MDE_CPU_IA32)
+	seed = RndRDSeedSupported();
+#endif
+	if (!seed && !RndRDRandSupported()) {
+		return RndJitterGetBytes(buf, len);
+	}
+	while (remains > 0 && ok) {
+		UINTN sz;
+#if defined(MDE_CPU_X64) || defined(MDE_CPU_IA32)
+		if (seed) {
+			ok = RndRDSeed64(&gRndSeedHealth, &tmpRnd);
+		}	else
+#endif
+		{
+			ok = RndRDRand64(&gRndSeedHealth, &tmpRnd);
+		}
+		sz = (remains > sizeof(tmpRnd)) ? sizeof(tmpRnd) : remains;
+		CopyMem(pos, &tmpRnd, sz);
+		pos += sz;
+		remains -= sz;
+	}
+	tmpRnd = 0;
+	if (!ok) {
+		// Hardware absent or failed health test
+		return RndJitterGetBytes(buf, len);
+	}
+	return EFI_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// DRBG HMAC (SHA512) (NIST SP 800-90A) (simplified)
+//////////////////////////////////////////////////////////////////////////
+// Midstates of ipad/opad blocks of a key. Computed once per key,
+// every HMAC with the key then costs only the data and final blocks.
+typedef struct _HMAC_SHA512_KEY {
+	sha512_ctx Inner;
+	sha512_ctx Outer;
+} HMAC_SHA512_KEY;
+
+VOID
+HmacSha512KeyInit(
+	OUT HMAC_SHA512_KEY  *hk,
+	IN  UINT8            *k				/* secret key (SHA512_DIGEST_SIZE) */
+	)
+{
 	char buf[SHA512_BLOCK_SIZE];
 	int32 i;
 	int32 lk = SHA512_DIGEST_SIZE;	/* length of the key in bytes */
-	VA_LIST args;
-	UINT8* data;
-	UINTN  len;
-
-	/**** Inner Digest ****/
-	sha512_begin(&ctx);
 
 	/* Pad the key for inner digest */
 	for (i = 0; i < lk; ++i)
 		buf[i] = (char)(k[i] ^ 0x36);
 	for (i = lk; i < SHA512_BLOCK_SIZE; ++i)
 		buf[i] = 0x36;
+	sha512_begin(&hk->Inner);
+	sha512_hash((unsigned char *)buf, SHA512_BLOCK_SIZE, &hk->Inner);
+
+	for (i = 0; i < lk; ++i)
+		buf[i] = (char)(k[i] ^ 0x5C);
+	for (i = lk; i < SHA512_BLOCK_SIZE; ++i)
+		buf[i] = 0x5C;
+	sha512_begin(&hk->Outer);
+	sha512_hash((unsigned char *)buf, SHA512_BLOCK_SIZE, &hk->Outer);
 
-	sha512_hash((unsigned char *)buf, SHA512_BLOCK_SIZE, &ctx);
+	burn(buf, sizeof(buf));
+}
 
-	VA_START(args, out);
+EFI_STATUS
+HmacSha512KeyedV(
+	IN  HMAC_SHA512_KEY  *hk,
+	OUT UINT8            *out,				/* output buffer */
+	IN  VA_LIST          args
+	)
+{
+	sha512_ctx ctx;
+	char inner[SHA512_DIGEST_SIZE];
+	UINT8* data;
+	UINTN  len;
+
+	/**** Inner Digest ****/
+	CopyMem(&ctx, &hk->Inner, sizeof(ctx));
 	while ((data = VA_ARG(args, UINT8 *)) != NULL) {
 		len = VA_ARG(args, UINTN);
 		sha512_hash(data, (UINT32)len, &ctx);
 	}
-	VA_END(args);
-
 	sha512_end((unsigned char *)inner, &ctx);
 
 	/**** Outer Digest ****/
-
-	sha512_begin(&ctx);
-
-	for (i = 0; i < lk; ++i)
-		buf[i] = (char)(k[i] ^ 0x5C);
-	for (i = lk; i < SHA512_BLOCK_SIZE; ++i)
-		buf[i] = 0x5C;
-
-	sha512_hash((unsigned char *)buf, SHA512_BLOCK_SIZE, &ctx);
+	CopyMem(&ctx, &hk->Outer, sizeof(ctx));
 	sha512_hash((unsigned char *)inner, SHA512_DIGEST_SIZE, &ctx);
-
 	sha512_end((unsigned char *)out, &ctx);
 
 	/* Prevent possible leaks. */
 	burn(&ctx, sizeof(ctx));
-	burn(outer, sizeof(outer));
 	burn(inner, sizeof(inner));
-	burn(buf, sizeof(buf));
-	burn(key, sizeof(key));
 	return EFI_SUCCESS;
 }
 
+EFI_STATUS
+HmacSha512Keyed(
+	IN  HMAC_SHA512_KEY  *hk,
+	OUT UINT8            *out,				/* output buffer */
+   ...
+	)
+{
+	EFI_STATUS res;
+	VA_LIST args;
+	VA_START(args, out);
+	res = HmacSha512KeyedV(hk, out, args);
+	VA_END(args);
+	return res;
+}
+
+EFI_STATUS
+HmacSha512(
+	IN  UINT8         *k,				/* secret key */
+	OUT UINT8         *out,				/* output buffer */
+   ...
+	)
+{
+	EFI_STATUS res;
+	HMAC_SHA512_KEY hk;
+	VA_LIST args;
+
+	HmacSha512KeyInit(&hk, k);
+	VA_START(args, out);
+	res = HmacSha512KeyedV(&hk, out, args);
+	VA_END(args);
+	burn(&hk, sizeof(hk));
+	return res;
+}
+
 EFI_STATUS
 RndDtrmHmacSha512Update(
 	RND_DTRM_HMAC_SHA512_STATE     *state,
@@ -257,6 +526,7 @@ RndDtrmHmacSha512Generate(
 {
 	EFI_STATUS     res = EFI_SUCCESS;
 	UINTN          len = 0;
+	HMAC_SHA512_KEY hk;
 
 	/* 10.1.2.5 step 2 */
 	if (seed && 0 < seedLen)
@@ -266,16 +536,20 @@ RndDtrmHmacSha512Generate(
 			return res;
 	}
 
+	/* key C is the same for all blocks */
+	HmacSha512KeyInit(&hk, state->C);
 	while (len < buflen)
 	{
 		UINTN outlen = 0;
 		/* 10.1.2.5 step 4.1 */
-		res = HmacSha512(state->C, state->V, 
+		res = HmacSha512Keyed(&hk, state->V, 
 			state->V, SHA512_DIGEST_SIZE,
 			NULL
 			);
-		if (EFI_ERROR(res))
+		if (EFI_ERROR(res)) {
+			burn(&hk, sizeof(hk));
 			return res;
+		}
 		outlen = (SHA512_DIGEST_SIZE < (buflen - len)) ?
 			SHA512_DIGEST_SIZE : (buflen - len);
 
@@ -283,23 +557,71 @@ RndDtrmHmacSha512Generate(
 		memcpy(buf + len, state->V, outlen);
 		len += outlen;
 	}
+	burn(&hk, sizeof(hk));
 
 	/* 10.1.2.5 step 6 */
 	res = RndDtrmHmacSha512Update(state, seed, seedLen, 1);
 	return res;
 }
 
+/* reseed function of HMAC DRBG as defined in 10.1.2.4 with hardware entropy */
+EFI_STATUS
+RndDtrmHmacSha512Reseed(
+	IN DCS_RND* rnd
+	)
+{
+	EFI_STATUS res;
+	UINT8      seed[SHA512_DIGEST_SIZE];
+	res = RndHwSeed(seed, sizeof(seed));
+	if (!EFI_ERROR(res)) {
+		res = RndDtrmHmacSha512Update(&rnd->State.HMacSha512, seed, sizeof(seed), 1);
+		if (!EFI_ERROR(res)) {
+			rnd->State.HMacSha512.ReseedCtr = 0;
+		}
+	}
+	burn(seed, sizeof(seed));
+	return res;
+}
+
 EFI_STATUS
 RndDtrmHmacSha512Prepare(
 	IN DCS_RND* rnd
 	)
 {
 	if (rnd != NULL && rnd->Type == RndTypeDtrmHmacSha512) {
-		return EFI_SUCCESS;
+		// Output generated before reseed is dropped
+		burn(rnd->Pool, sizeof(rnd->Pool));
+		rnd->PoolPos = sizeof(rnd->Pool);
+		// Reseed with fresh entropy (state can be loaded from file or DeList)
+		return RndDtrmHmacSha512Reseed(rnd);
 	}
 	return EFI_NOT_READY;
 }
 
+/**
+One generate call. Reseeds on schedule (without hardware entropy the
+counter runs up to SP 800-90A limit). TSC is additional input.
+*/
+EFI_STATUS
+RndDtrmHmacSha512Batch(
+	IN  DCS_RND* rnd,
+	OUT UINT8    *buf,
+	IN  UINTN    len
+	)
+{
+	EFI_STATUS res;
+	UINT64     tsc;
+	RND_DTRM_HMAC_SHA512_STATE *state = &rnd->State.HMacSha512;
+	if (state->ReseedCtr >= RND_RESEED_INTERVAL) {
+		RndDtrmHmacSha512Reseed(rnd);
+	}
+	if (state->ReseedCtr >= (1LL << 48)) return EFI_NOT_READY;
+	tsc = AsmReadTsc();
+	res = RndDtrmHmacSha512Generate(state, buf, len, (UINT8*)&tsc, sizeof(tsc));
+	state->ReseedCtr++;
+	return res;
+}
+
 EFI_STATUS
 RndDtrmHmacSha512GetBytes(
 	IN DCS_RND* rnd,
@@ -307,13 +629,26 @@ RndDtrmHmacSha512GetBytes(
 	UINTN len
 	)
 {
-	EFI_TIME seed;
-	EFI_STATUS res = EFI_NOT_READY;
-	RND_DTRM_HMAC_SHA512_STATE *state = &rnd->State.HMacSha512;
-	if (state->ReseedCtr < (1LL << 48)) {
-		gST->RuntimeServices->GetTime(&seed, NULL);
-		res = RndDtrmHmacSha512Generate(state, buf, len, (UINT8*)&seed, sizeof(seed));
-		state->ReseedCtr++;
+	EFI_STATUS res = EFI_SUCCESS;
+	UINTN      n;
+
+	if (len >= sizeof(rnd->Pool)) {
+		return RndDtrmHmacSha512Batch(rnd, buf, len);
+	}
+	while (len > 0) {
+		if (rnd->PoolPos >= sizeof(rnd->Pool)) {
+			res = RndDtrmHmacSha512Batch(rnd, rnd->Pool, sizeof(rnd->Pool));
+			if (EFI_ERROR(res)) return res;
+			rnd->PoolPos = 0;
+		}
+		n = sizeof(rnd->Pool) - rnd->PoolPos;
+		if (n > len) n = len;
+		CopyMem(buf, rnd->Pool + rnd->PoolPos, n);
+		// Served bytes do not stay in memory
+		ZeroMem(rnd->Pool + rnd->PoolPos, n);
+		rnd->PoolPos += n;
+		buf += n;
+		len -= n;
 	}
 	return res;
 }
@@ -329,6 +664,7 @@ RndDtrmHmacSha512Init(
 	rnd->Type = RndTypeDtrmHmacSha512;
 	rnd->GetBytes = RndDtrmHmacSha512GetBytes;
 	rnd->Prepare = RndDtrmHmacSha512Prepare;
+	rnd->PoolPos = sizeof(rnd->Pool);
 
 	if (Context != NULL) {
 		CHAR16* type = (CHAR16*)Context;
@@ -416,7 +752,6 @@ RndSave(
 {
 	EFI_STATUS res = EFI_NOT_READY;
 	DCS_RND_SAVED    *RndSaved;
-	UINT32 crc;
 	if (rnd != NULL && rndSaved != NULL && rnd->Type != RndTypeFile) {
 		RndSaved = MEM_ALLOC(sizeof(DCS_RND_SAVED));
 		if (RndSaved != NULL) {
@@ -425,12 +760,8 @@ RndSave(
 			RndSaved->Type = rnd->Type;
 			RndSaved->Sign = gRndHeaderSign;
 			gST->RuntimeServices->GetTime(&RndSaved->SavedAt, NULL);
-			res = gBS->CalculateCrc32(RndSaved, sizeof(DCS_RND_SAVED), &crc);
-			if (EFI_ERROR(res)) {
-				MEM_FREE(RndSaved);
-				return res;
-			}
-			RndSaved->CRC = crc;
+			RndSaved->CRC = EfiCrc32(RndSaved, sizeof(DCS_RND_SAVED));
+			res = EFI_SUCCESS;
 			*rndSaved = RndSaved;
 		}
 	}
@@ -448,8 +779,8 @@ RndLoad(
 
 	crcSaved = rndSaved->CRC;
 	rndSaved->CRC = 0;
-	res = gBS->CalculateCrc32(rndSaved, sizeof(DCS_RND_SAVED), &crc);
-	if (EFI_ERROR(res) || crc != crcSaved || rndSaved->Sign != gRndHeaderSign) {
+	crc = EfiCrc32(rndSaved, sizeof(DCS_RND_SAVED));
+	if (crc != crcSaved || rndSaved->Sign != gRndHeaderSign) {
 		return EFI_CRC_ERROR;
 	}
 	res = RndInit(rndSaved->Type, NULL, rndOut);
@@ -458,3 +789,87 @@ RndLoad(
 	}
 	return res;
 }
+
+//////////////////////////////////////////////////////////////////////////
+// Random stream for wipe
+// AES-256 in counter mode keyed once from gRnd. AES-NI is used by
+// EncipherBlocks if CPU supports it.
+//////////////////////////////////////////////////////////////////////////
+#define RND_STREAM_BLOCKS 32
+
+EFI_STATUS
+RndStreamInit(
+	OUT RND_STREAM *stream
+	)
+{
+	EFI_STATUS res;
+	UINT8      key[32];
+	if (stream == NULL) return EFI_INVALID_PARAMETER;
+	ZeroMem(stream, sizeof(RND_STREAM));
+	stream->Ks = MEM_ALLOC(CipherGetKeyScheduleSize(AES));
+	if (stream->Ks == NULL) return EFI_BUFFER_TOO_SMALL;
+	res = RndGetBytes(key, sizeof(key));
+	if (!EFI_ERROR(res)) {
+		res = RndGetBytes((UINT8*)&stream->Nonce, sizeof(stream->Nonce));
+	}
+	if (!EFI_ERROR(res) && CipherInit(AES, key, stream->Ks) != ERR_SUCCESS) {
+		res = EFI_INVALID_PARAMETER;
+	}
+	burn(key, sizeof(key));
+	if (EFI_ERROR(res)) {
+		RndStreamClose(stream);
+	}
+	return res;
+}
+
+EFI_STATUS
+RndStreamGetBytes(
+	IN OUT RND_STREAM *stream,
+	OUT    UINT8      *buf,
+	IN     UINTN      len
+	)
+{
+	UINT64 block[RND_STREAM_BLOCKS * 2];
+	UINTN  blocks;
+	UINTN  i;
+	if (stream == NULL || stream->Ks == NULL) return EFI_NOT_READY;
+	while (len > 0) {
+		UINT64 *ctr;
+		UINTN  sz;
+		if (len >= sizeof(block)) {
+			// Encrypt counters in place
+			ctr = (UINT64*)buf;
+			blocks = RND_STREAM_BLOCKS;
+		}	else {
+			ctr = block;
+			blocks = (len + 15) >> 4;
+		}
+		for (i = 0; i < blocks; ++i) {
+			ctr[i * 2] = stream->Nonce;
+			ctr[i * 2 + 1] = stream->Counter++;
+		}
+		EncipherBlocks(AES, ctr, stream->Ks, blocks);
+		sz = blocks << 4;
+		if (ctr == block) {
+			sz = len;
+			CopyMem(buf, block, sz);
+			burn(block, sizeof(block));
+		}
+		buf += sz;
+		len -= sz;
+	}
+	return EFI_SUCCESS;
+}
+
+VOID
+RndStreamClose(
+	IN OUT RND_STREAM *stream
+	)
+{
+	if (stream == NULL) return;
+	if (stream->Ks != NULL) {
+		burn(stream->Ks, CipherGetKeyScheduleSize(AES));
+		MEM_FREE(stream->Ks);
+	}
+	ZeroMem(stream, sizeof(RND_STREAM));
+}
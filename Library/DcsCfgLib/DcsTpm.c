@@ -0,0 +1,301 @@
+/** @file
+TPM 2.0 sealed secret for DCS
+
+Copyright (c) 2016. Disk Cryptography Services for EFI (DCS), Alex Kolotnikov
+
+This program and the accompanying materials
+are licensed and made available under the terms and conditions
+of the GNU Lesser General Public License, version 3.0 (LGPL-3.0).
+
+The full text of the license may be found at
+https://opensource.org/licenses/LGPL-3.0
+
+Secret is kept in TPM NV index readable only with policy session
+(PolicyPCR over selected PCRs [+ PolicyPassword for PIN]).
+Index is read locked after read until next TPM reset.
+**/
+
+#include <Uefi.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/CommonLib.h>
+#include <Library/DcsCfgLib.h>
+#include <Library/Tpm2CommandLib.h>
+#include <Library/Tpm2DeviceLib.h>
+#include <IndustryStandard/Tpm20.h>
+#include <Protocol/Tcg2Protocol.h>
+
+//////////////////////////////////////////////////////////////////////////
+// Measure
+//////////////////////////////////////////////////////////////////////////
+EFI_STATUS
+DcsTpmMeasure(
+	IN UINT32  pcr,
+	IN VOID    *data,
+	IN UINTN   size
+	)
+{
+	EFI_STATUS          res;
+	EFI_TCG2_PROTOCOL   *tcg2;
+	EFI_TCG2_EVENT      *event;
+	CHAR8               desc[] = "DcsProp";
+	UINT32              eventSize;
+
+	res = gBS->LocateProtocol(&gEfiTcg2ProtocolGuid, NULL, (VOID**)&tcg2);
+	if (EFI_ERROR(res)) return res;
+	eventSize = (UINT32)(sizeof(EFI_TCG2_EVENT) - sizeof(event->Event) + sizeof(desc));
+	event = MEM_ALLOC(eventSize);
+	if (event == NULL) return EFI_BUFFER_TOO_SMALL;
+	event->Size = eventSize;
+	event->Header.HeaderSize = sizeof(EFI_TCG2_EVENT_HEADER);
+	event->Header.HeaderVersion = EFI_TCG2_EVENT_HEADER_VERSION;
+	event->Header.PCRIndex = pcr;
+	event->Header.EventType = EV_IPL;
+	CopyMem(event->Event, desc, sizeof(desc));
+	res = tcg2->HashLogExtendEvent(tcg2, 0, (EFI_PHYSICAL_ADDRESS)(UINTN)data, size, event);
+	MEM_FREE(event);
+	return res;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Policy
+//////////////////////////////////////////////////////////////////////////
+#pragma pack(1)
+typedef struct {
+	TPM2_COMMAND_HEADER   Header;
+	TPMI_SH_POLICY        PolicySession;
+} TPM2_POLICY_PASSWORD_COMMAND;
+
+typedef struct {
+	TPM2_RESPONSE_HEADER  Header;
+} TPM2_POLICY_PASSWORD_RESPONSE;
+#pragma pack()
+
+EFI_STATUS
+DcsTpmPolicyPassword(
+	IN TPMI_SH_POLICY session
+	)
+{
+	EFI_STATUS                     res;
+	TPM2_POLICY_PASSWORD_COMMAND   cmd;
+	TPM2_POLICY_PASSWORD_RESPONSE  rsp;
+	UINT32                         rspSize = sizeof(rsp);
+	cmd.Header.tag = SwapBytes16(TPM_ST_NO_SESSIONS);
+	cmd.Header.paramSize = SwapBytes32(sizeof(cmd));
+	cmd.Header.commandCode = SwapBytes32(TPM_CC_PolicyPassword);
+	cmd.PolicySession = SwapBytes32(session);
+	res = Tpm2SubmitCommand(sizeof(cmd), (UINT8*)&cmd, &rspSize, (UINT8*)&rsp);
+	if (EFI_ERROR(res)) return res;
+	if (SwapBytes32(rsp.Header.responseCode) != TPM_RC_SUCCESS) return EFI_DEVICE_ERROR;
+	return EFI_SUCCESS;
+}
+
+VOID
+DcsTpmPcrSelection(
+	OUT TPML_PCR_SELECTION  *sel,
+	IN  UINT32              pcrMask
+	)
+{
+	ZeroMem(sel, sizeof(*sel));
+	sel->count = 1;
+	sel->pcrSelections[0].hash = TPM_ALG_SHA256;
+	sel->pcrSelections[0].sizeofSelect = PCR_SELECT_MIN;
+	sel->pcrSelections[0].pcrSelect[0] = (UINT8)pcrMask;
+	sel->pcrSelections[0].pcrSelect[1] = (UINT8)(pcrMask >> 8);
+	sel->pcrSelections[0].pcrSelect[2] = (UINT8)(pcrMask >> 16);
+}
+
+/**
+Start policy (or trial) session bound to current values of pcrMask PCRs
+*/
+EFI_STATUS
+DcsTpmPolicyStart(
+	IN  TPM_SE                 type,
+	IN  UINT32                 pcrMask,
+	IN  BOOLEAN                pin,
+	OUT TPMI_SH_AUTH_SESSION   *session
+	)
+{
+	EFI_STATUS              res;
+	TPM2B_NONCE             nonceCaller;
+	TPM2B_NONCE             nonceTpm;
+	TPM2B_ENCRYPTED_SECRET  salt;
+	TPMT_SYM_DEF            symmetric;
+	TPM2B_DIGEST            pcrDigest;
+	TPML_PCR_SELECTION      pcrs;
+
+	ZeroMem(&nonceCaller, sizeof(nonceCaller));
+	ZeroMem(&salt, sizeof(salt));
+	ZeroMem(&symmetric, sizeof(symmetric));
+	ZeroMem(&pcrDigest, sizeof(pcrDigest));
+	nonceCaller.size = SHA256_DIGEST_SIZE;
+	res = RndGetBytes(nonceCaller.buffer, nonceCaller.size);
+	if (EFI_ERROR(res)) {
+		res = RndHwSeed(nonceCaller.buffer, nonceCaller.size);
+		if (EFI_ERROR(res)) return res;
+	}
+	symmetric.algorithm = TPM_ALG_NULL;
+	res = Tpm2StartAuthSession(TPM_RH_NULL, TPM_RH_NULL, &nonceCaller, &salt, type, &symmetric, TPM_ALG_SHA256, session, &nonceTpm);
+	if (EFI_ERROR(res)) return res;
+
+	DcsTpmPcrSelection(&pcrs, pcrMask);
+	res = Tpm2PolicyPCR(*session, &pcrDigest, &pcrs);
+	if (!EFI_ERROR(res) && pin) {
+		res = DcsTpmPolicyPassword(*session);
+	}
+	if (EFI_ERROR(res)) {
+		Tpm2FlushContext(*session);
+	}
+	return res;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Seal/Unseal
+//////////////////////////////////////////////////////////////////////////
+/**
+TPM 2.0 is present, SHA256 PCR bank is active, owner authorization is empty
+and policy session over pcrMask PCRs can be started (DcsTpmSeal can work).
+*/
+EFI_STATUS
+DcsTpmSealReady(
+	IN UINT32  pcrMask
+	)
+{
+	EFI_STATUS                        res;
+	EFI_TCG2_PROTOCOL                 *tcg2;
+	EFI_TCG2_BOOT_SERVICE_CAPABILITY  cap;
+	TPMI_YES_NO                       more;
+	TPMS_CAPABILITY_DATA              capData;
+	TPMI_SH_AUTH_SESSION              trial;
+
+	if ((pcrMask & 0xFF000000) != 0) return EFI_INVALID_PARAMETER;
+	res = gBS->LocateProtocol(&gEfiTcg2ProtocolGuid, NULL, (VOID**)&tcg2);
+	if (EFI_ERROR(res)) return res;
+	ZeroMem(&cap, sizeof(cap));
+	cap.Size = (UINT8)sizeof(cap);
+	res = tcg2->GetCapability(tcg2, &cap);
+	if (EFI_ERROR(res)) return res;
+	if (!cap.TPMPresentFlag) return EFI_NOT_FOUND;
+	if ((cap.ActivePcrBanks & EFI_TCG2_BOOT_HASH_ALG_SHA256) == 0) return EFI_UNSUPPORTED;
+
+	// TPMA_PERMANENT.ownerAuthSet
+	ZeroMem(&capData, sizeof(capData));
+	res = Tpm2GetCapability(TPM_CAP_TPM_PROPERTIES, TPM_PT_PERMANENT, 1, &more, &capData);
+	if (EFI_ERROR(res)) return res;
+	if (SwapBytes32(capData.data.tpmProperties.count) != 1 ||
+		SwapBytes32(capData.data.tpmProperties.tpmProperty[0].property) != TPM_PT_PERMANENT) {
+		return EFI_DEVICE_ERROR;
+	}
+	if ((SwapBytes32(capData.data.tpmProperties.tpmProperty[0].value) & BIT0) != 0) return EFI_ACCESS_DENIED;
+
+	res = DcsTpmPolicyStart(TPM_SE_TRIAL, pcrMask, FALSE, &trial);
+	if (EFI_ERROR(res)) return res;
+	Tpm2FlushContext(trial);
+	return EFI_SUCCESS;
+}
+
+/**
+Keep secret in NV index. Read is allowed only with current values of pcrMask PCRs (and PIN).
+Owner authorization has to be empty.
+*/
+EFI_STATUS
+DcsTpmSeal(
+	IN UINT32  pcrMask,
+	IN UINT8   *pin,
+	IN UINTN   pinLen,
+	IN UINT8   *secret,
+	IN UINTN   secretLen
+	)
+{
+	EFI_STATUS             res;
+	TPMI_SH_AUTH_SESSION   trial;
+	TPM2B_DIGEST           policy;
+	TPM2B_AUTH             auth;
+	TPM2B_NV_PUBLIC        nvPublic;
+	TPM2B_MAX_BUFFER       data;
+
+	if (secretLen > sizeof(data.buffer) || pinLen > sizeof(auth.buffer)) return EFI_INVALID_PARAMETER;
+	res = DcsTpmPolicyStart(TPM_SE_TRIAL, pcrMask, pinLen > 0, &trial);
+	if (EFI_ERROR(res)) return res;
+	ZeroMem(&policy, sizeof(policy));
+	res = Tpm2PolicyGetDigest(trial, &policy);
+	Tpm2FlushContext(trial);
+	if (EFI_ERROR(res)) return res;
+
+	Tpm2NvUndefineSpace(TPM_RH_OWNER, DCS_TPM_NV_INDEX, NULL);
+
+	ZeroMem(&auth, sizeof(auth));
+	auth.size = (UINT16)pinLen;
+	CopyMem(auth.buffer, pin, pinLen);
+	ZeroMem(&nvPublic, sizeof(nvPublic));
+	nvPublic.nvPublic.nvIndex = DCS_TPM_NV_INDEX;
+	nvPublic.nvPublic.nameAlg = TPM_ALG_SHA256;
+	nvPublic.nvPublic.attributes.TPMA_NV_OWNERWRITE = 1;
+	nvPublic.nvPublic.attributes.TPMA_NV_POLICYREAD = 1;
+	nvPublic.nvPublic.attributes.TPMA_NV_READ_STCLEAR = 1;
+	nvPublic.nvPublic.attributes.TPMA_NV_NO_DA = pinLen > 0 ? 0 : 1;
+	CopyMem(&nvPublic.nvPublic.authPolicy, &policy, sizeof(policy));
+	nvPublic.nvPublic.dataSize = (UINT16)secretLen;
+	// marshaled size: nvIndex, nameAlg, attributes, authPolicy, dataSize
+	nvPublic.size = (UINT16)(sizeof(UINT32) + sizeof(UINT16) + sizeof(TPMA_NV) +
+		sizeof(UINT16) + policy.size + sizeof(UINT16));
+	res = Tpm2NvDefineSpace(TPM_RH_OWNER, NULL, &auth, &nvPublic);
+	ZeroMem(&auth, sizeof(auth));
+	if (EFI_ERROR(res)) return res;
+
+	data.size = (UINT16)secretLen;
+	CopyMem(data.buffer, secret, secretLen);
+	res = Tpm2NvWrite(TPM_RH_OWNER, DCS_TPM_NV_INDEX, NULL, &data, 0);
+	ZeroMem(&data, sizeof(data));
+	return res;
+}
+
+/**
+Read secret with policy session and lock read until next TPM reset
+*/
+EFI_STATUS
+DcsTpmUnseal(
+	IN  UINT32  pcrMask,
+	IN  UINT8   *pin,
+	IN  UINTN   pinLen,
+	OUT UINT8   *secret,
+	IN  UINTN   secretLen
+	)
+{
+	EFI_STATUS           res;
+	TPMS_AUTH_COMMAND    authSession;
+	TPM2B_MAX_BUFFER     data;
+
+	if (secretLen > sizeof(data.buffer) || pinLen > sizeof(authSession.hmac.buffer)) return EFI_INVALID_PARAMETER;
+	ZeroMem(&authSession, sizeof(authSession));
+	res = DcsTpmPolicyStart(TPM_SE_POLICY, pcrMask, pinLen > 0, &authSession.sessionHandle);
+	if (EFI_ERROR(res)) return res;
+	authSession.hmac.size = (UINT16)pinLen;
+	CopyMem(authSession.hmac.buffer, pin, pinLen);
+	ZeroMem(&data, sizeof(data));
+	res = Tpm2NvRead(DCS_TPM_NV_INDEX, DCS_TPM_NV_INDEX, &authSession, (UINT16)secretLen, 0, &data);
+	Tpm2FlushContext(authSession.sessionHandle);
+	if (!EFI_ERROR(res)) {
+		if (data.size != secretLen) {
+			res = EFI_CRC_ERROR;
+		}	else {
+			CopyMem(secret, data.buffer, secretLen);
+		}
+	}
+	ZeroMem(&data, sizeof(data));
+
+	// Nobody reads it after DCS
+	if (!EFI_ERROR(DcsTpmPolicyStart(TPM_SE_POLICY, pcrMask, pinLen > 0, &authSession.sessionHandle))) {
+		Tpm2NvReadLock(DCS_TPM_NV_INDEX, DCS_TPM_NV_INDEX, &authSession);
+		Tpm2FlushContext(authSession.sessionHandle);
+	}
+	ZeroMem(&authSession, sizeof(authSession));
+	return res;
+}
+
+EFI_STATUS
+DcsTpmClear()
+{
+	return Tpm2NvUndefineSpace(TPM_RH_OWNER, DCS_TPM_NV_INDEX, NULL);
+}
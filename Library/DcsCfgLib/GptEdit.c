@@ -82,7 +82,6 @@ GptHeaderCheckCrcAltSize(
 {
 	UINT32      Crc;
 	UINT32      OrgCrc;
-	EFI_STATUS  Status;
 
 	Crc = 0;
 
@@ -102,10 +101,7 @@ GptHeaderCheckCrcAltSize(
 	OrgCrc = Hdr->CRC32;
 	Hdr->CRC32 = 0;
 
-	Status = gBS->CalculateCrc32((UINT8 *)Hdr, Size, &Crc);
-	if (EFI_ERROR(Status)) {
-		return FALSE;
-	}
+	Crc = EfiCrc32(Hdr, Size);
 	//
 	// set results
 	//
@@ -144,10 +140,7 @@ GptCheckEntryArray(
 	UINTN       Size;
 
 	Size = PartHeader->NumberOfPartitionEntries * PartHeader->SizeOfPartitionEntry;
-	Status = gBS->CalculateCrc32(Entrys, Size, &Crc);
-	if (EFI_ERROR(Status)) {
-		return EFI_CRC_ERROR;
-	}
+	Crc = EfiCrc32(Entrys, Size);
 	Status = (PartHeader->PartitionEntryArrayCRC32 == Crc) ? EFI_SUCCESS : EFI_CRC_ERROR;
 	return Status;
 }
@@ -158,24 +151,13 @@ GptUpdateCRC(
 	IN  EFI_PARTITION_ENTRY         *Entrys
 	)
 {
-	EFI_STATUS  Status;
-	UINT32      Crc;
 	UINTN       Size;
 
 	Size = PartHeader->NumberOfPartitionEntries * PartHeader->SizeOfPartitionEntry;
-	Status = gBS->CalculateCrc32(Entrys, Size, &Crc);
-	if (EFI_ERROR(Status)) {
-		return Status;
-	}
-	PartHeader->PartitionEntryArrayCRC32 = Crc;
+	PartHeader->PartitionEntryArrayCRC32 = EfiCrc32(Entrys, Size);
 	PartHeader->Header.CRC32 = 0;
-
-	Status = gBS->CalculateCrc32((UINT8 *)PartHeader, PartHeader->Header.HeaderSize, &Crc);
-	if (EFI_ERROR(Status)) {
-		return Status;
-	}
-	PartHeader->Header.CRC32 = Crc;
-	return Status;
+	PartHeader->Header.CRC32 = EfiCrc32(PartHeader, PartHeader->Header.HeaderSize);
+	return EFI_SUCCESS;
 }
 
 /**
@@ -399,7 +381,7 @@ DeListPrint() {
 #define DeList_UPDATE_END    \
    }
 
-VOID
+EFI_STATUS
 DeListSaveToFile() {
 	EFI_STATUS                  res = EFI_SUCCESS;
 	UINT32                      Offset;
@@ -461,11 +443,7 @@ DeListSaveToFile() {
 	DeList_UPDATE_END
 
 	DeList->DataSize = Offset;
-	res = gBS->CalculateCrc32(DeList, 512, &DeList->CRC32);
-	if (EFI_ERROR(res)) {
-		ERR_PRINT(L"CRC: %r\n", res);
-		goto error;
-	}
+	DeList->CRC32 = EfiCrc32(DeList, 512);
 	{
 		EFI_FILE*  file;
 		UINTN     i;
@@ -489,6 +467,11 @@ DeListSaveToFile() {
 				}
 				if (pad > 0) {
 					res = FileWrite(file, pad512buf, &pad, NULL);
+					if (EFI_ERROR(res)) {
+						ERR_PRINT(L"Write: %r\n", res);
+						FileClose(file);
+						goto error;
+					}
 				}
 			}
 		}
@@ -498,6 +481,7 @@ DeListSaveToFile() {
 error:
 	MEM_FREE(DeList);
 	MEM_FREE(pad512buf);
+	return res;
 }
 
 EFI_STATUS
@@ -552,7 +536,7 @@ DeListParseSaved(
 		}
 		crcSaved = DePwdCache->CRC;
 		DePwdCache->CRC = 0;
-		res = gBS->CalculateCrc32(DePwdCache, sizeof(*DePwdCache), &crc);
+		crc = EfiCrc32(DePwdCache, sizeof(*DePwdCache));
 		if (crc != crcSaved) {
 			ERR_PRINT(L"Pwd cache crc\n");
 			return EFI_CRC_ERROR;
@@ -604,7 +588,7 @@ DeListParseSaved(
 
 	if (GptMainEntrys != NULL && GptAltEntrys != NULL && GptMainHdr != NULL) {
 		if (CompareMem(GptMainEntrys, GptAltEntrys, GptMainHdr->NumberOfPartitionEntries * GptMainHdr->SizeOfPartitionEntry) != 0) {
-			ERR_PRINT(L"Alt GPT != Main GPT\n", );
+			ERR_PRINT(L"Alt GPT != Main GPT\n");
 			return EFI_CRC_ERROR;
 		}
 	}
@@ -619,7 +603,7 @@ DeListLoadFromFile()
 	UINT8                       *DeBuffer;
 
 	InitFS();
-	res = FileLoad(NULL, (CHAR16*)DcsDiskEntrysFileName, &DeBuffer, &len);
+	res = FileLoad(NULL, (CHAR16*)DcsDiskEntrysFileName, (VOID**)&DeBuffer, &len);
 	if (EFI_ERROR(res)) {
 		ERR_PRINT(L"Load: %r\n", res);
 		return res;
@@ -661,7 +645,7 @@ DeListApplySectorsToDisk(
 	if (CompareMem(Mbr + 0x1b8, &DeDiskId.MbrID, sizeof(UINT32)) != 0) {
 		ERR_PRINT(L"Disk MBR ID %08x != %08x \n", *((UINT32*)(Mbr + 0x1b8)), DeDiskId.MbrID);
 		MEM_FREE(Mbr);
-		return res;
+		return EFI_NOT_FOUND;
 	}
 	MEM_FREE(Mbr);
 
@@ -762,11 +746,12 @@ IsRegionOverlap(UINT64 start1, UINT64 end1, UINT64 start2, UINT64 end2) {
 	return (start1 < start2) ? (end1 >= start2) : (start1 <= end2);
 }
 
-VOID
+EFI_STATUS
 GptHideParts() {
 	UINTN count;
 	UINTN n;
 	BOOLEAN set = FALSE;
+	if (GptMainHdr == NULL || GptMainEntrys == NULL) return EFI_NOT_READY;
 	count = GptMainHdr->NumberOfPartitionEntries;
 
 	for (n = 0; n < count; ++n) {
@@ -785,9 +770,13 @@ GptHideParts() {
 			}
 		}
 	}
+	if (!set) {
+		ERR_PRINT(L"No partition in hidden range\n");
+		return EFI_NOT_FOUND;
+	}
 	GptSqueze();
 	GptSort();
-	GptSyncMainAlt();
+	return GptSyncMainAlt();
 }
 
 BOOLEAN
@@ -868,10 +857,8 @@ DeListPwdCacheEdit()
 	UINTN     count;
 	UINTN     len;
 	UINTN     i;
-	UINT32    crc = 0;
 	Password  pwd;
 	UINTN     pim;
-	EFI_STATUS res;
 	if (DePwdCache == NULL) {
 		DePwdCache = MEM_ALLOC(sizeof(*DePwdCache));
 		DePwdCache->Sign = DCS_DEP_PWD_CACHE_SIGN;
@@ -886,10 +873,10 @@ DeListPwdCacheEdit()
 		pim = 0;
 		if (i < DePwdCache->Count) {
 			OUT_PRINT(L"%H%d%N [%a] [%d]\n:", i, DePwdCache->Pwd[i].Text, DePwdCache->Pim[i]);
-			GetLine(&len, NULL, pwd.Text, MAX_PASSWORD, 1);
+			GetLine(&len, NULL, (CHAR8*)pwd.Text, MAX_PASSWORD, 0);
 			if (len != 0) {
 				pwd.Length = (uint32)len;
-				pim = (uint32)AskUINTN("Pim:", DePwdCache->Pim[i]);
+				pim = (uint32)AskInt("Pim:", 0);
 			}
 		}
 		DePwdCache->Pim[i] = (uint32)pim;
@@ -897,9 +884,8 @@ DeListPwdCacheEdit()
 	}
 	ZeroMem(&DePwdCache->pad, sizeof(DePwdCache->pad));
 	DePwdCache->CRC = 0;
-	res =gBS->CalculateCrc32(DePwdCache, 512, &crc);
-	DePwdCache->CRC = crc;
-	return res;
+	DePwdCache->CRC = EfiCrc32(DePwdCache, 512);
+	return EFI_SUCCESS;
 }
 
 EFI_STATUS
@@ -0,0 +1,27 @@
+    .386
+    .model  flat,C
+    .code
+
+;------------------------------------------------------------------------------
+; BOOLEAN
+; EFIAPI
+; RdSeed64Step (
+;   OUT UINT64 *Rand
+;   );
+;------------------------------------------------------------------------------
+RdSeed64Step    PROC
+    mov edx, [esp + 4]
+    db 0Fh, 0C7h, 0F8h           ; rdseed eax
+    jnc fail
+    mov [edx], eax
+    db 0Fh, 0C7h, 0F8h           ; rdseed eax
+    jnc fail
+    mov [edx + 4], eax
+    mov eax, 1
+    ret
+fail:
+    xor eax, eax
+    ret
+RdSeed64Step    ENDP
+
+    END
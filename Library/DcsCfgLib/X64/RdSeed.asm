@@ -0,0 +1,21 @@
+    .code
+
+;------------------------------------------------------------------------------
+; BOOLEAN
+; EFIAPI
+; RdSeed64Step (
+;   OUT UINT64 *Rand
+;   );
+;------------------------------------------------------------------------------
+RdSeed64Step    PROC
+    db 48h, 0Fh, 0C7h, 0F8h      ; rdseed rax
+    jnc fail
+    mov [rcx], rax
+    mov rax, 1
+    ret
+fail:
+    xor rax, rax
+    ret
+RdSeed64Step    ENDP
+
+    END
@@ -101,14 +101,19 @@ EFI_STATUS ScreenUpdateDirty(
 	)
 {
 	EFI_STATUS	res = EFI_SUCCESS;
-	if (bltScreen->Dirty.top != bltScreen->Dirty.bottom || bltScreen->Dirty.left != bltScreen->Dirty.right) {
-		res = gGraphOut->Blt(gGraphOut, bltScreen->Pixels, EfiBltBufferToVideo, 
-			bltScreen->Dirty.top, bltScreen->Dirty.left, // Source x,y 
-			bltScreen->Dirty.top, bltScreen->Dirty.left, // Dest x,y
-			bltScreen->Dirty.right - bltScreen->Dirty.left + 1, bltScreen->Dirty.bottom - bltScreen->Dirty.top + 1,		// width , height
+	EFI_STATUS	resBlt;
+	PRECT       rect;
+	UINTN       i;
+	for (i = 0; i < bltScreen->DirtyCount; ++i) {
+		rect = &bltScreen->Dirty[i];
+		resBlt = gGraphOut->Blt(gGraphOut, bltScreen->Pixels, EfiBltBufferToVideo,
+			rect->left, rect->top, // Source x,y
+			rect->left, rect->top, // Dest x,y
+			rect->right - rect->left + 1, rect->bottom - rect->top + 1,		// width , height
 			bltScreen->Width * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
-		SetMem(&bltScreen->Dirty, sizeof(bltScreen->Dirty), 0);
+		if (EFI_ERROR(resBlt)) res = resBlt;
 	}
+	bltScreen->DirtyCount = 0;
 	return res;
 }
 
@@ -154,15 +159,16 @@ BltDrawBlt(
 	IN UINTN x,
 	IN UINTN y
 	) {
-	UINTN		row, col;
-	DRAW_CONTEXT	ctx;
-	ctx.Op = DrawOpSet;
-	ctx.Brush = NULL;
-	for (row = 0; row < blt->Height; ++row) {
-		for (col = 0; col < blt->Width; ++col) {
-			ctx.Color = blt->Pixels[col + row * blt->Width];
-			BltPoint(canvas, &ctx, x + col, y + row);
-		}
+	UINTN		row;
+	UINTN		width;
+	UINTN		height;
+	if (!canvas || !blt) return EFI_INVALID_PARAMETER;
+	if (x >= canvas->Width || y >= canvas->Height || blt->Width == 0 || blt->Height == 0) return EFI_SUCCESS;
+	width = MIN(blt->Width, canvas->Width - x);
+	height = MIN(blt->Height, canvas->Height - y);
+	BltMarkDirty(canvas, (INT32)x, (INT32)y, (INT32)(x + width - 1), (INT32)(y + height - 1));
+	for (row = 0; row < height; ++row) {
+		CopyMem(&canvas->Pixels[x + (y + row) * canvas->Width], &blt->Pixels[row * blt->Width], width * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
 	}
 	return EFI_SUCCESS;
 }
@@ -181,6 +187,128 @@ RectMarkDirty(
 	return EFI_SUCCESS;
 }
 
+//////////////////////////////////////////////////////////////////////////
+// Dirty rectangles
+// Every primitive marks its bounding box once. Rectangles are merged when
+// union wastes less than BLT_DIRTY_MERGE_WASTE pixels (or list is full),
+// so distant small updates stay separate GOP Blt calls.
+//////////////////////////////////////////////////////////////////////////
+UINTN
+RectArea(
+	IN PRECT rect
+	) {
+	return (UINTN)(rect->right - rect->left + 1) * (rect->bottom - rect->top + 1);
+}
+
+VOID
+RectUnion(
+	IN OUT PRECT rect,
+	IN PRECT add
+	) {
+	if (rect->left > add->left) rect->left = add->left;
+	if (rect->top > add->top) rect->top = add->top;
+	if (rect->right < add->right) rect->right = add->right;
+	if (rect->bottom < add->bottom) rect->bottom = add->bottom;
+}
+
+VOID
+BltMarkDirty(
+	IN OUT BLT_HEADER* blt,
+	IN INT32 x0,
+	IN INT32 y0,
+	IN INT32 x1,
+	IN INT32 y1
+	) {
+	RECT   add;
+	RECT   merged;
+	PRECT  rect;
+	UINTN  i;
+	UINTN  best;
+	INTN   waste;
+	INTN   bestWaste;
+	INT32  t;
+	if (!blt) return;
+	if (x0 > x1) { t = x0; x0 = x1; x1 = t; }
+	if (y0 > y1) { t = y0; y0 = y1; y1 = t; }
+	if (x1 < 0 || y1 < 0 || x0 >= (INT32)blt->Width || y0 >= (INT32)blt->Height) return;
+	add.left = x0 < 0 ? 0 : (UINT32)x0;
+	add.top = y0 < 0 ? 0 : (UINT32)y0;
+	add.right = x1 >= (INT32)blt->Width ? blt->Width - 1 : (UINT32)x1;
+	add.bottom = y1 >= (INT32)blt->Height ? blt->Height - 1 : (UINT32)y1;
+	if (blt->DirtyCount > BLT_DIRTY_MAX) blt->DirtyCount = 0;
+	for (;;) {
+		best = blt->DirtyCount;
+		bestWaste = 0;
+		for (i = 0; i < blt->DirtyCount; ++i) {
+			rect = &blt->Dirty[i];
+			if (rect->left <= add.left && rect->top <= add.top &&
+				rect->right >= add.right && rect->bottom >= add.bottom) {
+				return;
+			}
+			merged = *rect;
+			RectUnion(&merged, &add);
+			waste = (INTN)RectArea(&merged) - (INTN)RectArea(rect) - (INTN)RectArea(&add);
+			if (best == blt->DirtyCount || waste < bestWaste) {
+				best = i;
+				bestWaste = waste;
+			}
+		}
+		if (best == blt->DirtyCount ||
+			(bestWaste > BLT_DIRTY_MERGE_WASTE && blt->DirtyCount < BLT_DIRTY_MAX)) {
+			blt->Dirty[blt->DirtyCount++] = add;
+			return;
+		}
+		// take rectangle out and add union (can touch others now)
+		RectUnion(&add, &blt->Dirty[best]);
+		blt->Dirty[best] = blt->Dirty[--blt->DirtyCount];
+	}
+}
+
+/**
+Box of brush offsets (0,0 - single point)
+*/
+VOID
+BltBrushBox(
+	IN  INT32* brush,
+	OUT INT32* minX,
+	OUT INT32* minY,
+	OUT INT32* maxX,
+	OUT INT32* maxY
+	) {
+	INT32* offset;
+	*minX = *minY = *maxX = *maxY = 0;
+	if (brush == NULL) return;
+	offset = brush;
+	do {
+		*minX = MIN(*minX, offset[0]);
+		*maxX = MAX(*maxX, offset[0]);
+		*minY = MIN(*minY, offset[1]);
+		*maxY = MAX(*maxY, offset[1]);
+		offset += 2;
+	} while (!(offset[0] == 0 && offset[1] == 0));
+}
+
+/**
+Mark bounding box of points drawn with brush of the context
+*/
+VOID
+BltMarkBrush(
+	IN OUT BLT_HEADER* blt,
+	IN PDRAW_CONTEXT draw,
+	IN INT32 x0,
+	IN INT32 y0,
+	IN INT32 x1,
+	IN INT32 y1
+	) {
+	INT32  minX, minY, maxX, maxY;
+	INT32  t;
+	if (!draw) draw = &gDrawContext;
+	if (x0 > x1) { t = x0; x0 = x1; x1 = t; }
+	if (y0 > y1) { t = y0; y0 = y1; y1 = t; }
+	BltBrushBox(draw->Brush, &minX, &minY, &maxX, &maxY);
+	BltMarkDirty(blt, x0 + minX, y0 + minY, x1 + maxX, y1 + maxY);
+}
+
 
 EFI_STATUS
 BltPointSingle(
@@ -191,7 +319,6 @@ BltPointSingle(
 	) {
 	UINTN pos;
 	if (!blt || x >= blt->Width || y >= blt->Height) return EFI_INVALID_PARAMETER;
-	RectMarkDirty(&blt->Dirty, x, y);
 	pos = x + y * blt->Width;
 	if (!draw) draw = &gDrawContext;
 	switch (draw->Op)
@@ -228,23 +355,146 @@ BltPointSingle(
 	return EFI_SUCCESS;
 }
 
+//////////////////////////////////////////////////////////////////////////
+// Spans
+// Clipping and operation select are done once per span
+//////////////////////////////////////////////////////////////////////////
+VOID
+BltPixelsOp(
+	IN OUT EFI_GRAPHICS_OUTPUT_BLT_PIXEL *pixels,
+	IN     UINTN                         count,
+	IN     UINTN                         stride,
+	IN     PDRAW_CONTEXT                 draw
+	) {
+	UINT32	color = *(UINT32*)&draw->Color;
+	UINTN		i;
+	switch (draw->Op)
+	{
+	case DrawOpClear:
+		for (i = 0; i < count; ++i, pixels += stride) *(UINT32*)pixels &= ~color;
+		break;
+	case DrawOpXor:
+		for (i = 0; i < count; ++i, pixels += stride) *(UINT32*)pixels ^= color;
+		break;
+	case DrawOpOr:
+		for (i = 0; i < count; ++i, pixels += stride) *(UINT32*)pixels |= color;
+		break;
+	case DrawOpSet:
+		if (stride == 1) {
+			SetMem32(pixels, count * sizeof(UINT32), color);
+		}	else {
+			for (i = 0; i < count; ++i, pixels += stride) *(UINT32*)pixels = color;
+		}
+		break;
+	case DrawOpAlpha:
+	{
+		INT32	alpha = draw->Alpha;
+		INT32	red = draw->AlphaColor.Red;
+		INT32	green = draw->AlphaColor.Green;
+		INT32	blue = draw->AlphaColor.Blue;
+		for (i = 0; i < count; ++i, pixels += stride) {
+			pixels->Red = (UINT8)(pixels->Red + (((red - pixels->Red) * alpha) >> 8));
+			pixels->Green = (UINT8)(pixels->Green + (((green - pixels->Green) * alpha) >> 8));
+			pixels->Blue = (UINT8)(pixels->Blue + (((blue - pixels->Blue) * alpha) >> 8));
+		}
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+VOID
+BltHSpanOp(
+	IN BLT_HEADER* blt,
+	IN PDRAW_CONTEXT draw,
+	IN INT32 x0,
+	IN INT32 x1,
+	IN INT32 y
+	) {
+	INT32 t;
+	if (!blt) return;
+	if (!draw) draw = &gDrawContext;
+	if (x0 > x1) { t = x0; x0 = x1; x1 = t; }
+	if (y < 0 || y >= (INT32)blt->Height || x1 < 0 || x0 >= (INT32)blt->Width) return;
+	if (x0 < 0) x0 = 0;
+	if (x1 >= (INT32)blt->Width) x1 = (INT32)blt->Width - 1;
+	BltPixelsOp(&blt->Pixels[x0 + y * blt->Width], x1 - x0 + 1, 1, draw);
+}
+
+VOID
+BltVSpanOp(
+	IN BLT_HEADER* blt,
+	IN PDRAW_CONTEXT draw,
+	IN INT32 x,
+	IN INT32 y0,
+	IN INT32 y1
+	) {
+	INT32 t;
+	if (!blt) return;
+	if (!draw) draw = &gDrawContext;
+	if (y0 > y1) { t = y0; y0 = y1; y1 = t; }
+	if (x < 0 || x >= (INT32)blt->Width || y1 < 0 || y0 >= (INT32)blt->Height) return;
+	if (y0 < 0) y0 = 0;
+	if (y1 >= (INT32)blt->Height) y1 = (INT32)blt->Height - 1;
+	BltPixelsOp(&blt->Pixels[x + y0 * blt->Width], y1 - y0 + 1, blt->Width, draw);
+}
+
+VOID
+BltHSpan(
+	IN BLT_HEADER* blt,
+	IN PDRAW_CONTEXT draw,
+	IN INT32 x0,
+	IN INT32 x1,
+	IN INT32 y
+	) {
+	BltMarkDirty(blt, x0, y, x1, y);
+	BltHSpanOp(blt, draw, x0, x1, y);
+}
+
+VOID
+BltVSpan(
+	IN BLT_HEADER* blt,
+	IN PDRAW_CONTEXT draw,
+	IN INT32 x,
+	IN INT32 y0,
+	IN INT32 y1
+	) {
+	BltMarkDirty(blt, x, y0, x, y1);
+	BltVSpanOp(blt, draw, x, y0, y1);
+}
+
+/**
+Draw point with brush. Dirty is marked by caller
+*/
 EFI_STATUS
-BltPoint(
+BltPointOp(
 	IN BLT_HEADER* blt,
 	IN PDRAW_CONTEXT draw,
 	IN UINTN x,
 	IN UINTN y
 	) {
-	if (draw->Brush == NULL) return BltPointSingle(blt, draw, x, y);
-	else
-	{
+	if (!draw) draw = &gDrawContext;
+	if (draw->Brush != NULL) {
 		INT32*	offset = draw->Brush;
 		do {
-			BltPointSingle(blt, draw, x + offset[0], y + +offset[1]);
+			BltPointSingle(blt, draw, x + offset[0], y + offset[1]);
 			offset += 2;
 		} while (!(offset[0] == 0 && offset[1] == 0));
-		return BltPointSingle(blt, draw, x, y);
 	}
+	return BltPointSingle(blt, draw, x, y);
+}
+
+EFI_STATUS
+BltPoint(
+	IN BLT_HEADER* blt,
+	IN PDRAW_CONTEXT draw,
+	IN UINTN x,
+	IN UINTN y
+	) {
+	if (!blt) return EFI_INVALID_PARAMETER;
+	BltMarkBrush(blt, draw, (INT32)x, (INT32)y, (INT32)x, (INT32)y);
+	return BltPointOp(blt, draw, x, y);
 }
 
 VOID
@@ -271,16 +521,22 @@ BltFill(
 	IN INT32 x1,
 	IN INT32 y1) 
 {
-	INT32 x;
-	INT32 y;
-	DRAW_CONTEXT	ctx;
-	ctx.Op = DrawOpSet;
-	ctx.Brush = NULL;
-	ctx.Color = fill;
-	for (y = y0; y < y1; ++y) {
-		for (x = x0; x < x1; ++x) {
-			BltPoint(blt, &ctx, x, y);
-		}
+	INT32  y;
+	UINTN  rowSize;
+	EFI_GRAPHICS_OUTPUT_BLT_PIXEL	*first;
+	if (!blt) return;
+	if (x0 < 0) x0 = 0;
+	if (y0 < 0) y0 = 0;
+	if (x1 > (INT32)blt->Width) x1 = (INT32)blt->Width;
+	if (y1 > (INT32)blt->Height) y1 = (INT32)blt->Height;
+	if (x0 >= x1 || y0 >= y1) return;
+	BltMarkDirty(blt, x0, y0, x1 - 1, y1 - 1);
+	// first row by pattern, next rows are copies
+	first = &blt->Pixels[x0 + y0 * blt->Width];
+	rowSize = (x1 - x0) * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL);
+	SetMem32(first, rowSize, *(UINT32*)&fill);
+	for (y = y0 + 1; y < y1; ++y) {
+		CopyMem(&blt->Pixels[x0 + y * blt->Width], first, rowSize);
 	}
 }
 
@@ -298,12 +554,24 @@ BltLine(
 	UINT32 mask, dmask, cmask;
 	int err = dx + dy, e2;                                   /* error value e_xy */
 	mask = draw ? draw->DashLine : gDrawContext.DashLine;
+	// solid axis aligned line - span
+	if (mask == 0xFFFFFFFF && (draw == NULL || draw->Brush == NULL)) {
+		if (y0 == y1) {
+			BltHSpan(blt, draw, x0, x1, y0);
+			return;
+		}
+		if (x0 == x1) {
+			BltVSpan(blt, draw, x0, y0, y1);
+			return;
+		}
+	}
+	BltMarkBrush(blt, draw, x0, y0, x1, y1);
 	dmask = mask;
 	cmask = 32;
 	for (;;) {                                                          /* loop */
 		// Dash
 		if ((dmask & 1) == 1) {
-			BltPoint(blt, draw, x0, y0);
+			BltPointOp(blt, draw, x0, y0);
 		}
 		dmask >>= 1;
 		cmask--;
@@ -339,24 +607,30 @@ BltCircle(
 	int x = -r, y = 0, err = 2 - 2 * r;                /* bottom left to top right */
 	UINT32 mask, dmask, cmask;
 	mask = draw ? draw->DashLine : gDrawContext.DashLine;
+	BltMarkBrush(blt, draw, xm - r, ym - r, xm + r, ym + r);
 	dmask = mask;
 	cmask = 32;
 	do {
 		if (fill) {
 			if (sx != x) {
-				int i;
-				for (i = ym - y; i <= ym + y; i++) {
-					BltPoint(blt, draw, xm + x, i);
-					if( x != 0 ) BltPoint(blt, draw, xm - x, i);
+				if (draw == NULL || draw->Brush == NULL) {
+					BltVSpanOp(blt, draw, xm + x, ym - y, ym + y);
+					if (x != 0) BltVSpanOp(blt, draw, xm - x, ym - y, ym + y);
+				}	else {
+					int i;
+					for (i = ym - y; i <= ym + y; i++) {
+						BltPointOp(blt, draw, xm + x, i);
+						if (x != 0) BltPointOp(blt, draw, xm - x, i);
+					}
 				}
 				sx = x;
 			}
 		}	else {
 			if ((dmask & 1) == 1) {
-				BltPoint(blt, draw, xm - x, ym + y);                            /*   I. Quadrant +x +y */
-				BltPoint(blt, draw, xm - y, ym - x);                            /*  II. Quadrant -x +y */
-				BltPoint(blt, draw, xm + x, ym - y);                            /* III. Quadrant -x -y */
-				BltPoint(blt, draw, xm + y, ym + x);                            /*  IV. Quadrant +x -y */
+				BltPointOp(blt, draw, xm - x, ym + y);                            /*   I. Quadrant +x +y */
+				BltPointOp(blt, draw, xm - y, ym - x);                            /*  II. Quadrant -x +y */
+				BltPointOp(blt, draw, xm + x, ym - y);                            /* III. Quadrant -x -y */
+				BltPointOp(blt, draw, xm + y, ym + x);                            /*  IV. Quadrant +x -y */
 			}
 			dmask >>= 1;
 			cmask--;
@@ -372,7 +646,312 @@ BltCircle(
 	} while (x <= 0);
 }
 
+//////////////////////////////////////////////////////////////////////////
+// Text
+// Glyphs are rasterized once per scale and brush/dash (or bitmap font)
+// into horizontal spans, text is drawn by spans with context operation.
+// Bitmap font - BMP with 95 cells (ASCII 32..126) in one row, not black
+// pixel is ink. Cell height is scaled to line height (30 * scale / 256).
+//////////////////////////////////////////////////////////////////////////
+#define GLYPH_FIRST        32
+#define GLYPH_COUNT        95
+#define GLYPH_ATLAS_MAX    8
+
+typedef struct _GLYPH_SPAN {
+	INT16    X0;
+	INT16    X1;
+	INT16    Y;
+} GLYPH_SPAN;
+
+typedef struct _GLYPH {
+	BOOLEAN     Ready;
+	INT32       Advance;
+	INT32       Left;       // box of spans relative to pen
+	INT32       Top;
+	INT32       Right;
+	INT32       Bottom;
+	UINTN       SpanCount;
+	GLYPH_SPAN  *Spans;
+} GLYPH;
+
+typedef struct _GLYPH_ATLAS {
+	INT32       Scale;
+	INT32       *Brush;     // compared by pointer (brushes are constant tables)
+	UINT32      DashLine;
+	BLT_HEADER  *Font;
+	GLYPH       Glyphs[GLYPH_COUNT];
+} GLYPH_ATLAS;
+
 extern __int8 gSimplex_ascii_32_126[95][112];
+BLT_HEADER*    gBltFont = NULL;
+GLYPH_ATLAS*   gGlyphAtlas[GLYPH_ATLAS_MAX];
+UINTN          gGlyphAtlasNext = 0;
+
+/**
+Draw vector glyph by strokes. Returns advance
+*/
+INT32
+GlyphStrokes(
+	IN BLT_HEADER* blt,
+	IN PDRAW_CONTEXT draw,
+	IN UINTN idx,
+	IN INT32 posX,
+	IN INT32 posY,
+	IN INT32 scale)
+{
+	INT8 *it = gSimplex_ascii_32_126[idx];
+	INT32 nvtcs = *it++;
+	INT32 spacing = *it++;
+	INT32	fromX = -1;
+	INT32 fromY = -1;
+	INTN i;
+	for (i = 0; i < nvtcs; ++i) {
+		INT32 toX = *it++;
+		INT32 toY = *it++;
+		if ((fromX != -1 || fromY != -1) && (toX != -1 || toY != -1)) {
+			BltLine(
+				blt, draw,
+				posX + ((fromX * scale) >> 8), posY + (((25 - fromY) * scale) >> 8),
+				posX + ((toX * scale) >> 8), posY + (((25 - toY) * scale) >> 8));
+		}
+		fromX = toX;
+		fromY = toY;
+	}
+	return (spacing * scale) >> 8;
+}
+
+/**
+Box of vector glyph vertices relative to pen. Returns advance
+*/
+INT32
+GlyphStrokesBox(
+	IN  UINTN idx,
+	IN  INT32 scale,
+	OUT INT32 *left,
+	OUT INT32 *top,
+	OUT INT32 *right,
+	OUT INT32 *bottom)
+{
+	INT8 *it = gSimplex_ascii_32_126[idx];
+	INT32 nvtcs = *it++;
+	INT32 spacing = *it++;
+	INT32 px, py;
+	INTN i;
+	*left = *top = 0;
+	*right = *bottom = -1;
+	for (i = 0; i < nvtcs; ++i, it += 2) {
+		if (it[0] == -1 && it[1] == -1) continue;
+		px = (it[0] * scale) >> 8;
+		py = ((25 - it[1]) * scale) >> 8;
+		if (*left > *right) {
+			*left = *right = px;
+			*top = *bottom = py;
+		}	else {
+			*left = MIN(*left, px);
+			*right = MAX(*right, px);
+			*top = MIN(*top, py);
+			*bottom = MAX(*bottom, py);
+		}
+	}
+	return (spacing * scale) >> 8;
+}
+
+/**
+Sample bitmap font cell into mask (nearest pixel)
+*/
+VOID
+GlyphSampleFont(
+	IN     BLT_HEADER* font,
+	IN     UINTN       idx,
+	IN OUT BLT_HEADER* mask)
+{
+	UINTN  cellW = font->Width / GLYPH_COUNT;
+	UINTN  x, y, sx, sy;
+	EFI_GRAPHICS_OUTPUT_BLT_PIXEL *src;
+	for (y = 0; y < mask->Height; ++y) {
+		sy = y * font->Height / mask->Height;
+		for (x = 0; x < mask->Width; ++x) {
+			sx = idx * cellW + x * cellW / mask->Width;
+			src = &font->Pixels[sx + sy * font->Width];
+			if ((src->Red | src->Green | src->Blue) != 0) {
+				*(UINT32*)&mask->Pixels[x + y * mask->Width] = 0xFFFFFFFF;
+			}
+		}
+	}
+}
+
+EFI_STATUS
+GlyphRasterize(
+	IN OUT GLYPH_ATLAS* atlas,
+	IN     UINTN        idx)
+{
+	GLYPH          *glyph = &atlas->Glyphs[idx];
+	BLT_HEADER     *mask;
+	DRAW_CONTEXT   ctx;
+	INT32          left, top, right, bottom;
+	INT32          minX, minY, maxX, maxY;
+	INT32          x, y, x0;
+	UINT32         *row;
+	UINTN          count = 0;
+	UINTN          pass;
+
+	glyph->Left = glyph->Top = 0;
+	glyph->Right = glyph->Bottom = -1;
+	if (atlas->Font != NULL) {
+		left = top = 0;
+		bottom = ((30 * atlas->Scale) >> 8) - 1;
+		glyph->Advance = (INT32)((atlas->Font->Width / GLYPH_COUNT) * (bottom + 1) / atlas->Font->Height);
+		right = glyph->Advance - 1;
+	}	else {
+		glyph->Advance = GlyphStrokesBox(idx, atlas->Scale, &left, &top, &right, &bottom);
+		BltBrushBox(atlas->Brush, &minX, &minY, &maxX, &maxY);
+		left += minX;
+		top += minY;
+		right += maxX;
+		bottom += maxY;
+	}
+	if (left > right || top > bottom) {
+		glyph->Ready = TRUE;
+		return EFI_SUCCESS;
+	}
+
+	mask = MEM_ALLOC(sizeof(BLT_HEADER) + (right - left + 1) * (bottom - top + 1) * sizeof(EFI_GRAPHICS_OUTPUT_BLT_PIXEL));
+	if (mask == NULL) return EFI_BUFFER_TOO_SMALL;
+	mask->Width = right - left + 1;
+	mask->Height = bottom - top + 1;
+	if (atlas->Font != NULL) {
+		GlyphSampleFont(atlas->Font, idx, mask);
+	}	else {
+		ZeroMem(&ctx, sizeof(ctx));
+		SetMem(&ctx.Color, sizeof(ctx.Color), 0xFF);
+		ctx.Op = DrawOpSet;
+		ctx.DashLine = atlas->DashLine;
+		ctx.Brush = atlas->Brush;
+		GlyphStrokes(mask, &ctx, idx, -left, -top, atlas->Scale);
+	}
+
+	// Rows to spans (count, then store)
+	for (pass = 0; pass < 2; ++pass) {
+		count = 0;
+		for (y = 0; y < (INT32)mask->Height; ++y) {
+			row = (UINT32*)&mask->Pixels[y * mask->Width];
+			x = 0;
+			while (x < (INT32)mask->Width) {
+				if (row[x] == 0) {
+					x++;
+					continue;
+				}
+				x0 = x;
+				while (x < (INT32)mask->Width && row[x] != 0) x++;
+				if (pass == 1) {
+					glyph->Spans[count].X0 = (INT16)(x0 + left);
+					glyph->Spans[count].X1 = (INT16)(x - 1 + left);
+					glyph->Spans[count].Y = (INT16)(y + top);
+				}
+				count++;
+			}
+		}
+		if (count == 0) break;
+		if (pass == 0) {
+			glyph->Spans = MEM_ALLOC(count * sizeof(GLYPH_SPAN));
+			if (glyph->Spans == NULL) {
+				MEM_FREE(mask);
+				return EFI_BUFFER_TOO_SMALL;
+			}
+		}
+	}
+	MEM_FREE(mask);
+	glyph->SpanCount = count;
+	if (count != 0) {
+		glyph->Left = left;
+		glyph->Top = top;
+		glyph->Right = right;
+		glyph->Bottom = bottom;
+	}
+	glyph->Ready = TRUE;
+	return EFI_SUCCESS;
+}
+
+VOID
+GlyphAtlasFree(
+	IN GLYPH_ATLAS* atlas)
+{
+	UINTN i;
+	if (atlas == NULL) return;
+	for (i = 0; i < GLYPH_COUNT; ++i) {
+		MEM_FREE(atlas->Glyphs[i].Spans);
+	}
+	MEM_FREE(atlas);
+}
+
+/**
+Find or create atlas for text parameters (oldest atlas is replaced)
+*/
+GLYPH_ATLAS*
+GlyphAtlasGet(
+	IN PDRAW_CONTEXT draw,
+	IN INT32 scale)
+{
+	GLYPH_ATLAS  *atlas;
+	INT32        *brush = gBltFont != NULL ? NULL : draw->Brush;
+	UINT32       dash = gBltFont != NULL ? 0 : draw->DashLine;
+	UINTN        i;
+	for (i = 0; i < GLYPH_ATLAS_MAX; ++i) {
+		atlas = gGlyphAtlas[i];
+		if (atlas != NULL && atlas->Scale == scale && atlas->Font == gBltFont &&
+			atlas->Brush == brush && atlas->DashLine == dash) {
+			return atlas;
+		}
+	}
+	atlas = MEM_ALLOC(sizeof(GLYPH_ATLAS));
+	if (atlas == NULL) return NULL;
+	atlas->Scale = scale;
+	atlas->Brush = brush;
+	atlas->DashLine = dash;
+	atlas->Font = gBltFont;
+	GlyphAtlasFree(gGlyphAtlas[gGlyphAtlasNext]);
+	gGlyphAtlas[gGlyphAtlasNext] = atlas;
+	gGlyphAtlasNext = (gGlyphAtlasNext + 1) % GLYPH_ATLAS_MAX;
+	return atlas;
+}
+
+VOID
+BltTextCacheClear()
+{
+	UINTN i;
+	for (i = 0; i < GLYPH_ATLAS_MAX; ++i) {
+		GlyphAtlasFree(gGlyphAtlas[i]);
+		gGlyphAtlas[i] = NULL;
+	}
+	gGlyphAtlasNext = 0;
+}
+
+EFI_STATUS
+BltFontLoad(
+	IN CHAR16* fileName)
+{
+	EFI_STATUS   res;
+	VOID         *bmp = NULL;
+	UINTN        bmpSize = 0;
+	BLT_HEADER   *font = NULL;
+	if (fileName != NULL) {
+		res = FileLoad(NULL, fileName, &bmp, &bmpSize);
+		if (EFI_ERROR(res)) return res;
+		res = BmpToBlt(bmp, bmpSize, &font);
+		MEM_FREE(bmp);
+		if (EFI_ERROR(res)) return res;
+		if (font == NULL) return EFI_BUFFER_TOO_SMALL;
+		if (font->Width < GLYPH_COUNT || font->Height == 0) {
+			MEM_FREE(font);
+			return EFI_UNSUPPORTED;
+		}
+	}
+	BltTextCacheClear();
+	MEM_FREE(gBltFont);
+	gBltFont = font;
+	return EFI_SUCCESS;
+}
+
 VOID
 BltText(
 	IN BLT_HEADER* blt,
@@ -382,37 +961,61 @@ BltText(
 	IN INT32 scale, // 0..256 reduce 256... enlarge
 	IN CONST CHAR8 *text)
 {
-	INT32	posX = x;
-	INT32 posY = y;
-	const char *c;
-	for (c = text; *c; ++c)
-	{
-		INT8 ch = *c;
-		if (ch >= 32 && ch <= 126) {
-			INT8 *it = gSimplex_ascii_32_126[ch - 32];
-			INT32 nvtcs = *it++;
-			INT32 spacing = *it++;
-			INT32	fromX = -1;
-			INT32 fromY = -1;
-			INTN i;
-			for (i = 0; i < nvtcs; ++i) {
-				INT32 toX = *it++;
-				INT32 toY = *it++;
-				if ((fromX != -1 || fromY != -1) && (toX != -1 || toY != -1)) {
-					BltLine(
-						blt, draw,
-						posX + ((fromX * scale) >> 8), posY + (((25 - fromY) * scale) >> 8),
-						posX + ((toX * scale) >> 8), posY + (((25 - toY) * scale) >> 8));
+	GLYPH_ATLAS  *atlas;
+	GLYPH        *glyph;
+	GLYPH_SPAN   *span;
+	CONST CHAR8  *c;
+	INT32        posX;
+	INT32        posY;
+	INT32        left = 0, top = 0, right = -1, bottom = -1;
+	UINTN        pass;
+	UINTN        i;
+	if (!blt || !text) return;
+	if (!draw) draw = &gDrawContext;
+	atlas = GlyphAtlasGet(draw, scale);
+	for (pass = 0; pass < 2; ++pass) {
+		posX = x;
+		posY = y;
+		for (c = text; *c; ++c)
+		{
+			INT8 ch = *c;
+			if (ch >= GLYPH_FIRST && ch < GLYPH_FIRST + GLYPH_COUNT) {
+				if (atlas == NULL) {
+					// no memory for atlas - strokes
+					if (pass == 1) posX += GlyphStrokes(blt, draw, ch - GLYPH_FIRST, posX, posY, scale);
+					continue;
 				}
-				fromX = toX;
-				fromY = toY;
+				glyph = &atlas->Glyphs[ch - GLYPH_FIRST];
+				if (pass == 0) {
+					if (!glyph->Ready) GlyphRasterize(atlas, ch - GLYPH_FIRST);
+					if (glyph->SpanCount != 0) {
+						if (left > right) {
+							left = posX + glyph->Left;
+							top = posY + glyph->Top;
+							right = posX + glyph->Right;
+							bottom = posY + glyph->Bottom;
+						}	else {
+							left = MIN(left, posX + glyph->Left);
+							top = MIN(top, posY + glyph->Top);
+							right = MAX(right, posX + glyph->Right);
+							bottom = MAX(bottom, posY + glyph->Bottom);
+						}
+					}
+				}	else {
+					for (i = 0, span = glyph->Spans; i < glyph->SpanCount; ++i, ++span) {
+						BltHSpanOp(blt, draw, posX + span->X0, posX + span->X1, posY + span->Y);
+					}
+				}
+				posX += glyph->Advance;
+			}
+			// Next line
+			if (ch == '\n') {
+				posX = x;
+				posY += 30 * scale >> 8;
 			}
-			posX += (spacing * scale) >> 8;
 		}
-		// Next line
-		if (ch == '\n') {
-			posX = x;
-			posY += 30 * scale >> 8;
+		if (pass == 0 && left <= right) {
+			BltMarkDirty(blt, left, top, right, bottom);
 		}
 	}
 }
@@ -22,6 +22,7 @@ https://opensource.org/licenses/LGPL-3.0
 #include <Library/PasswordLib.h>
 
 CHAR16*	gPasswordPictureFileName = NULL;
+CHAR16*	gPasswordFontFileName = NULL;
 
 CHAR8*	gPasswordPictureChars = NULL;
 CHAR8*	gPasswordPictureCharsDefault = "MN/[aQ-eyPr}GT: |V^UqiI_gbdA9YwZ%f8t6S@D\"7uXl\\30R#+zH*,W4J?=&BLFv]hx~E;$<.o'sp1`(>C)O{!5j2nmkcK";
@@ -43,6 +44,11 @@ CONST CHAR16* BmpName = L"Test.bmp";
 VOID*		Bmp = NULL;
 UINTN		BmpSize = 0;
 BLT_HEADER*	bltPwd = NULL;
+BLT_HEADER*	bltPict = NULL;			// decoded picture
+BLT_HEADER*	bltPwdBase = NULL;		// picture and grid without selection
+UINTN			bltPwdBaseStep = 0;
+UINT8			bltPwdBaseVisible = 0;
+BOOLEAN		FontLoaded = FALSE;
 UINTN		   posPictX, posPictY;
 BLT_HEADER*	bltScrn = NULL;
 UINTN*		cellSelected = NULL;
@@ -181,28 +187,59 @@ DrawPwdZone(
 	}
 }
 
+/**
+Picture with grid of not selected cells. BMP is decoded once, grid is
+drawn again only if cell size or chars visibility changed
+*/
 EFI_STATUS
-DrawPwdPicture()
+PwdPictureBase()
 {
 	EFI_STATUS   res;
-	UINTN		    idx;
 	UINTN		    cellX, cellY;
 
-	if (bltPwd != NULL) MEM_FREE(bltPwd);
-
-	res = BmpToBlt(Bmp, BmpSize, &bltPwd);
-	if (EFI_ERROR(res)) {
-		return res;
+	if (bltPwdBase != NULL && bltPwdBaseStep == step && bltPwdBaseVisible == gPasswordVisible) {
+		return EFI_SUCCESS;
+	}
+	if (bltPict == NULL) {
+		res = BmpToBlt(Bmp, BmpSize, &bltPict);
+		if (EFI_ERROR(res)) {
+			return res;
+		}
+	}
+	if (bltPwdBase == NULL) {
+		bltPwdBase = MEM_ALLOC(BLT_SIZE(bltPict));
+		if (bltPwdBase == NULL) return EFI_BUFFER_TOO_SMALL;
 	}
+	CopyMem(bltPwdBase, bltPict, BLT_SIZE(bltPict));
 	cellY = 0;
 	do {
 		cellX = 0;
 		do {
-			CellUpdate(bltPwd, cellX, cellY, FALSE);
+			CellUpdate(bltPwdBase, cellX, cellY, FALSE);
 			cellX++;
-		} while ((cellX + 1) * step <= (bltPwd->Width));
+		} while ((cellX + 1) * step <= (bltPwdBase->Width));
 		cellY++;
-	} while ((cellY + 1)* step <= (bltPwd->Height));
+	} while ((cellY + 1)* step <= (bltPwdBase->Height));
+	bltPwdBaseStep = step;
+	bltPwdBaseVisible = gPasswordVisible;
+	return EFI_SUCCESS;
+}
+
+EFI_STATUS
+DrawPwdPicture()
+{
+	EFI_STATUS   res;
+	UINTN		    idx;
+
+	res = PwdPictureBase();
+	if (EFI_ERROR(res)) {
+		return res;
+	}
+	if (bltPwd == NULL) {
+		bltPwd = MEM_ALLOC(BLT_SIZE(bltPwdBase));
+		if (bltPwd == NULL) return EFI_BUFFER_TOO_SMALL;
+	}
+	CopyMem(bltPwd, bltPwdBase, BLT_SIZE(bltPwdBase));
 
 	// Update selected
 	for (idx = 0; idx < picPwdIdx; ++idx) {
@@ -293,6 +330,13 @@ AskPictPwdInt(
 			return;
 		}
 	}
+	if (!FontLoaded && gPasswordFontFileName != NULL) {
+		FontLoaded = TRUE;
+		res = BltFontLoad(gPasswordFontFileName);
+		if (EFI_ERROR(res)) {
+			ERR_PRINT(L"Font load - %r\n", res);
+		}
+	}
 	// Init draws
 	CreateDraws();
 
@@ -387,6 +431,7 @@ AskPictPwdInt(
 			if (EFI_ERROR(res)) {
 				continue;
 			}
+			KeyStrokeTimeAdd();
 		}
 		// OUT_PRINT(L" \r%05d %05d", (UINT32)curX, (UINT32)curY, );
 		// recharge timeout event and stop beep
@@ -499,6 +544,7 @@ AskPictPwdInt(
 		if (EventIndex == 2) {
 			res = gTouchPointer->GetState(gTouchPointer, &aps);
 			if (!EFI_ERROR(res)) {
+				KeyStrokeTimeAdd();
 				curX = (UINTN)(aps.CurrentX * sWidth / (gTouchPointer->Mode->AbsoluteMaxX - gTouchPointer->Mode->AbsoluteMinX));
 				curY = (UINTN)(aps.CurrentY * sHeight / (gTouchPointer->Mode->AbsoluteMaxY - gTouchPointer->Mode->AbsoluteMinY));
 			}
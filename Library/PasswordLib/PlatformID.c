@@ -194,7 +194,7 @@ PlatformGetIDCRC(
 	if (EFI_ERROR(res)) {
 		return res;
 	}
-	res = gBS->CalculateCrc32(crcBuf, crcLen, crc32);
+	*crc32 = EfiCrc32(crcBuf, crcLen);
 	MEM_FREE(crcBuf);
 	return res;
 }
@@ -219,8 +219,7 @@ PlatformGetAuthDataByType(
 		res = bio->ReadBlocks(bio, bio->Media->MediaId, 61, 512, mark);
 		if (EFI_ERROR(res)) continue;
 		
-		res = gBS->CalculateCrc32(&mark->PlatformCrc, sizeof(*mark) - 4, &crc);
-		if (EFI_ERROR(res)) continue;
+		crc = EfiCrc32(&mark->PlatformCrc, sizeof(*mark) - 4);
 		if( crc != mark->HeaderCrc) continue;
 		
 		res = PlatformGetIDCRC(gBIOHandles[gBioIndexAuth], &crc);
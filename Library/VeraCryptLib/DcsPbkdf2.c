@@ -0,0 +1,830 @@
+/** @file
+Multi-buffer PBKDF2-HMAC-SHA-512/SHA-256 for DCS
+
+Copyright (c) 2016. Disk Cryptography Services for EFI (DCS), Alex Kolotnikov
+
+This program and the accompanying materials
+are licensed and made available under the terms and conditions
+of the Apache License, Version 2.0.
+
+The full text of the license may be found at
+https://opensource.org/licenses/Apache-2.0
+
+One password, several salts (headers). Every output block of every salt is
+independent PBKDF2 stream. DCS_PBKDF2_LANES streams run in lockstep, one per
+lane of compression kernel. Kernel is selected from CPUID of the running
+CPU on X64: SHA-512 with AVX2 or SSE2 lanes, SHA-256 with SHA extensions
+or SSE2 lanes. IA32 and CPUs without SSE2 use interleaved C lanes.
+**/
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+
+#if defined(MDE_CPU_X64) && defined(_MSC_VER)
+#include <immintrin.h>
+#endif
+
+#include "common/Tcdefs.h"
+#include "DcsPbkdf2.h"
+
+#define LANES                DCS_PBKDF2_LANES
+#define DCS_PBKDF2_MSG_MAX   256
+// cancel is polled every DCS_PBKDF2_CANCEL_MASK + 1 iterations
+#define DCS_PBKDF2_CANCEL_MASK  0xFFF
+
+#define DCS_SHA512_BLOCK     128
+#define DCS_SHA512_DIGEST    64
+#define DCS_SHA256_BLOCK     64
+#define DCS_SHA256_DIGEST    32
+
+STATIC CONST UINT64 K512[80] = {
+	0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+	0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+	0xd807aa98a3030242ULL, 0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+	0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+	0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+	0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+	0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+	0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL, 0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+	0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+	0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+	0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+	0xd192e819d6ef5218ULL, 0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+	0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+	0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+	0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+	0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+	0xca273eceea26619cULL, 0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+	0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+	0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+	0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+};
+
+STATIC CONST UINT64 IV512[8] = {
+	0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+	0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+};
+
+STATIC CONST UINT32 K256[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+STATIC CONST UINT32 IV256[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Word operations
+// P##_OP for word type P: C64/C32 scalar words, Q2/Q4 (SHA-512) and
+// D4 (SHA-256) vectors with one lane per element. GCC vectors need no
+// intrinsic headers (GCC builds are -mno-sse); kernels enable instruction
+// sets with target() only.
+//////////////////////////////////////////////////////////////////////////
+#define C64_ADD(a, b)   ((a) + (b))
+#define C64_XOR(a, b)   ((a) ^ (b))
+#define C64_AND(a, b)   ((a) & (b))
+#define C64_OR(a, b)    ((a) | (b))
+#define C64_SHR(x, n)   ((x) >> (n))
+#define C64_SHL(x, n)   ((x) << (n))
+#define C64_SET(k)      (k)
+#define C64_T           UINT64
+#define C64_LD(p)       (*(p))
+#define C64_ST(p, v)    (*(p) = (v))
+
+#define C32_ADD   C64_ADD
+#define C32_XOR   C64_XOR
+#define C32_AND   C64_AND
+#define C32_OR    C64_OR
+#define C32_SHR   C64_SHR
+#define C32_SHL   C64_SHL
+#define C32_SET   C64_SET
+#define C32_T     UINT32
+#define C32_LD    C64_LD
+#define C32_ST    C64_ST
+
+#if defined(MDE_CPU_X64) && defined(__GNUC__)
+#define DCS_PBKDF2_SIMD
+#define DCS_PBKDF2_AVX2
+#define DCS_PBKDF2_SHANI
+#define DCS_TARGET(x)   __attribute__((target(x)))
+
+typedef UINT64 DCS_V2Q __attribute__((vector_size(16), aligned(8), __may_alias__));
+typedef UINT64 DCS_V4Q __attribute__((vector_size(32), aligned(8), __may_alias__));
+typedef UINT32 DCS_V4D __attribute__((vector_size(16), aligned(4), __may_alias__));
+typedef INT32  DCS_V4S __attribute__((vector_size(16)));
+
+#define Q2_ADD    C64_ADD
+#define Q2_XOR    C64_XOR
+#define Q2_AND    C64_AND
+#define Q2_OR     C64_OR
+#define Q2_SHR    C64_SHR
+#define Q2_SHL    C64_SHL
+#define Q2_SET    C64_SET
+#define Q2_T      DCS_V2Q
+#define Q2_LD(p)       (*(CONST DCS_V2Q*)(p))
+#define Q2_ST(p, v)    (*(DCS_V2Q*)(p) = (v))
+
+#define Q4_ADD    C64_ADD
+#define Q4_XOR    C64_XOR
+#define Q4_AND    C64_AND
+#define Q4_OR     C64_OR
+#define Q4_SHR    C64_SHR
+#define Q4_SHL    C64_SHL
+#define Q4_SET    C64_SET
+#define Q4_T      DCS_V4Q
+#define Q4_LD(p)       (*(CONST DCS_V4Q*)(p))
+#define Q4_ST(p, v)    (*(DCS_V4Q*)(p) = (v))
+
+#define D4_ADD    C64_ADD
+#define D4_XOR    C64_XOR
+#define D4_AND    C64_AND
+#define D4_OR     C64_OR
+#define D4_SHR    C64_SHR
+#define D4_SHL    C64_SHL
+#define D4_SET    C64_SET
+#define D4_T      DCS_V4D
+#define D4_LD(p)       (*(CONST DCS_V4D*)(p))
+#define D4_ST(p, v)    (*(DCS_V4D*)(p) = (v))
+
+// SHA-NI, 4 x 32 bits (element 0 first)
+#define NI_SET(a, b, c, d)  ((DCS_V4D){a, b, c, d})
+#define NI_GET(v, n)        ((v)[n])
+#define NI_LD(p)            (*(CONST DCS_V4D*)(p))
+#define NI_ADD(a, b)        ((a) + (b))
+#define NI_HIGH(a)          __builtin_shuffle(a, (DCS_V4D){2, 3, 2, 3})
+#define NI_ALIGNR4(a, b)    __builtin_shuffle(b, a, (DCS_V4D){1, 2, 3, 4})
+#define NI_RNDS2(c, a, k)   ((DCS_V4D)__builtin_ia32_sha256rnds2((DCS_V4S)(c), (DCS_V4S)(a), (DCS_V4S)(k)))
+#define NI_MSG1(a, b)       ((DCS_V4D)__builtin_ia32_sha256msg1((DCS_V4S)(a), (DCS_V4S)(b)))
+#define NI_MSG2(a, b)       ((DCS_V4D)__builtin_ia32_sha256msg2((DCS_V4S)(a), (DCS_V4S)(b)))
+typedef DCS_V4D DCS_NI;
+
+#elif defined(MDE_CPU_X64) && defined(_MSC_VER)
+#define DCS_PBKDF2_SIMD
+#if _MSC_VER >= 1900
+#define DCS_PBKDF2_AVX2
+#define DCS_PBKDF2_SHANI
+#endif
+#define DCS_TARGET(x)
+
+#define Q2_ADD         _mm_add_epi64
+#define Q2_XOR         _mm_xor_si128
+#define Q2_AND         _mm_and_si128
+#define Q2_OR          _mm_or_si128
+#define Q2_SHR         _mm_srli_epi64
+#define Q2_SHL         _mm_slli_epi64
+#define Q2_SET(k)      _mm_set1_epi64x((INT64)(k))
+#define Q2_T           __m128i
+#define Q2_LD(p)       _mm_loadu_si128((CONST __m128i*)(p))
+#define Q2_ST(p, v)    _mm_storeu_si128((__m128i*)(p), v)
+
+#define Q4_ADD         _mm256_add_epi64
+#define Q4_XOR         _mm256_xor_si256
+#define Q4_AND         _mm256_and_si256
+#define Q4_OR          _mm256_or_si256
+#define Q4_SHR         _mm256_srli_epi64
+#define Q4_SHL         _mm256_slli_epi64
+#define Q4_SET(k)      _mm256_set1_epi64x((INT64)(k))
+#define Q4_T           __m256i
+#define Q4_LD(p)       _mm256_loadu_si256((CONST __m256i*)(p))
+#define Q4_ST(p, v)    _mm256_storeu_si256((__m256i*)(p), v)
+
+#define D4_ADD         _mm_add_epi32
+#define D4_XOR         _mm_xor_si128
+#define D4_AND         _mm_and_si128
+#define D4_OR          _mm_or_si128
+#define D4_SHR         _mm_srli_epi32
+#define D4_SHL         _mm_slli_epi32
+#define D4_SET(k)      _mm_set1_epi32((INT32)(k))
+#define D4_T           __m128i
+#define D4_LD(p)       _mm_loadu_si128((CONST __m128i*)(p))
+#define D4_ST(p, v)    _mm_storeu_si128((__m128i*)(p), v)
+
+#define NI_SET(a, b, c, d)  _mm_set_epi32((INT32)(d), (INT32)(c), (INT32)(b), (INT32)(a))
+#define NI_GET(v, n)        ((UINT32)_mm_cvtsi128_si32(_mm_shuffle_epi32(v, n)))
+#define NI_LD(p)            _mm_loadu_si128((CONST __m128i*)(p))
+#define NI_ADD              _mm_add_epi32
+#define NI_HIGH(a)          _mm_shuffle_epi32(a, 0x0E)
+#define NI_ALIGNR4(a, b)    _mm_alignr_epi8(a, b, 4)
+#define NI_RNDS2            _mm_sha256rnds2_epu32
+#define NI_MSG1             _mm_sha256msg1_epu32
+#define NI_MSG2             _mm_sha256msg2_epu32
+typedef __m128i DCS_NI;
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+// SHA-2 rounds
+//////////////////////////////////////////////////////////////////////////
+#define ROR(P, x, n, b)   P##_OR(P##_SHR(x, n), P##_SHL(x, (b) - (n)))
+#define CH(P, x, y, z)    P##_XOR(z, P##_AND(x, P##_XOR(y, z)))
+#define MAJ(P, x, y, z)   P##_OR(P##_AND(x, y), P##_AND(z, P##_OR(x, y)))
+
+#define S512_0(P, x)  P##_XOR(P##_XOR(ROR(P, x, 28, 64), ROR(P, x, 34, 64)), ROR(P, x, 39, 64))
+#define S512_1(P, x)  P##_XOR(P##_XOR(ROR(P, x, 14, 64), ROR(P, x, 18, 64)), ROR(P, x, 41, 64))
+#define G512_0(P, x)  P##_XOR(P##_XOR(ROR(P, x, 1, 64), ROR(P, x, 8, 64)), P##_SHR(x, 7))
+#define G512_1(P, x)  P##_XOR(P##_XOR(ROR(P, x, 19, 64), ROR(P, x, 61, 64)), P##_SHR(x, 6))
+
+#define S256_0(P, x)  P##_XOR(P##_XOR(ROR(P, x, 2, 32), ROR(P, x, 13, 32)), ROR(P, x, 22, 32))
+#define S256_1(P, x)  P##_XOR(P##_XOR(ROR(P, x, 6, 32), ROR(P, x, 11, 32)), ROR(P, x, 25, 32))
+#define G256_0(P, x)  P##_XOR(P##_XOR(ROR(P, x, 7, 32), ROR(P, x, 18, 32)), P##_SHR(x, 3))
+#define G256_1(P, x)  P##_XOR(P##_XOR(ROR(P, x, 17, 32), ROR(P, x, 19, 32)), P##_SHR(x, 10))
+
+// Working variable j of round i (variables are renamed, not moved)
+#define SV(s, j, i)   (s)[((j) - (i)) & 7]
+
+#define ROUND(P, s, i, k, w, S0, S1) { \
+	t1 = P##_ADD(P##_ADD(P##_ADD(SV(s, 7, i), S1(P, SV(s, 4, i))), P##_ADD(CH(P, SV(s, 4, i), SV(s, 5, i), SV(s, 6, i)), k)), w); \
+	t2 = P##_ADD(S0(P, SV(s, 0, i)), MAJ(P, SV(s, 0, i), SV(s, 1, i), SV(s, 2, i))); \
+	SV(s, 3, i) = P##_ADD(SV(s, 3, i), t1); \
+	SV(s, 7, i) = P##_ADD(t1, t2); \
+}
+
+// Message schedule in 16 words ring
+#define SCHEDULE(P, x, t, G0, G1) \
+	x[(t) & 15] = P##_ADD(P##_ADD(x[(t) & 15], G1(P, x[((t) - 2) & 15])), P##_ADD(x[((t) - 7) & 15], G0(P, x[((t) - 15) & 15])))
+
+#define STEP(P, NL, t, i, K, S0, S1, G0, G1) \
+	for (l = 0; l < NL; ++l) { \
+		if ((t) + (i) >= 16) SCHEDULE(P, x[l], (t) + (i), G0, G1); \
+		ROUND(P, s[l], i, P##_SET(K[(t) + (i)]), x[l][((t) + (i)) & 15], S0, S1); \
+	}
+
+/**
+One block from lane base on. NL words of type P##_T run interleaved
+(independent chains for scalar C kernels).
+*/
+#define BLOCK_BODY(P, NL, base, R, K, S0, S1, G0, G1) { \
+	P##_T  s[NL][8]; \
+	P##_T  x[NL][16]; \
+	P##_T  t1, t2; \
+	UINTN  i, t, l; \
+	for (l = 0; l < NL; ++l) { \
+		for (i = 0; i < 8; ++i) s[l][i] = P##_LD(&h[i][(base) + l]); \
+		for (i = 0; i < 16; ++i) x[l][i] = P##_LD(&w[i][(base) + l]); \
+	} \
+	for (t = 0; t < R; t += 8) { \
+		STEP(P, NL, t, 0, K, S0, S1, G0, G1); \
+		STEP(P, NL, t, 1, K, S0, S1, G0, G1); \
+		STEP(P, NL, t, 2, K, S0, S1, G0, G1); \
+		STEP(P, NL, t, 3, K, S0, S1, G0, G1); \
+		STEP(P, NL, t, 4, K, S0, S1, G0, G1); \
+		STEP(P, NL, t, 5, K, S0, S1, G0, G1); \
+		STEP(P, NL, t, 6, K, S0, S1, G0, G1); \
+		STEP(P, NL, t, 7, K, S0, S1, G0, G1); \
+	} \
+	for (l = 0; l < NL; ++l) { \
+		for (i = 0; i < 8; ++i) P##_ST(&h[i][(base) + l], P##_ADD(P##_LD(&h[i][(base) + l]), s[l][i])); \
+	} \
+}
+
+#define SHA512_BLOCK_BODY(P, NL, base) BLOCK_BODY(P, NL, base, 80, K512, S512_0, S512_1, G512_0, G512_1)
+#define SHA256_BLOCK_BODY(P, NL, base) BLOCK_BODY(P, NL, base, 64, K256, S256_0, S256_1, G256_0, G256_1)
+
+//////////////////////////////////////////////////////////////////////////
+// Compression kernels (state and message words are [word][lane])
+//////////////////////////////////////////////////////////////////////////
+typedef VOID (*SHA512_MB_BLOCK)(UINT64 h[8][LANES], CONST UINT64 w[16][LANES]);
+typedef VOID (*SHA256_MB_BLOCK)(UINT32 h[8][LANES], CONST UINT32 w[16][LANES]);
+
+STATIC VOID
+Sha512MbBlockC(
+	IN OUT UINT64        h[8][LANES],
+	IN     CONST UINT64  w[16][LANES])
+{
+	SHA512_BLOCK_BODY(C64, LANES, 0)
+}
+
+STATIC VOID
+Sha256MbBlockC(
+	IN OUT UINT32        h[8][LANES],
+	IN     CONST UINT32  w[16][LANES])
+{
+	SHA256_BLOCK_BODY(C32, LANES, 0)
+}
+
+#if defined(DCS_PBKDF2_SIMD)
+/**
+Two 64-bit lanes per SSE register, two passes
+*/
+DCS_TARGET("sse2")
+STATIC VOID
+Sha512MbBlockSse2(
+	IN OUT UINT64        h[8][LANES],
+	IN     CONST UINT64  w[16][LANES])
+{
+	UINTN  b;
+	for (b = 0; b < LANES; b += 2) {
+		SHA512_BLOCK_BODY(Q2, 1, b)
+	}
+}
+
+DCS_TARGET("sse2")
+STATIC VOID
+Sha256MbBlockSse2(
+	IN OUT UINT32        h[8][LANES],
+	IN     CONST UINT32  w[16][LANES])
+{
+	SHA256_BLOCK_BODY(D4, 1, 0)
+}
+
+#if defined(DCS_PBKDF2_AVX2)
+DCS_TARGET("avx2")
+STATIC VOID
+Sha512MbBlockAvx2(
+	IN OUT UINT64        h[8][LANES],
+	IN     CONST UINT64  w[16][LANES])
+{
+	SHA512_BLOCK_BODY(Q4, 1, 0)
+#if defined(_MSC_VER)
+	_mm256_zeroupper();
+#endif
+}
+#endif
+
+#if defined(DCS_PBKDF2_SHANI)
+// Four rounds; a is ABEF, c is CDGH (F, E, B, A and H, G, D, C from element 0)
+#define NI_ROUNDS4(a, c, m) { \
+	c = NI_RNDS2(c, a, m); \
+	a = NI_RNDS2(a, c, NI_HIGH(m)); \
+}
+
+// W[t..t+3] from W[t-16..t-13] (m0), W[t-12..] (m1), W[t-8..] (m2), W[t-4..] (m3)
+#define NI_SCHEDULE(m0, m1, m2, m3) \
+	m0 = NI_MSG2(NI_ADD(NI_MSG1(m0, m1), NI_ALIGNR4(m3, m2)), m3)
+
+/**
+SHA extensions work on one lane; two lanes run interleaved.
+*/
+DCS_TARGET("sse4.1,sha")
+STATIC VOID
+Sha256MbBlockShaNi(
+	IN OUT UINT32        h[8][LANES],
+	IN     CONST UINT32  w[16][LANES])
+{
+	DCS_NI  a0, c0, a1, c1;
+	DCS_NI  sa0, sc0, sa1, sc1;
+	DCS_NI  m0[4], m1[4];
+	DCS_NI  k;
+	UINTN   l, t, j;
+
+	for (l = 0; l < LANES; l += 2) {
+		a0 = NI_SET(h[5][l], h[4][l], h[1][l], h[0][l]);
+		c0 = NI_SET(h[7][l], h[6][l], h[3][l], h[2][l]);
+		a1 = NI_SET(h[5][l + 1], h[4][l + 1], h[1][l + 1], h[0][l + 1]);
+		c1 = NI_SET(h[7][l + 1], h[6][l + 1], h[3][l + 1], h[2][l + 1]);
+		for (j = 0; j < 4; ++j) {
+			m0[j] = NI_SET(w[j * 4][l], w[j * 4 + 1][l], w[j * 4 + 2][l], w[j * 4 + 3][l]);
+			m1[j] = NI_SET(w[j * 4][l + 1], w[j * 4 + 1][l + 1], w[j * 4 + 2][l + 1], w[j * 4 + 3][l + 1]);
+		}
+		sa0 = a0; sc0 = c0;
+		sa1 = a1; sc1 = c1;
+		for (t = 0; t < 64; t += 4) {
+			j = (t / 4) & 3;
+			if (t >= 16) {
+				NI_SCHEDULE(m0[j], m0[(j + 1) & 3], m0[(j + 2) & 3], m0[(j + 3) & 3]);
+				NI_SCHEDULE(m1[j], m1[(j + 1) & 3], m1[(j + 2) & 3], m1[(j + 3) & 3]);
+			}
+			k = NI_LD(&K256[t]);
+			NI_ROUNDS4(a0, c0, NI_ADD(m0[j], k));
+			NI_ROUNDS4(a1, c1, NI_ADD(m1[j], k));
+		}
+		a0 = NI_ADD(a0, sa0); c0 = NI_ADD(c0, sc0);
+		a1 = NI_ADD(a1, sa1); c1 = NI_ADD(c1, sc1);
+		h[0][l] = NI_GET(a0, 3); h[1][l] = NI_GET(a0, 2); h[4][l] = NI_GET(a0, 1); h[5][l] = NI_GET(a0, 0);
+		h[2][l] = NI_GET(c0, 3); h[3][l] = NI_GET(c0, 2); h[6][l] = NI_GET(c0, 1); h[7][l] = NI_GET(c0, 0);
+		h[0][l + 1] = NI_GET(a1, 3); h[1][l + 1] = NI_GET(a1, 2); h[4][l + 1] = NI_GET(a1, 1); h[5][l + 1] = NI_GET(a1, 0);
+		h[2][l + 1] = NI_GET(c1, 3); h[3][l + 1] = NI_GET(c1, 2); h[6][l + 1] = NI_GET(c1, 1); h[7][l + 1] = NI_GET(c1, 0);
+	}
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+// Kernel selection (CPUID of the running CPU, no VeraCrypt detection state)
+//////////////////////////////////////////////////////////////////////////
+#define DCS_CPU_SSE2          BIT0
+#define DCS_CPU_AVX2          BIT1
+#define DCS_CPU_SHA           BIT2
+
+#define CPUID1_EDX_SSE2       BIT26
+#define CPUID1_ECX_SSE41      BIT19
+#define CPUID1_ECX_OSXSAVE    BIT27
+#define CPUID1_ECX_AVX        BIT28
+#define CPUID7_EBX_AVX2       BIT5
+#define CPUID7_EBX_SHA        BIT29
+#define XCR0_SSE_AVX          (BIT1 | BIT2)
+
+STATIC UINT64
+DcsXGetBv0()
+{
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	UINT32 lo, hi;
+	__asm__ __volatile__(".byte 0x0f, 0x01, 0xd0" : "=a"(lo), "=d"(hi) : "c"(0));
+	return ((UINT64)hi << 32) | lo;
+#endif
+}
+
+STATIC UINT32
+DcsPbkdf2Cpu()
+{
+	UINT32 maxLeaf = 0;
+	UINT32 ecx = 0, edx = 0, ebx7 = 0;
+	UINT32 cpu = 0;
+
+	AsmCpuid(0, &maxLeaf, NULL, NULL, NULL);
+	AsmCpuid(1, NULL, NULL, &ecx, &edx);
+	if (maxLeaf >= 7) {
+		AsmCpuidEx(7, 0, NULL, &ebx7, NULL, NULL);
+	}
+	if ((edx & CPUID1_EDX_SSE2) == 0) return 0;
+	cpu |= DCS_CPU_SSE2;
+	if ((ecx & CPUID1_ECX_SSE41) != 0 && (ebx7 & CPUID7_EBX_SHA) != 0) {
+		cpu |= DCS_CPU_SHA;
+	}
+	if ((ecx & CPUID1_ECX_OSXSAVE) != 0 && (ecx & CPUID1_ECX_AVX) != 0 && (ebx7 & CPUID7_EBX_AVX2) != 0 &&
+		(DcsXGetBv0() & XCR0_SSE_AVX) == XCR0_SSE_AVX) {
+		cpu |= DCS_CPU_AVX2;
+	}
+	return cpu;
+}
+#endif
+
+STATIC SHA512_MB_BLOCK
+Sha512MbSelect()
+{
+#if defined(DCS_PBKDF2_SIMD)
+	UINT32 cpu = DcsPbkdf2Cpu();
+#if defined(DCS_PBKDF2_AVX2)
+	if (cpu & DCS_CPU_AVX2) return Sha512MbBlockAvx2;
+#endif
+	if (cpu & DCS_CPU_SSE2) return Sha512MbBlockSse2;
+#endif
+	return Sha512MbBlockC;
+}
+
+STATIC SHA256_MB_BLOCK
+Sha256MbSelect()
+{
+#if defined(DCS_PBKDF2_SIMD)
+	UINT32 cpu = DcsPbkdf2Cpu();
+#if defined(DCS_PBKDF2_SHANI)
+	if (cpu & DCS_CPU_SHA) return Sha256MbBlockShaNi;
+#endif
+	if (cpu & DCS_CPU_SSE2) return Sha256MbBlockSse2;
+#endif
+	return Sha256MbBlockC;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// SHA-512
+//////////////////////////////////////////////////////////////////////////
+/**
+Continue hash in all lanes with len bytes of msgs[lane] and final padding.
+prev bytes were already compressed.
+*/
+STATIC VOID
+Sha512MbFinal(
+	IN OUT UINT64           h[8][LANES],
+	IN     CONST UINT8      *msgs[LANES],
+	IN     UINTN            len,
+	IN     UINTN            prev,
+	IN     SHA512_MB_BLOCK  block)
+{
+	UINT8   buf[LANES][DCS_PBKDF2_MSG_MAX];
+	UINT64  w[16][LANES];
+	UINT64  bits = (UINT64)(prev + len) * 8;
+	UINTN   blocks = (len + 1 + 16 + DCS_SHA512_BLOCK - 1) / DCS_SHA512_BLOCK;
+	UINTN   n, i, l;
+
+	for (l = 0; l < LANES; ++l) {
+		ZeroMem(buf[l], blocks * DCS_SHA512_BLOCK);
+		CopyMem(buf[l], msgs[l], len);
+		buf[l][len] = 0x80;
+		WriteUnaligned64((UINT64*)(buf[l] + blocks * DCS_SHA512_BLOCK - 8), SwapBytes64(bits));
+	}
+	for (n = 0; n < blocks; ++n) {
+		for (i = 0; i < 16; ++i) {
+			for (l = 0; l < LANES; ++l) {
+				w[i][l] = SwapBytes64(ReadUnaligned64((UINT64*)(buf[l] + n * DCS_SHA512_BLOCK + i * 8)));
+			}
+		}
+		block(h, w);
+	}
+	burn(buf, sizeof(buf));
+	burn(w, sizeof(w));
+}
+
+/**
+One HMAC key pad block compressed from IV (same in all lanes)
+*/
+STATIC VOID
+Sha512MbPad(
+	OUT UINT64           h[8][LANES],
+	IN  CONST UINT8      *key,
+	IN  UINT8            pad,
+	IN  SHA512_MB_BLOCK  block)
+{
+	UINT64  w[16][LANES];
+	UINTN   i, l;
+
+	for (i = 0; i < 8; ++i) {
+		for (l = 0; l < LANES; ++l) h[i][l] = IV512[i];
+	}
+	for (i = 0; i < 16; ++i) {
+		UINT64 k = SwapBytes64(ReadUnaligned64((UINT64*)(key + i * 8))) ^ MultU64x32(0x0101010101010101ULL, pad);
+		for (l = 0; l < LANES; ++l) w[i][l] = k;
+	}
+	block(h, w);
+	burn(w, sizeof(w));
+}
+
+/**
+PBKDF2-HMAC-SHA-512 of one password with count salts. Output blocks of all
+salts are spread over lanes. EFI_ABORTED (dks are incomplete) if *cancel is
+set during derivation.
+*/
+EFI_STATUS
+DcsPbkdf2Sha512Mb(
+	IN  CONST UINT8      *pwd,
+	IN  UINTN            pwdLen,
+	IN  CONST UINT8      **salts,
+	IN  UINTN            saltLen,
+	IN  UINTN            count,
+	IN  UINT32           iterations,
+	OUT UINT8            **dks,
+	IN  UINTN            dkLen,
+	IN  volatile UINT32  *cancel OPTIONAL)
+{
+	EFI_STATUS       res = EFI_SUCCESS;
+	SHA512_MB_BLOCK  block = Sha512MbSelect();
+	UINT8            key[DCS_SHA512_BLOCK];
+	UINT8            msg[LANES][DCS_PBKDF2_MSG_MAX];
+	CONST UINT8      *msgs[LANES];
+	UINT64           istate[8][LANES];
+	UINT64           ostate[8][LANES];
+	UINT64           h[8][LANES];
+	UINT64           u[8][LANES];
+	UINT64           f[8][LANES];
+	UINT64           w[16][LANES];
+	UINTN            blocks = (dkLen + DCS_SHA512_DIGEST - 1) / DCS_SHA512_DIGEST;
+	UINTN            streams = count * blocks;
+	UINTN            s, i, l, it;
+
+	if (iterations == 0 || pwdLen > DCS_PBKDF2_MSG_MAX - 17 || saltLen + 4 > DCS_PBKDF2_MSG_MAX - 17) {
+		return EFI_INVALID_PARAMETER;
+	}
+
+	// HMAC key
+	ZeroMem(key, sizeof(key));
+	if (pwdLen > DCS_SHA512_BLOCK) {
+		for (i = 0; i < 8; ++i) {
+			for (l = 0; l < LANES; ++l) h[i][l] = IV512[i];
+		}
+		for (l = 0; l < LANES; ++l) msgs[l] = pwd;
+		Sha512MbFinal(h, msgs, pwdLen, 0, block);
+		for (i = 0; i < 8; ++i) WriteUnaligned64((UINT64*)(key + i * 8), SwapBytes64(h[i][0]));
+	}	else {
+		CopyMem(key, pwd, pwdLen);
+	}
+	Sha512MbPad(istate, key, 0x36, block);
+	Sha512MbPad(ostate, key, 0x5C, block);
+
+	// Digest block padding (key block + digest)
+	for (i = 8; i < 16; ++i) {
+		for (l = 0; l < LANES; ++l) w[i][l] = 0;
+	}
+	for (l = 0; l < LANES; ++l) {
+		w[8][l] = 0x8000000000000000ULL;
+		w[15][l] = (DCS_SHA512_BLOCK + DCS_SHA512_DIGEST) * 8;
+	}
+
+	for (s = 0; s < streams; s += LANES) {
+		// Lane l takes stream s + l (spare lanes repeat stream s)
+		for (l = 0; l < LANES; ++l) {
+			UINTN st = (s + l < streams) ? s + l : s;
+			CopyMem(msg[l], salts[st / blocks], saltLen);
+			WriteUnaligned32((UINT32*)(msg[l] + saltLen), SwapBytes32((UINT32)(st % blocks + 1)));
+			msgs[l] = msg[l];
+		}
+
+		// U1
+		CopyMem(h, istate, sizeof(h));
+		Sha512MbFinal(h, msgs, saltLen + 4, DCS_SHA512_BLOCK, block);
+		CopyMem(w, h, sizeof(h));
+		CopyMem(u, ostate, sizeof(u));
+		block(u, w);
+		CopyMem(f, u, sizeof(f));
+
+		// U2..Uc
+		for (it = 1; it < iterations; ++it) {
+			if ((it & DCS_PBKDF2_CANCEL_MASK) == 0 && cancel != NULL && *cancel) break;
+			CopyMem(w, u, sizeof(u));
+			CopyMem(h, istate, sizeof(h));
+			block(h, w);
+			CopyMem(w, h, sizeof(h));
+			CopyMem(u, ostate, sizeof(u));
+			block(u, w);
+			for (i = 0; i < 8; ++i) {
+				for (l = 0; l < LANES; ++l) f[i][l] ^= u[i][l];
+			}
+		}
+		if (it < iterations) {
+			res = EFI_ABORTED;
+			break;
+		}
+
+		for (l = 0; l < LANES && s + l < streams; ++l) {
+			UINT8  out[DCS_SHA512_DIGEST];
+			UINTN  offset = ((s + l) % blocks) * DCS_SHA512_DIGEST;
+			for (i = 0; i < 8; ++i) WriteUnaligned64((UINT64*)(out + i * 8), SwapBytes64(f[i][l]));
+			CopyMem(dks[(s + l) / blocks] + offset, out, MIN(DCS_SHA512_DIGEST, dkLen - offset));
+			burn(out, sizeof(out));
+		}
+	}
+
+	burn(key, sizeof(key));
+	burn(msg, sizeof(msg));
+	burn(istate, sizeof(istate));
+	burn(ostate, sizeof(ostate));
+	burn(h, sizeof(h));
+	burn(u, sizeof(u));
+	burn(f, sizeof(f));
+	burn(w, sizeof(w));
+	return res;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// SHA-256
+//////////////////////////////////////////////////////////////////////////
+STATIC VOID
+Sha256MbFinal(
+	IN OUT UINT32           h[8][LANES],
+	IN     CONST UINT8      *msgs[LANES],
+	IN     UINTN            len,
+	IN     UINTN            prev,
+	IN     SHA256_MB_BLOCK  block)
+{
+	UINT8   buf[LANES][DCS_PBKDF2_MSG_MAX];
+	UINT32  w[16][LANES];
+	UINT64  bits = (UINT64)(prev + len) * 8;
+	UINTN   blocks = (len + 1 + 8 + DCS_SHA256_BLOCK - 1) / DCS_SHA256_BLOCK;
+	UINTN   n, i, l;
+
+	for (l = 0; l < LANES; ++l) {
+		ZeroMem(buf[l], blocks * DCS_SHA256_BLOCK);
+		CopyMem(buf[l], msgs[l], len);
+		buf[l][len] = 0x80;
+		WriteUnaligned64((UINT64*)(buf[l] + blocks * DCS_SHA256_BLOCK - 8), SwapBytes64(bits));
+	}
+	for (n = 0; n < blocks; ++n) {
+		for (i = 0; i < 16; ++i) {
+			for (l = 0; l < LANES; ++l) {
+				w[i][l] = SwapBytes32(ReadUnaligned32((UINT32*)(buf[l] + n * DCS_SHA256_BLOCK + i * 4)));
+			}
+		}
+		block(h, w);
+	}
+	burn(buf, sizeof(buf));
+	burn(w, sizeof(w));
+}
+
+STATIC VOID
+Sha256MbPad(
+	OUT UINT32           h[8][LANES],
+	IN  CONST UINT8      *key,
+	IN  UINT8            pad,
+	IN  SHA256_MB_BLOCK  block)
+{
+	UINT32  w[16][LANES];
+	UINTN   i, l;
+
+	for (i = 0; i < 8; ++i) {
+		for (l = 0; l < LANES; ++l) h[i][l] = IV256[i];
+	}
+	for (i = 0; i < 16; ++i) {
+		UINT32 k = SwapBytes32(ReadUnaligned32((UINT32*)(key + i * 4))) ^ (0x01010101 * pad);
+		for (l = 0; l < LANES; ++l) w[i][l] = k;
+	}
+	block(h, w);
+	burn(w, sizeof(w));
+}
+
+/**
+PBKDF2-HMAC-SHA-256 of one password with count salts. Output blocks of all
+salts are spread over lanes. EFI_ABORTED (dks are incomplete) if *cancel is
+set during derivation.
+*/
+EFI_STATUS
+DcsPbkdf2Sha256Mb(
+	IN  CONST UINT8      *pwd,
+	IN  UINTN            pwdLen,
+	IN  CONST UINT8      **salts,
+	IN  UINTN            saltLen,
+	IN  UINTN            count,
+	IN  UINT32           iterations,
+	OUT UINT8            **dks,
+	IN  UINTN            dkLen,
+	IN  volatile UINT32  *cancel OPTIONAL)
+{
+	EFI_STATUS       res = EFI_SUCCESS;
+	SHA256_MB_BLOCK  block = Sha256MbSelect();
+	UINT8            key[DCS_SHA256_BLOCK];
+	UINT8            msg[LANES][DCS_PBKDF2_MSG_MAX];
+	CONST UINT8      *msgs[LANES];
+	UINT32           istate[8][LANES];
+	UINT32           ostate[8][LANES];
+	UINT32           h[8][LANES];
+	UINT32           u[8][LANES];
+	UINT32           f[8][LANES];
+	UINT32           w[16][LANES];
+	UINTN            blocks = (dkLen + DCS_SHA256_DIGEST - 1) / DCS_SHA256_DIGEST;
+	UINTN            streams = count * blocks;
+	UINTN            s, i, l, it;
+
+	if (iterations == 0 || pwdLen > DCS_PBKDF2_MSG_MAX - 9 || saltLen + 4 > DCS_PBKDF2_MSG_MAX - 9) {
+		return EFI_INVALID_PARAMETER;
+	}
+
+	// HMAC key
+	ZeroMem(key, sizeof(key));
+	if (pwdLen > DCS_SHA256_BLOCK) {
+		for (i = 0; i < 8; ++i) {
+			for (l = 0; l < LANES; ++l) h[i][l] = IV256[i];
+		}
+		for (l = 0; l < LANES; ++l) msgs[l] = pwd;
+		Sha256MbFinal(h, msgs, pwdLen, 0, block);
+		for (i = 0; i < 8; ++i) WriteUnaligned32((UINT32*)(key + i * 4), SwapBytes32(h[i][0]));
+	}	else {
+		CopyMem(key, pwd, pwdLen);
+	}
+	Sha256MbPad(istate, key, 0x36, block);
+	Sha256MbPad(ostate, key, 0x5C, block);
+
+	// Digest block padding (key block + digest)
+	for (i = 8; i < 16; ++i) {
+		for (l = 0; l < LANES; ++l) w[i][l] = 0;
+	}
+	for (l = 0; l < LANES; ++l) {
+		w[8][l] = 0x80000000;
+		w[15][l] = (DCS_SHA256_BLOCK + DCS_SHA256_DIGEST) * 8;
+	}
+
+	for (s = 0; s < streams; s += LANES) {
+		for (l = 0; l < LANES; ++l) {
+			UINTN st = (s + l < streams) ? s + l : s;
+			CopyMem(msg[l], salts[st / blocks], saltLen);
+			WriteUnaligned32((UINT32*)(msg[l] + saltLen), SwapBytes32((UINT32)(st % blocks + 1)));
+			msgs[l] = msg[l];
+		}
+
+		CopyMem(h, istate, sizeof(h));
+		Sha256MbFinal(h, msgs, saltLen + 4, DCS_SHA256_BLOCK, block);
+		CopyMem(w, h, sizeof(h));
+		CopyMem(u, ostate, sizeof(u));
+		block(u, w);
+		CopyMem(f, u, sizeof(f));
+
+		for (it = 1; it < iterations; ++it) {
+			if ((it & DCS_PBKDF2_CANCEL_MASK) == 0 && cancel != NULL && *cancel) break;
+			CopyMem(w, u, sizeof(u));
+			CopyMem(h, istate, sizeof(h));
+			block(h, w);
+			CopyMem(w, h, sizeof(h));
+			CopyMem(u, ostate, sizeof(u));
+			block(u, w);
+			for (i = 0; i < 8; ++i) {
+				for (l = 0; l < LANES; ++l) f[i][l] ^= u[i][l];
+			}
+		}
+		if (it < iterations) {
+			res = EFI_ABORTED;
+			break;
+		}
+
+		for (l = 0; l < LANES && s + l < streams; ++l) {
+			UINT8  out[DCS_SHA256_DIGEST];
+			UINTN  offset = ((s + l) % blocks) * DCS_SHA256_DIGEST;
+			for (i = 0; i < 8; ++i) WriteUnaligned32((UINT32*)(out + i * 4), SwapBytes32(f[i][l]));
+			CopyMem(dks[(s + l) / blocks] + offset, out, MIN(DCS_SHA256_DIGEST, dkLen - offset));
+			burn(out, sizeof(out));
+		}
+	}
+
+	burn(key, sizeof(key));
+	burn(msg, sizeof(msg));
+	burn(istate, sizeof(istate));
+	burn(ostate, sizeof(ostate));
+	burn(h, sizeof(h));
+	burn(u, sizeof(u));
+	burn(f, sizeof(f));
+	burn(w, sizeof(w));
+	return res;
+}
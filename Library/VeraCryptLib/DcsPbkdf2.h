@@ -0,0 +1,45 @@
+/** @file
+Multi-buffer PBKDF2 for DCS
+
+Copyright (c) 2016. Disk Cryptography Services for EFI (DCS), Alex Kolotnikov
+
+This program and the accompanying materials
+are licensed and made available under the terms and conditions
+of the Apache License, Version 2.0.
+
+The full text of the license may be found at
+https://opensource.org/licenses/Apache-2.0
+**/
+
+#ifndef __DCSPBKDF2_H__
+#define __DCSPBKDF2_H__
+
+#include <Uefi.h>
+
+#define DCS_PBKDF2_LANES  4
+
+EFI_STATUS
+DcsPbkdf2Sha512Mb(
+	IN  CONST UINT8      *pwd,
+	IN  UINTN            pwdLen,
+	IN  CONST UINT8      **salts,
+	IN  UINTN            saltLen,
+	IN  UINTN            count,
+	IN  UINT32           iterations,
+	OUT UINT8            **dks,
+	IN  UINTN            dkLen,
+	IN  volatile UINT32  *cancel OPTIONAL);
+
+EFI_STATUS
+DcsPbkdf2Sha256Mb(
+	IN  CONST UINT8      *pwd,
+	IN  UINTN            pwdLen,
+	IN  CONST UINT8      **salts,
+	IN  UINTN            saltLen,
+	IN  UINTN            count,
+	IN  UINT32           iterations,
+	OUT UINT8            **dks,
+	IN  UINTN            dkLen,
+	IN  volatile UINT32  *cancel OPTIONAL);
+
+#endif
@@ -20,12 +20,16 @@ https://opensource.org/licenses/Apache-2.0
 #include <Library/GraphLib.h>
 #include <Library/PasswordLib.h>
 #include <Library/DcsCfgLib.h>
+#include <Library/SynchronizationLib.h>
+#include <Protocol/MpService.h>
 
 #include <common/Password.h>
 #include "common/Crypto.h"
 #include "common/Xml.h"
 #include "common/Crc.h"
+#include "common/Volumes.h"
 #include "BootCommon.h"
+#include "DcsPbkdf2.h"
 
 //////////////////////////////////////////////////////////////////////////
 // Config
@@ -105,6 +109,11 @@ int gAuthPwdCode = 1;
 INT32 gRUD = 0;
 
 int gAuthSecRegionSearch = 0;
+int gAuthParallel = 1;
+int gAuthHint = 0;
+int gAuthTpmSlot = -1;
+int gAuthTpmPcrs = 0x195;
+int gAuthTpmPin = 0;
 
 CHAR8* gPlatformKeyFile = NULL;
 UINTN gPlatformKeyFileSize = 0;
@@ -135,6 +144,11 @@ VCAuthLoadConfig()
 		gPasswordPictureFileName = MEM_ALLOC(MAX_MSG * 2);
 		ConfigReadString("PasswordPicture", "\\EFI\\VeraCrypt\\login.bmp", passwordPictureAscii, MAX_MSG);
 		AsciiStrToUnicodeStr(passwordPictureAscii, gPasswordPictureFileName);
+		ConfigReadString("PasswordFont", "", passwordPictureAscii, MAX_MSG);
+		if (passwordPictureAscii[0] != 0) {
+			gPasswordFontFileName = MEM_ALLOC(MAX_MSG * 2);
+			AsciiStrToUnicodeStr(passwordPictureAscii, gPasswordFontFileName);
+		}
 		MEM_FREE(passwordPictureAscii);
 	}
 	SetMem(&gAuthPassword, sizeof(gAuthPassword), 0);
@@ -145,6 +159,23 @@ VCAuthLoadConfig()
 	gTPMLocked = ConfigReadInt("TPMLocked", 0);
 	gSCLocked = ConfigReadInt("SCLocked", 0);
 	gDcsBootForce = ConfigReadInt("DcsBootForce", 1);
+	gAuthParallel = ConfigReadInt("AuthParallel", 1);
+	gAuthHint = ConfigReadInt("AuthHint", 0);
+	gAuthSpeculate = ConfigReadInt("AuthSpeculate", 1);
+	gAuthTpmSlot = ConfigReadInt("TpmSlot", -1);
+	gAuthTpmPcrs = ConfigReadInt("TpmPcrs", 0x195); // PCR 0,2,4,7,8
+	gAuthTpmPin = ConfigReadInt("TpmPin", 0);
+
+	{
+		char* keyFilesAscii = NULL;
+		keyFilesAscii = MEM_ALLOC(MAX_MSG);
+		ConfigReadString("KeyFiles", "", keyFilesAscii, MAX_MSG);
+		if (keyFilesAscii[0] != 0) {
+			gKeyFiles = MEM_ALLOC(MAX_MSG * 2);
+			AsciiStrToUnicodeStr(keyFilesAscii, gKeyFiles);
+		}
+		MEM_FREE(keyFilesAscii);
+	}
 
 	// Actions for DcsInt
 	gOnExitSuccess = MEM_ALLOC(MAX_MSG);
@@ -248,38 +279,51 @@ VOID
 VCAskPwd(
 	IN	 UINTN	pwdType,
 	OUT Password* vcPwd) {
+	EFI_STATUS res;
 	if (gAuthPasswordMsg == NULL) VCAuthLoadConfig();
-	if (gAuthPasswordType == 1 &&
-		gGraphOut != NULL &&
-		((gTouchPointer != NULL) || (gTouchSimulate != 0))) {
-		AskPictPwdInt(pwdType, sizeof(vcPwd->Text), vcPwd->Text, &vcPwd->Length, &gAuthPwdCode);
-	}	else {
-		switch (pwdType) {
-		case AskPwdNew:
-			OUT_PRINT(L"New password:");
-			break;
-		case AskPwdConfirm:
-			OUT_PRINT(L"Confirm password:");
-			break;
-		case AskPwdLogin:
-		default:
-			OUT_PRINT(L"%a", gAuthPasswordMsg);
-			break;
+	do {
+		if (gAuthPasswordType == 1 &&
+			gGraphOut != NULL &&
+			((gTouchPointer != NULL) || (gTouchSimulate != 0))) {
+			AskPictPwdInt(pwdType, sizeof(vcPwd->Text), vcPwd->Text, &vcPwd->Length, &gAuthPwdCode);
+		}	else {
+			switch (pwdType) {
+			case AskPwdNew:
+				OUT_PRINT(L"New password:");
+				break;
+			case AskPwdConfirm:
+				OUT_PRINT(L"Confirm password:");
+				break;
+			case AskPwdLogin:
+			default:
+				OUT_PRINT(L"%a", gAuthPasswordMsg);
+				break;
+			}
+			AskConsolePwdInt(&vcPwd->Length, vcPwd->Text, &gAuthPwdCode, sizeof(vcPwd->Text), gPasswordVisible);
 		}
-		AskConsolePwdInt(&vcPwd->Length, vcPwd->Text, &gAuthPwdCode, sizeof(vcPwd->Text), gPasswordVisible);
-	}
 
-	if (gAuthPwdCode == AskPwdRetCancel) {
-		return;
-	}
+		if (gAuthPwdCode == AskPwdRetCancel) {
+			return;
+		}
 
-	if (gPlatformLocked) {
-		if (gPlatformKeyFile == NULL) {
-			ERR_PRINT(L"Platform key file absent\n");
-		}	else {
-			ApplyKeyFile(vcPwd, gPlatformKeyFile, gPlatformKeyFileSize);
+		if (gPlatformLocked) {
+			if (gPlatformKeyFile == NULL) {
+				ERR_PRINT(L"Platform key file absent\n");
+			}	else {
+				ApplyKeyFile(vcPwd, gPlatformKeyFile, gPlatformKeyFileSize);
+			}
 		}
-	}
+
+		res = EFI_SUCCESS;
+		if (gKeyFiles != NULL) {
+			res = ApplyKeyFiles(vcPwd, gKeyFiles);
+			if (EFI_ERROR(res)) {
+				// never try header without all key files - ask again
+				burn(vcPwd, sizeof(*vcPwd));
+				ERR_PRINT(L"Key files not applied: %r\n", res);
+			}
+		}
+	} while (EFI_ERROR(res));
 
 	if (gTPMLocked) {
 		// TO DO
@@ -295,6 +339,7 @@ VCAuthAsk()
 	if (gAuthPwdCode == AskPwdRetCancel) {
 		return;
 	}
+	AuthSpecStart();
 
 	if (gAuthPimRqt) {
 		gAuthPim = AskInt(gAuthPimMsg, gPasswordVisible);
@@ -312,17 +357,830 @@ VCAuthAsk()
 			gAuthHash = AskInt(gAuthHashMsg, gPasswordVisible);
 		} while (gAuthHash < 0 || gAuthHash > 4);
 	}
+	AuthSpecFinish();
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+// Parallel header decrypt
+//////////////////////////////////////////////////////////////////////////
+// Key derivations are spread over application processors (MP services).
+// APs can not call boot services, so VeraCrypt allocations made on a
+// processor during a run come from its own preallocated arena.
+// SHA-512 and SHA-256 tries are grouped in units and their keys are derived
+// in lockstep (DcsPbkdf2). HeaderKeyOpen finishes them with derived keys.
+#define HEADER_TRY_ARENA_SIZE (256 * 1024)
+
+typedef struct _HEADER_TRY_ARENA {
+	UINT8            *Base;
+	UINTN            Used;
+} HEADER_TRY_ARENA;
+
+typedef struct _HEADER_TRY_UNIT {
+	UINT32           Count;
+	UINT32           Idx[DCS_PBKDF2_LANES];
+} HEADER_TRY_UNIT;
+
+typedef struct _HEADER_TRY_JOBS {
+	BOOL             Boot;
+	Password         *Pwd;
+	int              Pim;
+	BOOL             Tc;
+	DCS_HEADER_TRY   *Tries;
+	UINT32           Count;
+	HEADER_TRY_UNIT  *Units;
+	UINT32           UnitCount;
+	BOOLEAN          StopOnFound;
+	volatile UINT32  Next;
+	volatile UINT32  Found;
+	volatile UINT32  Cancel;
+	EFI_EVENT        *Events;
+	UINTN            Started;
+} HEADER_TRY_JOBS;
+
+EFI_MP_SERVICES_PROTOCOL  *gHeaderTryMp = NULL;
+HEADER_TRY_ARENA          *gHeaderTryArenas = NULL;
+UINTN                     gHeaderTryArenasCount = 0;
+
+HEADER_TRY_ARENA*
+HeaderTryArena()
+{
+	UINTN cpu;
+	if (gHeaderTryArenas == NULL) return NULL;
+	if (EFI_ERROR(gHeaderTryMp->WhoAmI(gHeaderTryMp, &cpu))) return NULL;
+	if (cpu >= gHeaderTryArenasCount || gHeaderTryArenas[cpu].Base == NULL) return NULL;
+	return &gHeaderTryArenas[cpu];
+}
+
+BOOLEAN
+HeaderTryArenaOwns(
+	IN VOID* ptr)
+{
+	UINTN i;
+	if (gHeaderTryArenas == NULL) return FALSE;
+	for (i = 0; i < gHeaderTryArenasCount; ++i) {
+		UINT8* base = gHeaderTryArenas[i].Base;
+		if (base != NULL && (UINT8*)ptr >= base && (UINT8*)ptr < base + HEADER_TRY_ARENA_SIZE) return TRUE;
+	}
+	return FALSE;
+}
+
+VOID
+HeaderTryFound(
+	IN OUT HEADER_TRY_JOBS  *jobs,
+	IN     UINT32           idx)
+{
+	UINT32 cur;
+	do {
+		cur = jobs->Found;
+		if (cur <= idx) return;
+	} while (InterlockedCompareExchange32(&jobs->Found, cur, idx) != cur);
+}
+
+/**
+Lane group of prf (0 - SHA-512, 1 - SHA-256) or -1 if keys are derived one by one
+*/
+int
+HeaderTryLaneKind(
+	IN int   prf,
+	IN BOOL  tc)
+{
+	if (tc) return -1;
+	if (prf == SHA512) return 0;
+	if (prf == SHA256) return 1;
+	return -1;
+}
+
+/**
+Split tries in units. Tries of same PRF are grouped by up to DCS_PBKDF2_LANES,
+but not more than needed to keep all workers busy.
+*/
+VOID
+HeaderTryUnitsBuild(
+	IN OUT HEADER_TRY_JOBS  *jobs,
+	IN     UINTN            workers)
+{
+	UINT32  n[2] = { 0, 0 };
+	UINT32  per[2];
+	UINT32  open[2];
+	UINT32  i;
+	int     k;
+
+	for (i = 0; i < jobs->Count; ++i) {
+		k = HeaderTryLaneKind(jobs->Tries[i].Prf, jobs->Tc);
+		if (k >= 0) n[k]++;
+	}
+	for (k = 0; k < 2; ++k) {
+		per[k] = (UINT32)((n[k] + workers - 1) / workers);
+		if (per[k] > DCS_PBKDF2_LANES) per[k] = DCS_PBKDF2_LANES;
+		open[k] = jobs->Count;
+	}
+
+	jobs->UnitCount = 0;
+	for (i = 0; i < jobs->Count; ++i) {
+		HEADER_TRY_UNIT *unit;
+		k = HeaderTryLaneKind(jobs->Tries[i].Prf, jobs->Tc);
+		if (k >= 0 && per[k] > 1 && open[k] < jobs->UnitCount && jobs->Units[open[k]].Count < per[k]) {
+			unit = &jobs->Units[open[k]];
+		}	else {
+			if (k >= 0) open[k] = jobs->UnitCount;
+			unit = &jobs->Units[jobs->UnitCount++];
+			unit->Count = 0;
+		}
+		unit->Idx[unit->Count++] = i;
+	}
+}
+
+/**
+ReadVolumeHeader for already derived header key dk (VeraCrypt mode): same
+checks of decrypted header and same CRYPTO_INFO results.
+*/
+int
+HeaderKeyOpen(
+	IN  char           *encryptedHeader,
+	IN  UINT8          *dk,
+	IN  int            prf,
+	IN  int            iterations,
+	IN  int            pim,
+	OUT PCRYPTO_INFO   *retInfo,
+	OUT CRYPTO_INFO    *retHeaderCryptoInfo)
+{
+	UINT8         header[TC_VOLUME_HEADER_EFFECTIVE_SIZE];
+	PCRYPTO_INFO  cryptoInfo;
+	UINT16        headerVersion;
+	int           status;
+
+	if (retHeaderCryptoInfo != NULL) {
+		cryptoInfo = retHeaderCryptoInfo;
+	}	else {
+		cryptoInfo = *retInfo = crypto_open();
+		if (cryptoInfo == NULL) return ERR_OUTOFMEMORY;
+	}
+
+	cryptoInfo->mode = XTS;
+	for (cryptoInfo->ea = EAGetFirst(); cryptoInfo->ea != 0; cryptoInfo->ea = EAGetNext(cryptoInfo->ea)) {
+		if (!EAIsModeSupported(cryptoInfo->ea, cryptoInfo->mode)) continue;
+		status = EAInit(cryptoInfo->ea, dk, cryptoInfo->ks);
+		if (status == ERR_CIPHER_INIT_FAILURE) goto err;
+		CopyMem(cryptoInfo->k2, dk + EAGetKeySize(cryptoInfo->ea), EAGetKeySize(cryptoInfo->ea));
+		if (!EAInitMode(cryptoInfo)) {
+			status = ERR_MODE_INIT_FAILED;
+			goto err;
+		}
+
+		CopyMem(header, encryptedHeader, sizeof(header));
+		DecryptBuffer(header + HEADER_ENCRYPTED_DATA_OFFSET, HEADER_ENCRYPTED_DATA_SIZE, cryptoInfo);
+		if (GetHeaderField32(header, TC_HEADER_OFFSET_MAGIC) != 0x56455241) continue;
+
+		headerVersion = GetHeaderField16(header, TC_HEADER_OFFSET_VERSION);
+		if (headerVersion > VOLUME_HEADER_VERSION) {
+			status = ERR_NEW_VERSION_REQUIRED;
+			goto err;
+		}
+		if (headerVersion >= 4 &&
+			GetHeaderField32(header, TC_HEADER_OFFSET_HEADER_CRC) != GetCrc32(header + TC_HEADER_OFFSET_MAGIC, TC_HEADER_OFFSET_HEADER_CRC - TC_HEADER_OFFSET_MAGIC)) {
+			continue;
+		}
+		cryptoInfo->RequiredProgramVersion = GetHeaderField16(header, TC_HEADER_OFFSET_REQUIRED_VERSION);
+		cryptoInfo->LegacyVolume = cryptoInfo->RequiredProgramVersion < 0x10b;
+		if (GetHeaderField32(header, TC_HEADER_OFFSET_KEY_AREA_CRC) != GetCrc32(header + HEADER_MASTER_KEYDATA_OFFSET, MASTER_KEYDATA_SIZE)) {
+			continue;
+		}
+		if (cryptoInfo->RequiredProgramVersion > VERSION_NUM) {
+			status = ERR_NEW_VERSION_REQUIRED;
+			goto err;
+		}
+
+		cryptoInfo->HeaderVersion = headerVersion;
+		cryptoInfo->hiddenVolumeSize = GetHeaderField64(header, TC_HEADER_OFFSET_HIDDEN_VOLUME_SIZE).Value;
+		cryptoInfo->hiddenVolume = (cryptoInfo->hiddenVolumeSize != 0);
+		cryptoInfo->VolumeSize = GetHeaderField64(header, TC_HEADER_OFFSET_VOLUME_SIZE);
+		cryptoInfo->EncryptedAreaStart = GetHeaderField64(header, TC_HEADER_OFFSET_ENCRYPTED_AREA_START);
+		cryptoInfo->EncryptedAreaLength = GetHeaderField64(header, TC_HEADER_OFFSET_ENCRYPTED_AREA_LENGTH);
+		cryptoInfo->HeaderFlags = GetHeaderField32(header, TC_HEADER_OFFSET_FLAGS);
+		cryptoInfo->SectorSize = headerVersion >= 5 ? GetHeaderField32(header, TC_HEADER_OFFSET_SECTOR_SIZE) : TC_SECTOR_SIZE_LEGACY;
+		if (cryptoInfo->SectorSize < TC_MIN_VOLUME_SECTOR_SIZE ||
+			cryptoInfo->SectorSize > TC_MAX_VOLUME_SECTOR_SIZE ||
+			cryptoInfo->SectorSize % ENCRYPTION_DATA_UNIT_SIZE != 0) {
+			status = ERR_PARAMETER_INCORRECT;
+			goto err;
+		}
+
+		// Header keys stay in retHeaderCryptoInfo
+		if (retHeaderCryptoInfo != NULL) {
+			cryptoInfo = *retInfo = crypto_open();
+			if (cryptoInfo == NULL) {
+				status = ERR_OUTOFMEMORY;
+				goto err;
+			}
+			CopyMem(cryptoInfo, retHeaderCryptoInfo, sizeof(*cryptoInfo));
+		}
+
+		CopyMem(cryptoInfo->master_keydata, header + HEADER_MASTER_KEYDATA_OFFSET, MASTER_KEYDATA_SIZE);
+		CopyMem(cryptoInfo->salt, encryptedHeader + HEADER_SALT_OFFSET, PKCS5_SALT_SIZE);
+		cryptoInfo->pkcs5 = prf;
+		cryptoInfo->noIterations = iterations;
+		cryptoInfo->bTrueCryptMode = FALSE;
+		cryptoInfo->volumePim = pim;
+
+		status = EAInit(cryptoInfo->ea, cryptoInfo->master_keydata, cryptoInfo->ks);
+		if (status == ERR_CIPHER_INIT_FAILURE) goto err;
+		CopyMem(cryptoInfo->k2, cryptoInfo->master_keydata + EAGetKeySize(cryptoInfo->ea), EAGetKeySize(cryptoInfo->ea));
+		if (!EAInitMode(cryptoInfo)) {
+			status = ERR_MODE_INIT_FAILED;
+			goto err;
+		}
+		status = ERR_SUCCESS;
+		goto ret;
+	}
+	status = ERR_PASSWORD_WRONG;
+
+err:
+	if (cryptoInfo != retHeaderCryptoInfo) {
+		crypto_close(cryptoInfo);
+		*retInfo = NULL;
+	}
+
+ret:
+	burn(header, sizeof(header));
+	return status;
+}
+
+/**
+Derive keys of unit tries in lockstep. FALSE if they can not be derived here
+(ReadVolumeHeader does the tries then) or jobs are cancelled.
+*/
+BOOL
+HeaderTryUnitDerive(
+	IN  HEADER_TRY_JOBS  *jobs,
+	IN  HEADER_TRY_UNIT  *unit,
+	OUT UINT8            dk[DCS_PBKDF2_LANES][MASTER_KEYDATA_SIZE],
+	OUT int              *iterations)
+{
+	EFI_STATUS    res;
+	UINT8         *dks[DCS_PBKDF2_LANES];
+	CONST UINT8   *salts[DCS_PBKDF2_LANES];
+	int           prf = jobs->Tries[unit->Idx[0]].Prf;
+	int           dkLen = GetMaxPkcs5OutSize();
+	UINT32        i;
+
+	*iterations = get_pkcs5_iteration_count(prf, jobs->Pim, jobs->Tc, jobs->Boot);
+	if (dkLen > MASTER_KEYDATA_SIZE || *iterations <= 0) return FALSE;
+	for (i = 0; i < unit->Count; ++i) {
+		salts[i] = (UINT8*)jobs->Tries[unit->Idx[i]].Header + HEADER_SALT_OFFSET;
+		dks[i] = dk[i];
+	}
+
+	if (prf == SHA512) {
+		res = DcsPbkdf2Sha512Mb((UINT8*)jobs->Pwd->Text, jobs->Pwd->Length, salts, PKCS5_SALT_SIZE, unit->Count, (UINT32)*iterations, dks, dkLen, &jobs->Cancel);
+	}	else {
+		res = DcsPbkdf2Sha256Mb((UINT8*)jobs->Pwd->Text, jobs->Pwd->Length, salts, PKCS5_SALT_SIZE, unit->Count, (UINT32)*iterations, dks, dkLen, &jobs->Cancel);
+	}
+	return !EFI_ERROR(res);
+}
+
+VOID
+EFIAPI
+HeaderTryWorker(
+	IN VOID  *ctx)
+{
+	HEADER_TRY_JOBS   *jobs = (HEADER_TRY_JOBS*)ctx;
+	HEADER_TRY_ARENA  *arena = HeaderTryArena();
+	HEADER_TRY_UNIT   *unit;
+	UINT8             dk[DCS_PBKDF2_LANES][MASTER_KEYDATA_SIZE];
+	BOOL              derived;
+	int               iterations;
+	UINT32            u;
+	UINT32            i;
+	while ((u = InterlockedIncrement(&jobs->Next) - 1) < jobs->UnitCount) {
+		unit = &jobs->Units[u];
+		if (jobs->Cancel) continue;
+		if (jobs->StopOnFound && jobs->Found < unit->Idx[0]) continue;
+		// Lane PRFs go through DcsPbkdf2 even alone - it stops on Cancel
+		derived = HeaderTryLaneKind(jobs->Tries[unit->Idx[0]].Prf, jobs->Tc) >= 0 &&
+			HeaderTryUnitDerive(jobs, unit, dk, &iterations);
+		for (i = 0; i < unit->Count; ++i) {
+			UINT32          idx = unit->Idx[i];
+			DCS_HEADER_TRY  *t = &jobs->Tries[idx];
+			PCRYPTO_INFO    ci = NULL;
+			if (jobs->Cancel) break;
+			if (jobs->StopOnFound && jobs->Found < idx) continue;
+			if (derived) {
+				t->Result = HeaderKeyOpen(t->Header, dk[i], t->Prf, iterations, jobs->Pim, &ci, t->HeaderCryptoInfo);
+			}	else {
+				t->Result = ReadVolumeHeader(jobs->Boot, t->Header, jobs->Pwd, t->Prf, jobs->Pim, jobs->Tc, &ci, t->HeaderCryptoInfo);
+			}
+			if (t->Result == 0) {
+				CopyMem(t->CryptoInfo, ci, sizeof(CRYPTO_INFO));
+				HeaderTryFound(jobs, idx);
+			}
+			if (arena != NULL) {
+				burn(arena->Base, arena->Used);
+				arena->Used = 0;
+			}	else if (ci != NULL) {
+				crypto_close(ci);
+			}
+		}
+	}
+	burn(dk, sizeof(dk));
+}
+
+/**
+Start workers on APs. Returns number of started APs, their events are in events.
+*/
+UINTN
+HeaderTryStartAPs(
+	IN HEADER_TRY_JOBS  *jobs,
+	IN EFI_EVENT        *events,
+	IN UINTN            maxAPs)
+{
+	EFI_STATUS                 res;
+	UINTN                      cpus = 0;
+	UINTN                      enabled = 0;
+	UINTN                      bsp = 0;
+	UINTN                      i;
+	UINTN                      started = 0;
+	EFI_PROCESSOR_INFORMATION  info;
+
+	if (EFI_ERROR(gHeaderTryMp->WhoAmI(gHeaderTryMp, &bsp)) ||
+		EFI_ERROR(gHeaderTryMp->GetNumberOfProcessors(gHeaderTryMp, &cpus, &enabled)) ||
+		enabled < 2) {
+		return 0;
+	}
+	gHeaderTryArenas = MEM_ALLOC(sizeof(HEADER_TRY_ARENA) * cpus);
+	if (gHeaderTryArenas == NULL) return 0;
+	gHeaderTryArenasCount = cpus;
+	gHeaderTryArenas[bsp].Base = MEM_ALLOC(HEADER_TRY_ARENA_SIZE);
+
+	for (i = 0; i < cpus && started < maxAPs; ++i) {
+		if (i == bsp) continue;
+		res = gHeaderTryMp->GetProcessorInfo(gHeaderTryMp, i, &info);
+		if (EFI_ERROR(res) || (info.StatusFlag & PROCESSOR_ENABLED_BIT) == 0) continue;
+		gHeaderTryArenas[i].Base = MEM_ALLOC(HEADER_TRY_ARENA_SIZE);
+		if (gHeaderTryArenas[i].Base == NULL) break;
+		res = gBS->CreateEvent(0, TPL_CALLBACK, NULL, NULL, &events[started]);
+		if (EFI_ERROR(res)) break;
+		res = gHeaderTryMp->StartupThisAP(gHeaderTryMp, HeaderTryWorker, i, events[started], 0, jobs, NULL);
+		if (EFI_ERROR(res)) {
+			gBS->CloseEvent(events[started]);
+			MEM_FREE(gHeaderTryArenas[i].Base);
+			gHeaderTryArenas[i].Base = NULL;
+			if (res == EFI_UNSUPPORTED) break; // no non-blocking mode
+			continue;
+		}
+		started++;
+	}
+	return started;
+}
+
+VOID
+HeaderTryArenasFree()
+{
+	UINTN i;
+	HEADER_TRY_ARENA* arenas = gHeaderTryArenas;
+	if (arenas == NULL) return;
+	gHeaderTryArenas = NULL;
+	for (i = 0; i < gHeaderTryArenasCount; ++i) {
+		if (arenas[i].Base != NULL) {
+			burn(arenas[i].Base, HEADER_TRY_ARENA_SIZE);
+			MEM_FREE(arenas[i].Base);
+		}
+	}
+	MEM_FREE(arenas);
+	gHeaderTryArenasCount = 0;
+}
+
+/**
+Prepare tries and start them on APs. With bspWorks BSP takes part in HeaderTryFinish,
+else all tries go to APs (nothing is started without MP).
+*/
+HEADER_TRY_JOBS*
+HeaderTryStart(
+	IN     BOOL            boot,
+	IN     Password        *pwd,
+	IN     int             pim,
+	IN     BOOL            tc,
+	IN OUT DCS_HEADER_TRY  *tries,
+	IN     UINTN           count,
+	IN     BOOLEAN         stopOnFound,
+	IN     BOOLEAN         bspWorks)
+{
+	HEADER_TRY_JOBS   *jobs;
+	UINTN             i;
+	UINTN             maxAPs = bspWorks ? count - 1 : count;
+	UINTN             workers = 1;
+	UINTN             cpus;
+	UINTN             enabled;
+
+	jobs = MEM_ALLOC(sizeof(HEADER_TRY_JOBS) + sizeof(HEADER_TRY_UNIT) * count);
+	if (jobs == NULL) return NULL;
+	for (i = 0; i < count; ++i) {
+		tries[i].Result = ERR_PASSWORD_WRONG;
+		tries[i].CryptoInfo = crypto_open();
+		if (tries[i].CryptoInfo == NULL) {
+			tries[i].Result = ERR_OUTOFMEMORY;
+			count = i;
+			break;
+		}
+	}
+
+	jobs->Boot = boot;
+	jobs->Pwd = pwd;
+	jobs->Pim = pim;
+	jobs->Tc = tc;
+	jobs->Tries = tries;
+	jobs->Count = (UINT32)count;
+	jobs->Units = (HEADER_TRY_UNIT*)(jobs + 1);
+	jobs->StopOnFound = stopOnFound;
+	jobs->Found = (UINT32)count;
+
+	if (gAuthParallel && maxAPs > 0 && gHeaderTryArenas == NULL &&
+		(gHeaderTryMp != NULL || !EFI_ERROR(gBS->LocateProtocol(&gEfiMpServiceProtocolGuid, NULL, (VOID**)&gHeaderTryMp)))) {
+		if (!EFI_ERROR(gHeaderTryMp->GetNumberOfProcessors(gHeaderTryMp, &cpus, &enabled)) && enabled > 1) {
+			workers = MIN(bspWorks ? enabled : enabled - 1, count);
+		}
+		HeaderTryUnitsBuild(jobs, workers);
+		jobs->Events = MEM_ALLOC(sizeof(EFI_EVENT) * maxAPs);
+		if (jobs->Events != NULL) {
+			jobs->Started = HeaderTryStartAPs(jobs, jobs->Events, maxAPs);
+		}
+	}	else {
+		HeaderTryUnitsBuild(jobs, workers);
+	}
+	return jobs;
+}
+
+/**
+Run rest of tries on BSP, wait APs and release jobs.
+Returns index of first decrypted header or -1.
+*/
+int
+HeaderTryFinish(
+	IN HEADER_TRY_JOBS  *jobs)
+{
+	DCS_HEADER_TRY    *tries = jobs->Tries;
+	UINTN             i;
+	int               found = -1;
+
+	HeaderTryWorker(jobs);
+	for (i = 0; i < jobs->Started; ++i) {
+		UINTN index;
+		gBS->WaitForEvent(1, &jobs->Events[i], &index);
+		gBS->CloseEvent(jobs->Events[i]);
+	}
+	HeaderTryArenasFree();
+	MEM_FREE(jobs->Events);
+
+	// Arena was too small - retry on BSP
+	for (i = 0; i < jobs->Count && !jobs->Cancel; ++i) {
+		if (tries[i].Result == ERR_OUTOFMEMORY) {
+			PCRYPTO_INFO ci = NULL;
+			tries[i].Result = ReadVolumeHeader(jobs->Boot, tries[i].Header, jobs->Pwd, tries[i].Prf, jobs->Pim, jobs->Tc, &ci, tries[i].HeaderCryptoInfo);
+			if (tries[i].Result == 0) {
+				CopyMem(tries[i].CryptoInfo, ci, sizeof(CRYPTO_INFO));
+				if (jobs->Found > i) jobs->Found = (UINT32)i;
+			}
+			if (ci != NULL) crypto_close(ci);
+		}
+	}
+
+	for (i = 0; i < jobs->Count; ++i) {
+		if (tries[i].Result == 0 && !jobs->Cancel && (!jobs->StopOnFound || i == jobs->Found)) {
+			if (found < 0) found = (int)i;
+			continue;
+		}
+		crypto_close(tries[i].CryptoInfo);
+		tries[i].CryptoInfo = NULL;
+	}
+	MEM_FREE(jobs);
+	return found;
+}
+
+/**
+Try to decrypt all headers in tries (on all processors if possible).
+Returns index of first decrypted header or -1.
+With stopOnFound only first decrypted try keeps CryptoInfo.
+*/
+int
+HeaderTryAll(
+	IN     BOOL            boot,
+	IN     Password        *pwd,
+	IN     int             pim,
+	IN     BOOL            tc,
+	IN OUT DCS_HEADER_TRY  *tries,
+	IN     UINTN           count,
+	IN     BOOLEAN         stopOnFound)
+{
+	HEADER_TRY_JOBS   *jobs;
+	jobs = HeaderTryStart(boot, pwd, pim, tc, tries, count, stopOnFound, TRUE);
+	if (jobs == NULL) return -1;
+	return HeaderTryFinish(jobs);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Speculative key derivation
+//////////////////////////////////////////////////////////////////////////
+// Tries registered by AuthSpecSet are derived on APs with configured PIM
+// and hash while VCAuthAsk asks the rest. Result is used only if answers
+// match, else it is wiped.
+int               gAuthSpeculate = 1;
+DCS_HEADER_TRY    *gAuthSpecTries = NULL;
+UINTN             gAuthSpecCount = 0;
+HEADER_TRY_JOBS   *gAuthSpecJobs = NULL;
+Password          gAuthSpecPassword;
+int               gAuthSpecPim;
+int               gAuthSpecHash;
+int               gAuthSpecTc;
+int               gAuthSpecBoot;
+int               gAuthSpecFound = AUTH_SPEC_NONE;
+
+VOID
+AuthSpecSet(
+	IN DCS_HEADER_TRY  *tries,
+	IN UINTN           count)
+{
+	gAuthSpecTries = tries;
+	gAuthSpecCount = count;
+	gAuthSpecFound = AUTH_SPEC_NONE;
+}
+
+/**
+TRUE if workers stop all tries within DcsPbkdf2 cancel interval. Other PRFs
+are derived by ReadVolumeHeader and can not be interrupted.
+*/
+BOOL
+AuthSpecCancelable()
+{
+	UINTN i;
+	for (i = 0; i < gAuthSpecCount; ++i) {
+		if (HeaderTryLaneKind(gAuthSpecTries[i].Prf, gAuthTc) < 0) return FALSE;
+	}
+	return TRUE;
+}
+
+VOID
+AuthSpecStart()
+{
+	gAuthSpecFound = AUTH_SPEC_NONE;
+	if (!gAuthSpeculate || gAuthSpecTries == NULL || gAuthSpecCount == 0) return;
+	if (!gAuthPimRqt && !gAuthHashRqt && !gAuthTcRqt && !gAuthBootRqt) return; // nothing to overlap
+	if (!AuthSpecCancelable()) return; // mismatch would wait for full derivation
+	CopyMem(&gAuthSpecPassword, &gAuthPassword, sizeof(gAuthSpecPassword));
+	gAuthSpecPim = gAuthPim;
+	gAuthSpecHash = gAuthHash;
+	gAuthSpecTc = gAuthTc;
+	gAuthSpecBoot = gAuthBoot;
+	gAuthSpecJobs = HeaderTryStart(gAuthSpecBoot, &gAuthSpecPassword, gAuthSpecPim, gAuthSpecTc,
+		gAuthSpecTries, gAuthSpecCount, TRUE, FALSE);
+	if (gAuthSpecJobs != NULL && gAuthSpecJobs->Started == 0) {
+		// No APs - do not block prompts
+		gAuthSpecJobs->Cancel = 1;
+		HeaderTryFinish(gAuthSpecJobs);
+		gAuthSpecJobs = NULL;
+	}
+	if (gAuthSpecJobs == NULL) burn(&gAuthSpecPassword, sizeof(gAuthSpecPassword));
+}
+
+VOID
+AuthSpecFinish()
+{
+	BOOLEAN match;
+	int     found;
+	if (gAuthSpecJobs == NULL) return;
+	match = gAuthSpecPim == gAuthPim && gAuthSpecHash == gAuthHash &&
+		gAuthSpecTc == gAuthTc && gAuthSpecBoot == gAuthBoot &&
+		CompareMem(&gAuthSpecPassword, &gAuthPassword, sizeof(gAuthSpecPassword)) == 0;
+	if (!match) gAuthSpecJobs->Cancel = 1;
+	found = HeaderTryFinish(gAuthSpecJobs);
+	gAuthSpecJobs = NULL;
+	burn(&gAuthSpecPassword, sizeof(gAuthSpecPassword));
+	gAuthSpecFound = match ? found : AUTH_SPEC_NONE;
+}
+
+/**
+Result of speculation for registered tries: index of decrypted try, -1 if all failed
+or AUTH_SPEC_NONE if tries have to be done. Registration is cleared.
+*/
+int
+AuthSpecResult()
+{
+	int found = gAuthSpecFound;
+	gAuthSpecFound = AUTH_SPEC_NONE;
+	gAuthSpecTries = NULL;
+	gAuthSpecCount = 0;
+	return found;
+}
+
+/**
+ReadVolumeHeader with PRFs of TEST ALL (prf == 0) derived in parallel
+*/
+int
+ReadVolumeHeaderMP(
+	IN  BOOL           boot,
+	IN  char           *header,
+	IN  Password       *pwd,
+	IN  int            prf,
+	IN  int            pim,
+	IN  BOOL           tc,
+	OUT PCRYPTO_INFO   *retInfo,
+	OUT CRYPTO_INFO    *retHeaderCryptoInfo)
+{
+	DCS_HEADER_TRY  tries[LAST_PRF_ID - FIRST_PRF_ID + 1];
+	UINTN           count = 0;
+	int             found;
+	int             vcres = ERR_PASSWORD_WRONG;
+	int             i;
+
+	if (prf != 0) {
+		return ReadVolumeHeader(boot, header, pwd, prf, pim, tc, retInfo, retHeaderCryptoInfo);
+	}
+
+	SetMem(tries, sizeof(tries), 0);
+	for (i = FIRST_PRF_ID; i <= LAST_PRF_ID; ++i) {
+		tries[count].Header = header;
+		tries[count].Prf = i;
+		if (retHeaderCryptoInfo != NULL) {
+			tries[count].HeaderCryptoInfo = crypto_open();
+			if (tries[count].HeaderCryptoInfo == NULL) break;
+		}
+		count++;
+	}
+
+	found = HeaderTryAll(boot, pwd, pim, tc, tries, count, TRUE);
+	if (found >= 0) {
+		*retInfo = tries[found].CryptoInfo;
+		if (retHeaderCryptoInfo != NULL) {
+			CopyMem(retHeaderCryptoInfo, tries[found].HeaderCryptoInfo, sizeof(CRYPTO_INFO));
+		}
+		vcres = 0;
+	}	else if (count == 0 || tries[0].Result == ERR_OUTOFMEMORY) {
+		vcres = ERR_OUTOFMEMORY;
+	}
+	for (i = 0; i < (int)count; ++i) {
+		crypto_close(tries[i].HeaderCryptoInfo);
+	}
+	return vcres;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Unlock hint
+//////////////////////////////////////////////////////////////////////////
+// Not secret: slot and PRF of last success to try first (opt-in AuthHint)
+CHAR16* sAuthHintVar = L"DcsAuthHint";
+
+EFI_STATUS
+AuthHintLoad(
+	OUT DCS_AUTH_HINT  *hint)
+{
+	EFI_STATUS     res;
+	DCS_AUTH_HINT  *data = NULL;
+	UINTN          size = 0;
+	UINT32         attr;
+	if (!gAuthHint) return EFI_NOT_READY;
+	res = EfiGetVar(sAuthHintVar, NULL, (VOID**)&data, &size, &attr);
+	if (EFI_ERROR(res)) return res;
+	if (size != sizeof(DCS_AUTH_HINT) || data->Signature != DCS_AUTH_HINT_SIGNATURE ||
+		data->Prf < FIRST_PRF_ID || data->Prf > LAST_PRF_ID) {
+		res = EFI_CRC_ERROR;
+	}	else {
+		CopyMem(hint, data, sizeof(DCS_AUTH_HINT));
+	}
+	MEM_FREE(data);
+	return res;
+}
+
+EFI_STATUS
+AuthHintSave(
+	IN UINT32  slot,
+	IN UINT32  prf)
+{
+	DCS_AUTH_HINT  hint;
+	DCS_AUTH_HINT  old;
+	if (!gAuthHint) return EFI_NOT_READY;
+	if (!EFI_ERROR(AuthHintLoad(&old)) && old.Slot == slot && old.Prf == prf) return EFI_SUCCESS;
+	hint.Signature = DCS_AUTH_HINT_SIGNATURE;
+	hint.Slot = slot;
+	hint.Prf = prf;
+	return EfiSetVar(sAuthHintVar, NULL, &hint, sizeof(hint), EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Reboot token
+//////////////////////////////////////////////////////////////////////////
+// One-shot unlock: secret of token slot is kept in boot services only variable
+CHAR16* sRebootTokenVar = L"DcsRebootToken";
+
+EFI_STATUS
+RebootTokenSave(
+	IN DCS_REBOOT_TOKEN  *token)
+{
+	token->Signature = DCS_REBOOT_TOKEN_SIGNATURE;
+	return EfiSetVar(sRebootTokenVar, NULL, token, sizeof(DCS_REBOOT_TOKEN), EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS);
+}
+
+/**
+Load and delete token (used once). EFI_TIMEOUT if expired, token->Slot still set.
+*/
+EFI_STATUS
+RebootTokenTake(
+	OUT DCS_REBOOT_TOKEN  *token)
+{
+	EFI_STATUS        res;
+	DCS_REBOOT_TOKEN  *data = NULL;
+	UINTN             size = 0;
+	UINT32            attr;
+	UINT64            now;
+	res = EfiGetVar(sRebootTokenVar, NULL, (VOID**)&data, &size, &attr);
+	if (EFI_ERROR(res)) return res;
+	EfiSetVar(sRebootTokenVar, NULL, NULL, 0, attr);
+	if (size != sizeof(DCS_REBOOT_TOKEN) || data->Signature != DCS_REBOOT_TOKEN_SIGNATURE) {
+		res = EFI_CRC_ERROR;
+	}	else {
+		now = EfiTimeNowSeconds();
+		if (now == 0 || now > data->Expires) {
+			ZeroMem(token, sizeof(DCS_REBOOT_TOKEN));
+			token->Slot = data->Slot;
+			res = EFI_TIMEOUT;
+		}	else {
+			CopyMem(token, data, sizeof(DCS_REBOOT_TOKEN));
+		}
+	}
+	burn(data, size);
+	MEM_FREE(data);
+	return res;
+}
+
+/**
+Password of token slot: secret bound to platform by platform key file
+*/
+VOID
+RebootTokenPassword(
+	IN  DCS_REBOOT_TOKEN  *token,
+	OUT Password          *pwd)
+{
+	ZeroMem(pwd, sizeof(Password));
+	pwd->Length = DCS_REBOOT_TOKEN_SECRET_SIZE;
+	CopyMem(pwd->Text, token->Secret, DCS_REBOOT_TOKEN_SECRET_SIZE);
+	if (gPlatformKeyFile != NULL) {
+		ApplyKeyFile(pwd, gPlatformKeyFile, gPlatformKeyFileSize);
+	}
+}
+
+CHAR16* sRebootTokenSlotVar = L"DcsRebootTokenSlot";
+
+EFI_STATUS
+RebootTokenSlotSave(
+	IN UINT32  slot,
+	IN UINT8   *header)
+{
+	DCS_REBOOT_TOKEN_SLOT  owner;
+	owner.Signature = DCS_REBOOT_TOKEN_SIGNATURE;
+	owner.Slot = slot;
+	owner.HeaderCrc = EfiCrc32(header, 512);
+	return EfiSetVar(sRebootTokenSlotVar, NULL, &owner, sizeof(owner), EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS);
 }
 
+/**
+TRUE if slot still holds token (or its wipe) written by DCS
+*/
+BOOLEAN
+RebootTokenSlotOwned(
+	IN UINT32  slot,
+	IN UINT8   *header)
+{
+	DCS_REBOOT_TOKEN_SLOT  *owner = NULL;
+	UINTN                  size = 0;
+	UINT32                 attr;
+	BOOLEAN                owned;
+
+	if (EFI_ERROR(EfiGetVar(sRebootTokenSlotVar, NULL, (VOID**)&owner, &size, &attr))) return FALSE;
+	owned = size == sizeof(DCS_REBOOT_TOKEN_SLOT) &&
+		owner->Signature == DCS_REBOOT_TOKEN_SIGNATURE &&
+		owner->Slot == slot &&
+		owner->HeaderCrc == EfiCrc32(header, 512);
+	MEM_FREE(owner);
+	return owned;
+}
 
 //////////////////////////////////////////////////////////////////////////
 // VeraCrypt helpers
 //////////////////////////////////////////////////////////////////////////
 void* VeraCryptMemAlloc(IN UINTN size) {
+   HEADER_TRY_ARENA* arena = HeaderTryArena();
+   if (arena != NULL) {
+      UINT8* ptr;
+      size = ALIGN_VALUE(size, 16);
+      if (arena->Used + size > HEADER_TRY_ARENA_SIZE) return NULL;
+      ptr = arena->Base + arena->Used;
+      arena->Used += size;
+      ZeroMem(ptr, size);
+      return ptr;
+   }
    return MEM_ALLOC(size);
 }
 
 void VeraCryptMemFree(IN VOID* ptr) {
+   if (HeaderTryArenaOwns(ptr)) return; // arena is released after job
    MEM_FREE(ptr);
 }
 void ThrowFatalException(int line) {
@@ -345,47 +1203,201 @@ RandgetBytes(unsigned char *buf, int len, BOOL forceSlowPoll) {
 
 #define KEYFILE_POOL_SIZE	64
 #define	KEYFILE_MAX_READ_LEN	(1024*1024)
+#define KEYFILE_CHUNK_SIZE	(64*1024)
+
+CHAR16* gKeyFiles = NULL;
+
+/**
+Key files are mixed to one pool as in VeraCrypt: CRC and write position restart
+for every file, pool bytes are added.
+*/
+typedef struct _KEYFILE_POOL {
+	UINT8   Pool[KEYFILE_POOL_SIZE];
+	UINT32  Crc;
+	UINTN   WritePos;
+	UINTN   TotalRead;
+} KEYFILE_POOL;
 
 VOID
-ApplyKeyFile(
-	IN OUT Password* password,
-	IN     CHAR8*    keyfileData,
-	IN     UINTN     keyfileDataSize
-	) 
+KeyFilePoolStart(
+	IN OUT KEYFILE_POOL  *kp)
+{
+	kp->Crc = 0xffffffff;
+	kp->WritePos = 0;
+	kp->TotalRead = 0;
+}
+
+/**
+Mix chunk of current key file. FALSE if KEYFILE_MAX_READ_LEN of file is reached.
+*/
+BOOLEAN
+KeyFilePoolUpdate(
+	IN OUT KEYFILE_POOL  *kp,
+	IN     CONST UINT8   *data,
+	IN     UINTN         len)
 {
-	unsigned __int32 crc = 0xffffffff;
-	int writePos = 0;
-	size_t totalRead = 0;
-	size_t i;
-	CHAR8 keyPool[KEYFILE_POOL_SIZE];
-	
-	ZeroMem(keyPool, sizeof(keyPool));
+	UINT32  crc = kp->Crc;
+	UINT8   *pos = kp->Pool + kp->WritePos;
+	UINT8   *end = kp->Pool + KEYFILE_POOL_SIZE;
+	UINTN   n;
+
+	n = KEYFILE_MAX_READ_LEN - kp->TotalRead;
+	if (n > len) n = len;
+	kp->TotalRead += n;
+	while (n-- > 0) {
+		crc = UPDC32(*data++, crc);
+		pos[0] += (UINT8)(crc >> 24);
+		pos[1] += (UINT8)(crc >> 16);
+		pos[2] += (UINT8)(crc >> 8);
+		pos[3] += (UINT8)crc;
+		pos += 4;
+		if (pos >= end) pos = kp->Pool;
+	}
+	kp->Crc = crc;
+	kp->WritePos = pos - kp->Pool;
+	return kp->TotalRead < KEYFILE_MAX_READ_LEN;
+}
 
-	for (i = 0; i < keyfileDataSize; i++)
+VOID
+KeyFilePoolApply(
+	IN     KEYFILE_POOL  *kp,
+	IN OUT Password      *password)
+{
+	UINTN i;
+	for (i = 0; i < sizeof(kp->Pool); i++)
 	{
-		crc = UPDC32(keyfileData[i], crc);
+		if (i < password->Length)
+			password->Text[i] += kp->Pool[i];
+		else
+			password->Text[i] = kp->Pool[i];
+	}
 
-		keyPool[writePos++] += (unsigned __int8)(crc >> 24);
-		keyPool[writePos++] += (unsigned __int8)(crc >> 16);
-		keyPool[writePos++] += (unsigned __int8)(crc >> 8);
-		keyPool[writePos++] += (unsigned __int8)crc;
+	if (password->Length < (int)sizeof(kp->Pool))
+		password->Length = sizeof(kp->Pool);
+}
 
-		if (writePos >= KEYFILE_POOL_SIZE)
-			writePos = 0;
+/**
+Stream file to pool by chunks. Empty key file is error.
+*/
+EFI_STATUS
+KeyFilePoolAddFile(
+	IN OUT KEYFILE_POOL  *kp,
+	IN     EFI_FILE      *file,
+	IN     UINT8         *chunk)
+{
+	EFI_STATUS  res;
+	UINTN       size;
+
+	KeyFilePoolStart(kp);
+	do {
+		size = KEYFILE_CHUNK_SIZE;
+		res = FileRead(file, chunk, &size, NULL);
+		if (EFI_ERROR(res)) return res;
+	} while (size > 0 && KeyFilePoolUpdate(kp, chunk, size));
+	return kp->TotalRead == 0 ? EFI_END_OF_FILE : EFI_SUCCESS;
+}
 
-		if (++totalRead >= KEYFILE_MAX_READ_LEN)
-			break;
+/**
+Add key file or all files of key file directory (not hidden, not recursive)
+*/
+EFI_STATUS
+KeyFilePoolAddPath(
+	IN OUT KEYFILE_POOL  *kp,
+	IN     CHAR16        *path,
+	IN     UINT8         *chunk)
+{
+	EFI_STATUS     res;
+	EFI_FILE       *file;
+	EFI_FILE       *item;
+	EFI_FILE_INFO  *info = NULL;
+	UINTN          infoSize;
+
+	res = FileOpen(NULL, path, &file, EFI_FILE_MODE_READ, 0);
+	if (EFI_ERROR(res)) return res;
+	res = FileGetInfo(file, &info, &infoSize);
+	if (EFI_ERROR(res)) goto error;
+
+	if ((info->Attribute & EFI_FILE_DIRECTORY) == 0) {
+		res = KeyFilePoolAddFile(kp, file, chunk);
+		goto error;
 	}
 
-	for (i = 0; i < sizeof(keyPool); i++)
-	{
-		if (i < password->Length)
-			password->Text[i] += keyPool[i];
-		else
-			password->Text[i] = keyPool[i];
+	// Directory entries are read to chunk
+	do {
+		EFI_FILE_INFO  *entry = (EFI_FILE_INFO*)chunk;
+		infoSize = KEYFILE_CHUNK_SIZE;
+		res = file->Read(file, &infoSize, entry);
+		if (EFI_ERROR(res) || infoSize == 0) break;
+		if ((entry->Attribute & (EFI_FILE_DIRECTORY | EFI_FILE_HIDDEN | EFI_FILE_SYSTEM)) != 0) continue;
+		res = FileOpen(file, entry->FileName, &item, EFI_FILE_MODE_READ, 0);
+		if (EFI_ERROR(res)) break;
+		res = KeyFilePoolAddFile(kp, item, chunk);
+		FileClose(item);
+	} while (!EFI_ERROR(res));
+
+error:
+	MEM_FREE(info);
+	FileClose(file);
+	return res;
+}
+
+/**
+Apply key files (and directories) listed in ';' separated keyFiles
+*/
+EFI_STATUS
+ApplyKeyFiles(
+	IN OUT Password  *password,
+	IN     CHAR16    *keyFiles)
+{
+	EFI_STATUS    res = EFI_SUCCESS;
+	KEYFILE_POOL  kp;
+	UINT8         *chunk;
+	CHAR16        *list;
+	CHAR16        *path;
+	CHAR16        *next;
+
+	ZeroMem(&kp, sizeof(kp));
+	chunk = MEM_ALLOC(KEYFILE_CHUNK_SIZE);
+	list = MEM_ALLOC(StrSize(keyFiles));
+	if (chunk == NULL || list == NULL) {
+		res = EFI_BUFFER_TOO_SMALL;
+		goto error;
+	}
+	CopyMem(list, keyFiles, StrSize(keyFiles));
+	for (path = list; path != NULL && *path != 0 && !EFI_ERROR(res); path = next) {
+		next = StrStr(path, L";");
+		if (next != NULL) *next++ = 0;
+		if (*path == 0) continue;
+		res = KeyFilePoolAddPath(&kp, path, chunk);
+		if (EFI_ERROR(res)) {
+			ERR_PRINT(L"Key file %s: %r\n", path, res);
+		}
+	}
+	if (!EFI_ERROR(res)) {
+		KeyFilePoolApply(&kp, password);
 	}
 
-	if (password->Length < (int)sizeof(keyPool))
-		password->Length = sizeof(keyPool);
+error:
+	burn(&kp, sizeof(kp));
+	if (chunk != NULL) {
+		burn(chunk, KEYFILE_CHUNK_SIZE);
+		MEM_FREE(chunk);
+	}
+	MEM_FREE(list);
+	return res;
+}
 
+VOID
+ApplyKeyFile(
+	IN OUT Password* password,
+	IN     CHAR8*    keyfileData,
+	IN     UINTN     keyfileDataSize
+	) 
+{
+	KEYFILE_POOL  kp;
+	ZeroMem(&kp, sizeof(kp));
+	KeyFilePoolStart(&kp);
+	KeyFilePoolUpdate(&kp, (UINT8*)keyfileData, keyfileDataSize);
+	KeyFilePoolApply(&kp, password);
+	burn(&kp, sizeof(kp));
 }
\ No newline at end of file
@@ -18,6 +18,7 @@ https://opensource.org/licenses/Apache-2.0
 #include <Uefi.h>
 #include <common/Tcdefs.h>
 #include <common/Password.h>
+#include <common/Crypto.h>
 
 //////////////////////////////////////////////////////////////////////////
 // Auth
@@ -45,6 +46,15 @@ extern int gAuthRetry;
 extern INT32 gRUD;
 
 extern int gAuthSecRegionSearch;
+extern int gAuthParallel;
+extern int gAuthHint;
+extern int gAuthSpeculate;
+extern int gAuthTpmSlot;
+extern int gAuthTpmPcrs;
+extern int gAuthTpmPin;
+
+extern char *ConfigBuffer;
+extern UINTN ConfigBufferSize;
 
 extern int gPlatformLocked;
 extern int gTPMLocked;
@@ -73,6 +83,128 @@ VCAskPwd(
 VOID
 VCAuthLoadConfig();
 
+//////////////////////////////////////////////////////////////////////////
+// Parallel header decrypt
+//////////////////////////////////////////////////////////////////////////
+typedef struct _DCS_HEADER_TRY {
+	char          *Header;            // IN encrypted header
+	int           Prf;                // IN PRF (0 - all serially)
+	CRYPTO_INFO   *HeaderCryptoInfo;  // IN optional, filled with header keys
+	UINTN         Tag;                // caller data
+	int           Result;             // OUT ReadVolumeHeader result
+	PCRYPTO_INFO  CryptoInfo;         // OUT on success (caller closes)
+} DCS_HEADER_TRY;
+
+int
+HeaderTryAll(
+	IN     BOOL            boot,
+	IN     Password        *pwd,
+	IN     int             pim,
+	IN     BOOL            tc,
+	IN OUT DCS_HEADER_TRY  *tries,
+	IN     UINTN           count,
+	IN     BOOLEAN         stopOnFound);
+
+int
+ReadVolumeHeaderMP(
+	IN  BOOL           boot,
+	IN  char           *header,
+	IN  Password       *pwd,
+	IN  int            prf,
+	IN  int            pim,
+	IN  BOOL           tc,
+	OUT PCRYPTO_INFO   *retInfo,
+	OUT CRYPTO_INFO    *retHeaderCryptoInfo);
+
+//////////////////////////////////////////////////////////////////////////
+// Speculative key derivation
+//////////////////////////////////////////////////////////////////////////
+#define AUTH_SPEC_NONE (-2)
+
+VOID
+AuthSpecSet(
+	IN DCS_HEADER_TRY  *tries,
+	IN UINTN           count);
+
+int
+AuthSpecResult();
+
+VOID
+AuthSpecStart();
+
+VOID
+AuthSpecFinish();
+
+//////////////////////////////////////////////////////////////////////////
+// Unlock hint
+//////////////////////////////////////////////////////////////////////////
+#define DCS_AUTH_HINT_SIGNATURE SIGNATURE_32('D','C','S','H')
+
+#pragma pack(1)
+typedef struct _DCS_AUTH_HINT {
+	UINT32        Signature;
+	UINT32        Slot;      // 128K slot of security region
+	UINT32        Prf;       // PRF id
+} DCS_AUTH_HINT;
+#pragma pack()
+
+EFI_STATUS
+AuthHintLoad(
+	OUT DCS_AUTH_HINT  *hint);
+
+EFI_STATUS
+AuthHintSave(
+	IN UINT32  slot,
+	IN UINT32  prf);
+
+//////////////////////////////////////////////////////////////////////////
+// Reboot token
+//////////////////////////////////////////////////////////////////////////
+#define DCS_REBOOT_TOKEN_SIGNATURE   SIGNATURE_32('D','C','R','T')
+#define DCS_REBOOT_TOKEN_SECRET_SIZE 64
+#define DCS_REBOOT_TOKEN_PIM         1
+
+#pragma pack(1)
+typedef struct _DCS_REBOOT_TOKEN {
+	UINT32        Signature;
+	UINT32        Slot;      // 128K slot of security region
+	UINT64        Expires;   // seconds since 1970 (RTC)
+	UINT8         Secret[DCS_REBOOT_TOKEN_SECRET_SIZE];
+} DCS_REBOOT_TOKEN;
+#pragma pack()
+
+EFI_STATUS
+RebootTokenSave(
+	IN DCS_REBOOT_TOKEN  *token);
+
+EFI_STATUS
+RebootTokenTake(
+	OUT DCS_REBOOT_TOKEN  *token);
+
+VOID
+RebootTokenPassword(
+	IN  DCS_REBOOT_TOKEN  *token,
+	OUT Password          *pwd);
+
+// Free slots are random data, so slot used by tokens is recorded aside
+#pragma pack(1)
+typedef struct _DCS_REBOOT_TOKEN_SLOT {
+	UINT32        Signature; // DCS_REBOOT_TOKEN_SIGNATURE
+	UINT32        Slot;
+	UINT32        HeaderCrc; // first sector written by token create or wipe
+} DCS_REBOOT_TOKEN_SLOT;
+#pragma pack()
+
+EFI_STATUS
+RebootTokenSlotSave(
+	IN UINT32  slot,
+	IN UINT8   *header);
+
+BOOLEAN
+RebootTokenSlotOwned(
+	IN UINT32  slot,
+	IN UINT8   *header);
+
 VOID
 ApplyKeyFile(
 	IN OUT Password* password,
@@ -80,5 +212,12 @@ ApplyKeyFile(
 	IN     UINTN     keyfileDataSize
 	);
 
+extern CHAR16* gKeyFiles;
+
+EFI_STATUS
+ApplyKeyFiles(
+	IN OUT Password  *password,
+	IN     CHAR16    *keyFiles);
+
 #endif
 